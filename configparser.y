@@ -114,12 +114,15 @@ struct component {
 %token VAR_REFUSE_ANY
 %token VAR_ZONEFILES_CHECK
 %token VAR_ZONEFILES_WRITE
+%token VAR_ZONEFILES_LOAD_WORKERS
 %token VAR_RRL_SIZE
 %token VAR_RRL_RATELIMIT
 %token VAR_RRL_SLIP
 %token VAR_RRL_IPV4_PREFIX_LENGTH
 %token VAR_RRL_IPV6_PREFIX_LENGTH
 %token VAR_RRL_WHITELIST_RATELIMIT
+%token VAR_RRL_PREFIX_RATELIMIT
+%token VAR_RRL_TOKEN_BUCKET
 %token VAR_TLS_SERVICE_KEY
 %token VAR_TLS_SERVICE_PEM
 %token VAR_TLS_SERVICE_OCSP
@@ -131,6 +134,7 @@ struct component {
 %token VAR_DROP_UPDATES
 %token VAR_XFRD_TCP_MAX
 %token VAR_XFRD_TCP_PIPELINE
+%token VAR_IXFR_PACK_CACHE_SIZE
 
 /* dnstap */
 %token VAR_DNSTAP
@@ -142,6 +146,9 @@ struct component {
 %token VAR_DNSTAP_VERSION
 %token VAR_DNSTAP_LOG_AUTH_QUERY_MESSAGES
 %token VAR_DNSTAP_LOG_AUTH_RESPONSE_MESSAGES
+%token VAR_DNSTAP_SAMPLE_RATE
+%token VAR_DNSTAP_LOG_QTYPES
+%token VAR_DNSTAP_LOG_RCODES
 
 /* remote-control */
 %token VAR_REMOTE_CONTROL
@@ -195,6 +202,8 @@ struct component {
 %token VAR_IXFR_SIZE
 %token VAR_IXFR_NUMBER
 %token VAR_CREATE_IXFR
+%token VAR_CONDENSE_IXFR
+%token VAR_BINARY_IXFR
 
 /* zone */
 %token VAR_ZONE
@@ -424,7 +433,7 @@ server_option:
   | VAR_RRL_IPV6_PREFIX_LENGTH number
     {
 #ifdef RATELIMIT
-      if ($2 > 64) {
+      if ($2 > 128) {
         yyerror("invalid IPv6 prefix length");
       } else {
         cfg_parser->opt->rrl_ipv6_prefix_length = (size_t)$2;
@@ -435,12 +444,43 @@ server_option:
     {
 #ifdef RATELIMIT
       cfg_parser->opt->rrl_whitelist_ratelimit = (size_t)$2;
+#endif
+    }
+  | VAR_RRL_PREFIX_RATELIMIT STRING number
+    {
+#ifdef RATELIMIT
+      if(!rrl_prefix_parse($2, NULL, NULL, NULL)) {
+        yyerror("expected an address or address/prefixlen");
+      } else {
+        struct rrl_prefix_option *p, **last =
+          &cfg_parser->opt->rrl_prefixes;
+        p = region_alloc_zero(cfg_parser->opt->region, sizeof(*p));
+        p->address = region_strdup(cfg_parser->opt->region, $2);
+        p->ratelimit = (size_t)$3;
+        while(*last)
+          last = &(*last)->next;
+        *last = p;
+      }
+#endif
+    }
+  | VAR_RRL_TOKEN_BUCKET boolean
+    {
+#ifdef RATELIMIT
+      cfg_parser->opt->rrl_token_bucket = $2;
 #endif
     }
   | VAR_ZONEFILES_CHECK boolean
     { cfg_parser->opt->zonefiles_check = $2; }
   | VAR_ZONEFILES_WRITE number
     { cfg_parser->opt->zonefiles_write = (int)$2; }
+  | VAR_ZONEFILES_LOAD_WORKERS number
+    {
+      if ($2 > 0) {
+        cfg_parser->opt->zonefiles_load_workers = (int)$2;
+      } else {
+        yyerror("expected a number greater than zero");
+      }
+    }
   | VAR_LOG_TIME_ASCII boolean
     {
       cfg_parser->opt->log_time_ascii = $2;
@@ -485,6 +525,8 @@ server_option:
     { cfg_parser->opt->xfrd_tcp_max = (int)$2; }
   | VAR_XFRD_TCP_PIPELINE number
     { cfg_parser->opt->xfrd_tcp_pipeline = (int)$2; }
+  | VAR_IXFR_PACK_CACHE_SIZE number
+    { cfg_parser->opt->ixfr_pack_cache_size = (size_t)$2; }
   | VAR_CPU_AFFINITY cpus
     {
       cfg_parser->opt->cpu_affinity = $2;
@@ -627,6 +669,22 @@ dnstap_option:
     { cfg_parser->opt->dnstap_log_auth_query_messages = $2; }
   | VAR_DNSTAP_LOG_AUTH_RESPONSE_MESSAGES boolean
     { cfg_parser->opt->dnstap_log_auth_response_messages = $2; }
+  | VAR_DNSTAP_SAMPLE_RATE number
+    { cfg_parser->opt->dnstap_sample_rate = (int)$2; }
+  | VAR_DNSTAP_LOG_QTYPES STRING
+    {
+      if(!dnstap_parse_qtypes($2, NULL))
+        yyerror("expected a list of query types");
+      else
+        cfg_parser->opt->dnstap_log_qtypes = region_strdup(cfg_parser->opt->region, $2);
+    }
+  | VAR_DNSTAP_LOG_RCODES STRING
+    {
+      if(!dnstap_parse_rcodes($2, NULL))
+        yyerror("expected a list of rcodes");
+      else
+        cfg_parser->opt->dnstap_log_rcodes = region_strdup(cfg_parser->opt->region, $2);
+    }
   ;
 
 remote_control:
@@ -1008,6 +1066,16 @@ pattern_or_zone_option:
       cfg_parser->pattern->create_ixfr = $2;
       cfg_parser->pattern->create_ixfr_is_default = 0;
     }
+  | VAR_CONDENSE_IXFR boolean
+    {
+      cfg_parser->pattern->condense_ixfr = $2;
+      cfg_parser->pattern->condense_ixfr_is_default = 0;
+    }
+  | VAR_BINARY_IXFR boolean
+    {
+      cfg_parser->pattern->binary_ixfr = $2;
+      cfg_parser->pattern->binary_ixfr_is_default = 0;
+    }
   | VAR_VERIFY_ZONE boolean
     { cfg_parser->pattern->verify_zone = $2; }
   | VAR_VERIFIER command
@@ -11,12 +11,16 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "dns.h"
 #include "namedb.h"
@@ -237,6 +241,8 @@ namedb_zone_create(namedb_type* db, const dname_type* dname,
 	zone->hashtree = NULL;
 	zone->wchashtree = NULL;
 	zone->dshashtree = NULL;
+	zone->nsec3index = NULL;
+	zone->nsec3index_count = 0;
 #endif
 	zone->opts = zo;
 	zone->ixfr = NULL;
@@ -283,6 +289,7 @@ namedb_zone_delete(namedb_type* db, zone_type* zone)
 	hash_tree_delete(db->region, zone->hashtree);
 	hash_tree_delete(db->region, zone->wchashtree);
 	hash_tree_delete(db->region, zone->dshashtree);
+	nsec3_hash_index_clear(zone);
 #endif
 	zone_ixfr_free(zone->ixfr);
 	if(zone->filename)
@@ -401,7 +408,13 @@ namedb_open (const char* filename, struct nsd_options* opt)
 	region_type* db_region;
 	int fd;
 
-#ifdef USE_MMAP_ALLOC
+#if defined(USE_NAMEDB_ARENA)
+	/* the zone data is packed in large slabs, the server children
+	 * forked off later share those pages as long as they only read */
+	db_region = region_create_custom(mmap_alloc, mmap_free,
+		NAMEDB_ARENA_CHUNK_SIZE, NAMEDB_ARENA_LARGE_OBJECT_SIZE,
+		NAMEDB_ARENA_INITIAL_CLEANUP_SIZE, 1);
+#elif defined(USE_MMAP_ALLOC)
 	db_region = region_create_custom(mmap_alloc, mmap_free, MMAP_ALLOC_CHUNK_SIZE,
 		MMAP_ALLOC_LARGE_OBJECT_SIZE, MMAP_ALLOC_INITIAL_CLEANUP_SIZE, 1);
 #else /* !USE_MMAP_ALLOC */
@@ -490,23 +503,20 @@ file_get_mtime(const char* file, struct timespec* mtime, int* nonexist)
 	return 1;
 }
 
-void
-namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
-	udb_ptr* last_task)
+/** see if the zonefile has to be read, returns filename or NULL if not */
+static const char*
+zonefile_needs_read(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
+	udb_ptr* last_task, struct timespec* mtime)
 {
-	struct timespec mtime;
 	int nonexist = 0;
-	unsigned int errors;
 	const char* fname;
-	struct ixfr_create* ixfrcr = NULL;
-	int ixfr_create_already_done = 0;
 	if(!nsd->db || !zone || !zone->opts || !zone->opts->pattern->zonefile)
-		return;
-	mtime.tv_sec = 0;
-	mtime.tv_nsec = 0;
+		return NULL;
+	mtime->tv_sec = 0;
+	mtime->tv_nsec = 0;
 	fname = config_make_zonefile(zone->opts, nsd);
 	assert(fname);
-	if(!file_get_mtime(fname, &mtime, &nonexist)) {
+	if(!file_get_mtime(fname, mtime, &nonexist)) {
 		if(nonexist) {
 			if(zone_is_slave(zone->opts)) {
 				/* for slave zones not as bad, no zonefile
@@ -523,7 +533,7 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 			log_msg(LOG_ERR, "zonefile %s: %s",
 				fname, strerror(errno));
 		if(taskudb) task_new_soainfo(taskudb, last_task, zone, 0);
-		return;
+		return NULL;
 	} else {
 		const char* zone_fname = zone->filename;
 		struct timespec zone_mtime = zone->mtime;
@@ -540,20 +550,112 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 		 * see if the file is newer than the zone transfer
 		 * (regardless if this is a different file), because the
 		 * zone transfer is a different content source too */
-		if(!zone_fname && timespec_compare(&zone_mtime, &mtime) >= 0) {
+		if(!zone_fname && timespec_compare(&zone_mtime, mtime) >= 0) {
 			VERBOSITY(3, (LOG_INFO, "zonefile %s is older than "
 				"zone transfer in memory", fname));
-			return;
+			return NULL;
 
 		/* if zone_fname, then the file was acquired from reading it,
 		 * and see if filename changed or mtime newer to read it */
 		} else if(zone_fname && strcmp(zone_fname, fname) == 0 &&
-		   timespec_compare(&zone_mtime, &mtime) == 0) {
+		   timespec_compare(&zone_mtime, mtime) == 0) {
 			VERBOSITY(3, (LOG_INFO, "zonefile %s is not modified",
 				fname));
-			return;
+			return NULL;
+		}
+	}
+	return fname;
+}
+
+/** the zonefile has been read without errors, note it in the zone */
+static void
+zonefile_read_success(struct nsd* nsd, struct zone* zone, const char* fname,
+	struct timespec* mtime)
+{
+	VERBOSITY(1, (LOG_INFO, "zone %s read with success",
+		zone->opts->name));
+	zone->is_ok = 1;
+	zone->is_changed = 0;
+	/* store zone into udb */
+	if(nsd->db->udb) {
+		if(!write_zone_to_udb(nsd->db->udb, zone, mtime, fname)) {
+			log_msg(LOG_ERR, "failed to store zone in db");
+		} else {
+			VERBOSITY(2, (LOG_INFO, "zone %s written to db",
+				zone->opts->name));
+		}
+	} else {
+		zone->mtime = *mtime;
+		if(zone->filename)
+			region_recycle(nsd->db->region, zone->filename,
+				strlen(zone->filename)+1);
+		zone->filename = region_strdup(nsd->db->region, fname);
+		if(zone->logstr)
+			region_recycle(nsd->db->region, zone->logstr,
+				strlen(zone->logstr)+1);
+		zone->logstr = NULL;
+	}
+}
+
+/** handle a zonefile that is read with errors, it reverts the zone to
+ * the udb stored version, if any, returns 0 if the zone contents is lost
+ * and that has been reported to the task list already */
+static int
+zonefile_read_errors(struct nsd* nsd, struct zone* zone, const char* fname,
+	unsigned int errors, udb_base* taskudb, udb_ptr* last_task)
+{
+	log_msg(LOG_ERR, "zone %s file %s read with %u errors",
+		zone->opts->name, fname, errors);
+	/* wipe (partial) zone from memory */
+	zone->is_ok = 1;
+#ifdef NSEC3
+	nsec3_clear_precompile(nsd->db, zone);
+	zone->nsec3_param = NULL;
+#endif
+	delete_zone_rrs(nsd->db, zone);
+	if(nsd->db->udb) {
+		region_type* dname_region;
+		udb_ptr z;
+		/* see if we can revert to the udb stored version */
+		if(!udb_zone_search(nsd->db->udb, &z, dname_name(domain_dname(
+			zone->apex)), domain_dname(zone->apex)->name_size)) {
+			/* tell that zone contents has been lost */
+			if(taskudb) task_new_soainfo(taskudb, last_task, zone, 0);
+			return 0;
 		}
+		/* read from udb */
+		dname_region = region_create(xalloc, free);
+		udb_rrsets = 0;
+		udb_rrset_count = ZONE(&z)->rrset_count;
+		udb_time = time(NULL);
+		read_zone_data(nsd->db->udb, nsd->db, dname_region, &z, zone);
+		region_destroy(dname_region);
+		udb_ptr_unlink(&z, nsd->db->udb);
+	} else {
+		if(zone->filename)
+			region_recycle(nsd->db->region, zone->filename,
+				strlen(zone->filename)+1);
+		zone->filename = NULL;
+		if(zone->logstr)
+			region_recycle(nsd->db->region, zone->logstr,
+				strlen(zone->logstr)+1);
+		zone->logstr = NULL;
 	}
+	return 1;
+}
+
+void
+namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
+	udb_ptr* last_task)
+{
+	struct timespec mtime;
+	unsigned int errors;
+	const char* fname;
+	struct ixfr_create* ixfrcr = NULL;
+	int ixfr_create_already_done = 0;
+	fname = zonefile_needs_read(nsd, zone, taskudb, last_task, &mtime);
+	if(!fname)
+		return;
 	if(ixfr_create_from_difference(zone, fname,
 		&ixfr_create_already_done)) {
 		ixfrcr = ixfr_create_start(zone, fname,
@@ -573,69 +675,13 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 	delete_zone_rrs(nsd->db, zone);
 	errors = zonec_read(zone->opts->name, fname, zone);
 	if(errors > 0) {
-		log_msg(LOG_ERR, "zone %s file %s read with %u errors",
-			zone->opts->name, fname, errors);
-		/* wipe (partial) zone from memory */
-		zone->is_ok = 1;
-#ifdef NSEC3
-		nsec3_clear_precompile(nsd->db, zone);
-		zone->nsec3_param = NULL;
-#endif
-		delete_zone_rrs(nsd->db, zone);
-		if(nsd->db->udb) {
-			region_type* dname_region;
-			udb_ptr z;
-			/* see if we can revert to the udb stored version */
-			if(!udb_zone_search(nsd->db->udb, &z, dname_name(domain_dname(
-				zone->apex)), domain_dname(zone->apex)->name_size)) {
-				/* tell that zone contents has been lost */
-				if(taskudb) task_new_soainfo(taskudb, last_task, zone, 0);
-				ixfr_create_cancel(ixfrcr);
-				return;
-			}
-			/* read from udb */
-			dname_region = region_create(xalloc, free);
-			udb_rrsets = 0;
-			udb_rrset_count = ZONE(&z)->rrset_count;
-			udb_time = time(NULL);
-			read_zone_data(nsd->db->udb, nsd->db, dname_region, &z, zone);
-			region_destroy(dname_region);
-			udb_ptr_unlink(&z, nsd->db->udb);
-		} else {
-			if(zone->filename)
-				region_recycle(nsd->db->region, zone->filename,
-					strlen(zone->filename)+1);
-			zone->filename = NULL;
-			if(zone->logstr)
-				region_recycle(nsd->db->region, zone->logstr,
-					strlen(zone->logstr)+1);
-			zone->logstr = NULL;
+		if(!zonefile_read_errors(nsd, zone, fname, errors, taskudb,
+			last_task)) {
+			ixfr_create_cancel(ixfrcr);
+			return;
 		}
 	} else {
-		VERBOSITY(1, (LOG_INFO, "zone %s read with success",
-			zone->opts->name));
-		zone->is_ok = 1;
-		zone->is_changed = 0;
-		/* store zone into udb */
-		if(nsd->db->udb) {
-			if(!write_zone_to_udb(nsd->db->udb, zone, &mtime,
-				fname)) {
-				log_msg(LOG_ERR, "failed to store zone in db");
-			} else {
-				VERBOSITY(2, (LOG_INFO, "zone %s written to db",
-					zone->opts->name));
-			}
-		} else {
-			zone->mtime = mtime;
-			if(zone->filename)
-				region_recycle(nsd->db->region, zone->filename,
-					strlen(zone->filename)+1);
-			zone->filename = region_strdup(nsd->db->region, fname);
-			if(zone->logstr)
-				region_recycle(nsd->db->region, zone->logstr,
-					strlen(zone->logstr)+1);
-			zone->logstr = NULL;
-		}
+		zonefile_read_success(nsd, zone, fname, &mtime);
 		if(ixfr_create_already_done) {
 			ixfr_readup_exist(zone, nsd, fname);
 		} else if(ixfrcr) {
@@ -670,10 +716,271 @@ void namedb_check_zonefile(struct nsd* nsd, udb_base* taskudb,
 	namedb_read_zonefile(nsd, zone, taskudb, last_task);
 }
 
+#ifdef HAVE_MMAP
+/** a zonefile that is read by a zonefile load worker */
+struct zonefile_load {
+	struct zone* zone;
+	char* fname;
+	struct timespec mtime;
+};
+
+/** filename of the temporary file that a zonefile load worker writes */
+static void
+zonefile_load_tmpname(char* buf, size_t len, struct nsd* nsd, pid_t pid,
+	int num)
+{
+	snprintf(buf, len, "%snsd-xfr-%d/nsd.%u.zload.%d",
+		nsd->options->xfrdir, (int)nsd->pid, (unsigned)pid, num);
+}
+
+/** zonefile load worker process, it reads every n-th zonefile from the
+ * list and stores the zones that are read without errors in the file,
+ * the number of errors for a zone is reported in the shared errors array */
+static void
+zonefile_load_worker(struct nsd* nsd, struct zonefile_load* list,
+	size_t num, int w, int workers, const char* tmpname,
+	unsigned int* errors)
+{
+	udb_base* udb;
+	size_t i;
+	if(!(udb = udb_base_create_new(tmpname, &namedb_walkfunc, NULL)))
+		_exit(1);
+	if(!udb_dns_init_file(udb)) {
+		udb_base_free(udb);
+		_exit(1);
+	}
+	for(i=(size_t)w; i<num; i+=(size_t)workers) {
+		zone_type* zone = list[i].zone;
+		unsigned int e;
+#ifdef NSEC3
+		nsec3_clear_precompile(nsd->db, zone);
+		zone->nsec3_param = NULL;
+#endif
+		delete_zone_rrs(nsd->db, zone);
+		e = zonec_read(zone->opts->name, list[i].fname, zone);
+		errors[i] = e;
+		if(e == 0 && !write_zone_to_udb(udb, zone, &list[i].mtime,
+			list[i].fname)) {
+			udb_ptr z;
+			log_msg(LOG_ERR, "zone %s: failed to store in %s",
+				zone->opts->name, tmpname);
+			/* remove the partially stored zone, the main
+			 * process reads the zonefile itself */
+			if(udb_zone_search(udb, &z, dname_name(domain_dname(
+				zone->apex)), domain_dname(zone->apex)->name_size)) {
+				udb_zone_delete(udb, &z);
+				udb_ptr_unlink(&z, udb);
+			}
+		}
+		if(nsd->signal_hint_shutdown) break;
+	}
+	udb_base_free(udb);
+	_exit(0);
+}
+
+/** put the zone read by a zonefile load worker into the namedb */
+static void
+zonefile_load_from_worker(struct nsd* nsd, udb_base* udb, udb_ptr* z,
+	struct zonefile_load* load, udb_base* taskudb, udb_ptr* last_task)
+{
+	zone_type* zone = load->zone;
+	region_type* dname_region;
+#ifdef NSEC3
+	nsec3_clear_precompile(nsd->db, zone);
+	zone->nsec3_param = NULL;
+#endif
+	delete_zone_rrs(nsd->db, zone);
+	dname_region = region_create(xalloc, free);
+	udb_rrsets = 0;
+	udb_rrset_count = ZONE(z)->rrset_count;
+	udb_time = time(NULL);
+	read_zone_data(udb, nsd->db, dname_region, z, zone);
+	region_destroy(dname_region);
+	zonefile_read_success(nsd, zone, load->fname, &load->mtime);
+	if(zone_is_ixfr_enabled(zone))
+		ixfr_read_from_file(nsd, zone, load->fname);
+	if(taskudb) task_new_soainfo(taskudb, last_task, zone, 0);
+#ifdef NSEC3
+	prehash_zone_complete(nsd->db, zone);
+#endif
+}
+
+/** read the zonefiles in the list with worker processes in parallel */
+static void
+zonefile_load_parallel(struct nsd* nsd, struct zonefile_load* list,
+	size_t num, udb_base* taskudb, udb_ptr* last_task)
+{
+	int workers = nsd->options->zonefiles_load_workers;
+	pid_t* pids;
+	udb_base** udbs;
+	unsigned int* errors;
+	char tmpname[1024];
+	pid_t mypid = getpid();
+	size_t i;
+	int w;
+
+#ifdef MAP_ANONYMOUS
+	/* the workers report the number of errors per zone in here */
+	errors = (unsigned int*)mmap(NULL, num*sizeof(unsigned int),
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(errors == MAP_FAILED) {
+		log_msg(LOG_ERR, "mmap failed: %s", strerror(errno));
+		errors = NULL;
+	}
+#else
+	errors = NULL;
+#endif
+	if(!errors) {
+		for(i=0; i<num; i++) {
+			namedb_read_zonefile(nsd, list[i].zone, taskudb,
+				last_task);
+			if(nsd->signal_hint_shutdown) break;
+		}
+		return;
+	}
+	memset(errors, 0, num*sizeof(unsigned int));
+
+	if((size_t)workers > num)
+		workers = (int)num;
+	pids = (pid_t*)xalloc_array_zero((size_t)workers, sizeof(pid_t));
+	udbs = (udb_base**)xalloc_array_zero((size_t)workers,
+		sizeof(udb_base*));
+	for(w=0; w<workers; w++) {
+		zonefile_load_tmpname(tmpname, sizeof(tmpname), nsd, mypid, w);
+		switch((pids[w] = fork())) {
+		case -1:
+			log_msg(LOG_ERR, "fork failed: %s", strerror(errno));
+			break;
+		case 0:
+			zonefile_load_worker(nsd, list, num, w, workers,
+				tmpname, errors);
+			break;
+		default:
+			break;
+		}
+		if(pids[w] == -1)
+			break;
+	}
+	for(w=0; w<workers; w++) {
+		int status = 0;
+		if(pids[w] <= 0)
+			continue;
+		while(waitpid(pids[w], &status, 0) == -1) {
+			if(errno != EINTR) {
+				log_msg(LOG_ERR, "waitpid: %s",
+					strerror(errno));
+				status = -1;
+				break;
+			}
+		}
+		zonefile_load_tmpname(tmpname, sizeof(tmpname), nsd, mypid, w);
+		if(status != -1 && WIFEXITED(status) &&
+			WEXITSTATUS(status) == 0) {
+			udbs[w] = udb_base_create_read(tmpname,
+				&namedb_walkfunc, NULL);
+			/* a nonzero userflag means a write did not finish */
+			if(udbs[w] && udb_base_get_userflags(udbs[w]) != 0) {
+				log_msg(LOG_ERR, "zonefile load worker %d: "
+					"%s is not complete", w, tmpname);
+				udb_base_free(udbs[w]);
+				udbs[w] = NULL;
+			}
+		} else {
+			log_msg(LOG_ERR, "zonefile load worker %d failed, "
+				"reading its zonefiles again", w);
+		}
+		unlink(tmpname);
+	}
+
+	/* the zones of a worker that failed and the zones that the worker
+	 * could not store are read here, the zones with errors are not
+	 * read again, the worker has reported the errors for them */
+	for(i=0; i<num; i++) {
+		udb_base* udb = udbs[i%(size_t)workers];
+		zone_type* zone = list[i].zone;
+		udb_ptr z;
+		if(udb && errors[i] > 0) {
+			if(zonefile_read_errors(nsd, zone, list[i].fname,
+				errors[i], taskudb, last_task)) {
+				if(taskudb) task_new_soainfo(taskudb,
+					last_task, zone, 0);
+#ifdef NSEC3
+				prehash_zone_complete(nsd->db, zone);
+#endif
+			}
+		} else if(udb && udb_zone_search(udb, &z, dname_name(
+			domain_dname(zone->apex)),
+			domain_dname(zone->apex)->name_size)) {
+			zonefile_load_from_worker(nsd, udb, &z, &list[i],
+				taskudb, last_task);
+			udb_ptr_unlink(&z, udb);
+		} else {
+			namedb_read_zonefile(nsd, zone, taskudb, last_task);
+		}
+		if(nsd->signal_hint_shutdown) break;
+	}
+	for(w=0; w<workers; w++) {
+		if(udbs[w])
+			udb_base_free(udbs[w]);
+	}
+	munmap(errors, num*sizeof(unsigned int));
+	free(udbs);
+	free(pids);
+}
+#endif /* HAVE_MMAP */
+
 void namedb_check_zonefiles(struct nsd* nsd, struct nsd_options* opt,
 	udb_base* taskudb, udb_ptr* last_task)
 {
 	struct zone_options* zo;
+#ifdef HAVE_MMAP
+	struct zonefile_load* list = NULL;
+	size_t num = 0, max = 0;
+	if(opt->zonefiles_load_workers > 1) {
+		/* collect the zonefiles that need to be read */
+		RBTREE_FOR(zo, struct zone_options*, opt->zone_options) {
+			const dname_type* dname = (const dname_type*)
+				zo->node.key;
+			zone_type* zone = namedb_find_zone(nsd->db, dname);
+			struct timespec mtime;
+			const char* fname;
+			if(!zone)
+				zone = namedb_zone_create(nsd->db, dname, zo);
+			if(zone_is_ixfr_enabled(zone) &&
+				zone->opts->pattern->create_ixfr) {
+				/* the ixfr is created from the zone in
+				 * memory, read it here */
+				namedb_read_zonefile(nsd, zone, taskudb,
+					last_task);
+				continue;
+			}
+			if(!(fname = zonefile_needs_read(nsd, zone, taskudb,
+				last_task, &mtime)))
+				continue;
+			if(num == max) {
+				max = (max==0?64:max*2);
+				list = (struct zonefile_load*)xrealloc(list,
+					max*sizeof(*list));
+			}
+			list[num].zone = zone;
+			/* copy, config_make_zonefile uses a static buffer */
+			list[num].fname = xstrdup(fname);
+			list[num].mtime = mtime;
+			num++;
+			if(nsd->signal_hint_shutdown) break;
+		}
+		if(num > 1)
+			zonefile_load_parallel(nsd, list, num, taskudb,
+				last_task);
+		else if(num == 1)
+			namedb_read_zonefile(nsd, list[0].zone, taskudb,
+				last_task);
+		while(num > 0)
+			free(list[--num].fname);
+		free(list);
+		return;
+	}
+#endif /* HAVE_MMAP */
 	/* check all zones in opt, create if not exist in main db */
 	RBTREE_FOR(zo, struct zone_options*, opt->zone_options) {
 		namedb_check_zonefile(nsd, taskudb, last_task, zo);
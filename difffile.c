@@ -13,6 +13,12 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif /* HAVE_MMAP */
 #include "difffile.h"
 #include "xfrd-disk.h"
 #include "util.h"
@@ -45,6 +51,13 @@ write_8(FILE *out, uint8_t val)
 	return write_data(out, &val, sizeof(val));
 }
 
+/* same as write_64, the 64bit values are stored in host order */
+static void
+diff_buffer_write_64(buffer_type* buf, uint64_t val)
+{
+	buffer_write(buf, &val, sizeof(val));
+}
+
 static int
 write_str(FILE *out, const char* str)
 {
@@ -54,11 +67,40 @@ write_str(FILE *out, const char* str)
 	return write_data(out, str, len);
 }
 
+/* write the iovecs to the file, continue after short writes */
+static int
+diff_writev(int fd, struct iovec* iov, int iovcnt)
+{
+	while(iovcnt > 0) {
+		ssize_t w = writev(fd, iov, iovcnt);
+		if(w == -1) {
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			return 0;
+		}
+		while(iovcnt > 0 && (size_t)w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt > 0) {
+			iov->iov_base = (uint8_t*)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return 1;
+}
+
 void
 diff_write_packet(const char* zone, const char* pat, uint32_t old_serial,
 	uint32_t new_serial, uint32_t seq_nr, uint8_t* data, size_t len,
 	struct nsd* nsd, uint64_t filenumber)
 {
+	uint8_t hdrdata[64];
+	buffer_type hdr;
+	struct iovec iov[7];
+	uint32_t part[2], check, patlen;
+	int iovcnt = 0;
 	FILE* df = xfrd_open_xfrfile(nsd, filenumber, seq_nr?"a":"w");
 	if(!df) {
 		log_msg(LOG_ERR, "could not open transfer %s file %lld: %s",
@@ -73,29 +115,42 @@ diff_write_packet(const char* zone, const char* pat, uint32_t old_serial,
 			log_msg(LOG_ERR, "could not get timestamp for %s: %s",
 				zone, strerror(errno));
 		}
-		if(!write_32(df, DIFF_PART_XFRF) ||
-			!write_8(df, 0) /* notcommitted(yet) */ ||
-			!write_32(df, 0) /* numberofparts when done */ ||
-			!write_64(df, (uint64_t) tv.tv_sec) ||
-			!write_32(df, (uint32_t) tv.tv_usec) ||
-			!write_32(df, old_serial) ||
-			!write_32(df, new_serial) ||
-			!write_64(df, (uint64_t) tv.tv_sec) ||
-			!write_32(df, (uint32_t) tv.tv_usec) ||
-			!write_str(df, zone) ||
-			!write_str(df, pat)) {
-			log_msg(LOG_ERR, "could not write transfer %s file %lld: %s",
-				zone, (long long)filenumber, strerror(errno));
-			fclose(df);
-			return;
-		}
-	}
-
-	if(!write_32(df, DIFF_PART_XXFR) ||
-		!write_32(df, len) ||
-		!write_data(df, data, len) ||
-		!write_32(df, len))
-	{
+		/* the fixed part is on the stack, the names are written
+		 * from where they are */
+		buffer_create_from(&hdr, hdrdata, sizeof(hdrdata));
+		buffer_write_u32(&hdr, DIFF_PART_XFRF);
+		buffer_write_u8(&hdr, 0); /* notcommitted(yet) */
+		buffer_write_u32(&hdr, 0); /* numberofparts when done */
+		diff_buffer_write_64(&hdr, (uint64_t) tv.tv_sec);
+		buffer_write_u32(&hdr, (uint32_t) tv.tv_usec);
+		buffer_write_u32(&hdr, old_serial);
+		buffer_write_u32(&hdr, new_serial);
+		diff_buffer_write_64(&hdr, (uint64_t) tv.tv_sec);
+		buffer_write_u32(&hdr, (uint32_t) tv.tv_usec);
+		buffer_write_u32(&hdr, strlen(zone));
+		buffer_flip(&hdr);
+		patlen = htonl(strlen(pat));
+		iov[iovcnt].iov_base = buffer_begin(&hdr);
+		iov[iovcnt++].iov_len = buffer_limit(&hdr);
+		iov[iovcnt].iov_base = (void*)zone;
+		iov[iovcnt++].iov_len = strlen(zone);
+		iov[iovcnt].iov_base = &patlen;
+		iov[iovcnt++].iov_len = sizeof(patlen);
+		iov[iovcnt].iov_base = (void*)pat;
+		iov[iovcnt++].iov_len = strlen(pat);
+	}
+
+	/* the part with its length before and after, in one write */
+	part[0] = htonl(DIFF_PART_XXFR);
+	part[1] = htonl(len);
+	check = htonl(len);
+	iov[iovcnt].iov_base = part;
+	iov[iovcnt++].iov_len = sizeof(part);
+	iov[iovcnt].iov_base = data;
+	iov[iovcnt++].iov_len = len;
+	iov[iovcnt].iov_base = &check;
+	iov[iovcnt++].iov_len = sizeof(check);
+	if(!diff_writev(fileno(df), iov, iovcnt)) {
 		log_msg(LOG_ERR, "could not write transfer %s file %lld: %s",
 			zone, (long long)filenumber, strerror(errno));
 	}
@@ -189,50 +244,100 @@ diff_update_commit(
 }
 
 int
-diff_read_64(FILE *in, uint64_t* result)
+diff_read_64(buffer_type* in, uint64_t* result)
 {
-	if (fread(result, sizeof(*result), 1, in) == 1) {
-		return 1;
-	} else {
+	/* stored in host order by write_64 */
+	if(!buffer_available(in, sizeof(*result)))
 		return 0;
-	}
+	buffer_read(in, result, sizeof(*result));
+	return 1;
 }
 
 int
-diff_read_32(FILE *in, uint32_t* result)
+diff_read_32(buffer_type* in, uint32_t* result)
 {
-	if (fread(result, sizeof(*result), 1, in) == 1) {
-		*result = ntohl(*result);
-		return 1;
-	} else {
+	if(!buffer_available(in, sizeof(*result)))
 		return 0;
-	}
+	*result = buffer_read_u32(in);
+	return 1;
 }
 
 int
-diff_read_8(FILE *in, uint8_t* result)
+diff_read_8(buffer_type* in, uint8_t* result)
 {
-	if (fread(result, sizeof(*result), 1, in) == 1) {
-		return 1;
-	} else {
+	if(!buffer_available(in, sizeof(*result)))
 		return 0;
-	}
+	*result = buffer_read_u8(in);
+	return 1;
 }
 
 int
-diff_read_str(FILE* in, char* buf, size_t len)
+diff_read_str(buffer_type* in, char* buf, size_t len)
 {
 	uint32_t disklen;
 	if(!diff_read_32(in, &disklen))
 		return 0;
 	if(disklen >= len)
 		return 0;
-	if(fread(buf, disklen, 1, in) != 1)
+	if(!buffer_available(in, disklen))
 		return 0;
+	buffer_read(in, buf, disklen);
 	buf[disklen] = 0;
 	return 1;
 }
 
+/* map the transfer file into memory, the parts are parsed in place */
+static uint8_t*
+diff_map_xfrfile(FILE* df, size_t* size)
+{
+	struct stat st;
+	uint8_t* data;
+	if(fstat(fileno(df), &st) != 0) {
+		log_msg(LOG_ERR, "could not stat transfer file: %s",
+			strerror(errno));
+		return NULL;
+	}
+	*size = (size_t)st.st_size;
+	if(*size == 0) {
+		log_msg(LOG_ERR, "diff file too short");
+		return NULL;
+	}
+#ifdef HAVE_MMAP
+	data = (uint8_t*)mmap(NULL, *size, PROT_READ, MAP_PRIVATE,
+		fileno(df), 0);
+	if(data == MAP_FAILED) {
+		log_msg(LOG_ERR, "could not mmap transfer file: %s",
+			strerror(errno));
+		return NULL;
+	}
+#ifdef MADV_SEQUENTIAL
+	(void)madvise(data, *size, MADV_SEQUENTIAL);
+#endif
+#else
+	data = (uint8_t*)xalloc(*size);
+	if(fread(data, *size, 1, df) != 1) {
+		log_msg(LOG_ERR, "could not read transfer file: %s",
+			strerror(errno));
+		free(data);
+		return NULL;
+	}
+#endif /* HAVE_MMAP */
+	return data;
+}
+
+static void
+diff_unmap_xfrfile(uint8_t* data, size_t size)
+{
+#ifdef HAVE_MMAP
+	if(munmap(data, size) != 0)
+		log_msg(LOG_ERR, "could not munmap transfer file: %s",
+			strerror(errno));
+#else
+	(void)size;
+	free(data);
+#endif
+}
+
 static void
 add_rdata_to_recyclebin(namedb_type* db, rr_type* rr)
 {
@@ -483,6 +588,7 @@ nsec3_delete_rr_trigger(namedb_type* db, rr_type* rr, zone_type* zone,
 		/* unlink from the nsec3tree */
 		zone_del_domain_in_hash_tree(zone->nsec3tree,
 			&rr->owner->nsec3->nsec3_node);
+		nsec3_hash_index_delete(zone, rr->owner);
 		/* add previous NSEC3 to the prehash list */
 		if(prev && prev != rr->owner)
 			prehash_add(db->domains, prev);
@@ -941,8 +1047,12 @@ find_or_create_zone(namedb_type* db, const dname_type* zone_name,
 	return zone;
 }
 
+/* delete the rrsets of the zone, if keep_domains, the domain nodes are left
+ * in the domain table, so that an AXFR that adds the names again does not
+ * have to delete and insert every domain, prune_zone_domains removes the
+ * ones that stay empty. */
 void
-delete_zone_rrs(namedb_type* db, zone_type* zone)
+delete_zone_rrsets(namedb_type* db, zone_type* zone, int keep_domains)
 {
 	rrset_type *rrset;
 	domain_type *domain = zone->apex, *next;
@@ -966,13 +1076,14 @@ delete_zone_rrs(namedb_type* db, zone_type* zone)
 		 * or after the domain so store next ptr */
 		next = domain_next(domain);
 		/* see if the domain can be deleted (and inspect parents) */
-		domain_table_deldomain(db, domain);
+		if(!keep_domains)
+			domain_table_deldomain(db, domain);
 		domain = next;
 	}
 
 	/* check if data deletions have created nonexisting domain entries,
 	 * but after deleting domains so the checks are faster */
-	if(nonexist_check) {
+	if(nonexist_check && !keep_domains) {
 		domain_type* ce = NULL; /* for speeding up has_data_below */
 		DEBUG(DEBUG_XFRD, 1, (LOG_INFO, "axfrdel: zero rrset check"));
 		domain = zone->apex;
@@ -1001,9 +1112,41 @@ delete_zone_rrs(namedb_type* db, zone_type* zone)
 	assert(zone->is_secure == 0);
 }
 
+void
+delete_zone_rrs(namedb_type* db, zone_type* zone)
+{
+	delete_zone_rrsets(db, zone, 0);
+}
+
+/* after an AXFR is applied, remove the domains of the zone that were kept
+ * by delete_zone_rrsets but did not get data again */
+void
+prune_zone_domains(namedb_type* db, zone_type* zone)
+{
+	domain_type *domain = zone->apex, *next, *ce = NULL;
+	while(domain && domain_is_subdomain(domain, zone->apex))
+	{
+		/* deldomain only deletes the domain and its parents, the
+		 * next domain stays */
+		next = domain_next(domain);
+		if(domain->rrsets == 0)
+			domain_table_deldomain(db, domain);
+		domain = next;
+	}
+	/* the empty domains that are still used, or have subdomains, could
+	 * be nonexisting now */
+	domain = zone->apex;
+	while(domain && domain_is_subdomain(domain, zone->apex))
+	{
+		if(domain->is_existing)
+			ce = rrset_zero_nonexist_check(domain, ce);
+		domain = domain_next(domain);
+	}
+}
+
 /* return value 0: syntaxerror,badIXFR, 1:OK, 2:done_and_skip_it */
 static int
-apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
+apply_ixfr(namedb_type* db, buffer_type* in, const char* zone, uint32_t serialno,
 	struct nsd_options* opt, uint32_t seq_nr, uint32_t seq_total,
 	int* is_axfr, int* delete_mode, int* rr_count,
 	udb_ptr* udbz, struct zone** zone_res, const char* patname, int* bytes,
@@ -1011,7 +1154,7 @@ apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
 {
 	uint32_t msglen, checklen, pkttype;
 	int qcount, ancount, counter;
-	buffer_type* packet;
+	buffer_type* packet, packet_mem;
 	region_type* region;
 	int i;
 	uint16_t rrlen;
@@ -1039,24 +1182,18 @@ apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
 		return 0;
 	}
 
-	region = region_create(xalloc, free);
-	if(!region) {
-		log_msg(LOG_ERR, "out of memory");
-		return 0;
-	}
-	packet = buffer_create(region, QIOBUFSZ);
 	if(msglen > QIOBUFSZ) {
 		log_msg(LOG_ERR, "msg too long");
-		region_destroy(region);
 		return 0;
 	}
-	buffer_clear(packet);
-	if(fread(buffer_begin(packet), msglen, 1, in) != 1) {
-		log_msg(LOG_ERR, "short fread: %s", strerror(errno));
-		region_destroy(region);
+	if(!buffer_available(in, msglen)) {
+		log_msg(LOG_ERR, "transfer part is truncated");
 		return 0;
 	}
-	buffer_set_limit(packet, msglen);
+	/* parse the packet in place, in the mapped file */
+	packet = &packet_mem;
+	buffer_create_from(packet, buffer_current(in), msglen);
+	buffer_skip(in, msglen);
 
 	/* see if check on data fails: checks that we are not reading
 	 * random garbage */
@@ -1064,6 +1201,12 @@ apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
 		log_msg(LOG_ERR, "transfer part has incorrect checkvalue");
 		return 0;
 	}
+
+	region = region_create(xalloc, free);
+	if(!region) {
+		log_msg(LOG_ERR, "out of memory");
+		return 0;
+	}
 	*bytes += msglen;
 
 	dname_zone = dname_parse(region, zone);
@@ -1189,7 +1332,7 @@ apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
 			nsec3_clear_precompile(db, zone_db);
 			zone_db->nsec3_param = NULL;
 #endif
-			delete_zone_rrs(db, zone_db);
+			delete_zone_rrsets(db, zone_db, 1);
 			if(db->udb)
 				udb_zone_clear(db->udb, udbz);
 			/* add everything else (incl end SOA) */
@@ -1221,7 +1364,7 @@ apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
 				nsec3_clear_precompile(db, zone_db);
 				zone_db->nsec3_param = NULL;
 #endif
-				delete_zone_rrs(db, zone_db);
+				delete_zone_rrsets(db, zone_db, 1);
 				if(db->udb)
 					udb_zone_clear(db->udb, udbz);
 				*delete_mode = 0;
@@ -1320,7 +1463,7 @@ check_for_bad_serial(namedb_type* db, const char* zone_str, uint32_t old_serial)
 }
 
 static int
-apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
+apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, buffer_type* in,
 	struct nsd_options* opt, udb_base* taskudb, udb_ptr* last_task,
 	uint32_t xfrfilenr)
 {
@@ -1451,6 +1594,9 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
 				break;
 			}
 		}
+		/* the AXFR has been added, remove the names it no longer has */
+		if(is_axfr)
+			prune_zone_domains(nsd->db, zonedb);
 		if(nsd->db->udb)
 			udb_base_set_userflags(nsd->db->udb, 0);
 		/* read the final log_str: but do not fail on it */
@@ -2184,6 +2330,9 @@ task_process_apply_xfr(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
 	 * appends soa_info which may remap and change the pointer. */
 	zone_type* zone;
 	FILE* df;
+	uint8_t* data;
+	size_t size;
+	buffer_type in;
 	DEBUG(DEBUG_IPC,1, (LOG_INFO, "applyxfr task %s", dname_to_string(
 		TASKLIST(task)->zname, NULL)));
 	zone = namedb_find_zone(nsd->db, TASKLIST(task)->zname);
@@ -2203,15 +2352,22 @@ task_process_apply_xfr(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
 		zone->is_skipped = 1;
 		return;
 	}
+	data = diff_map_xfrfile(df, &size);
+	fclose(df);
+	if(!data) {
+		zone->is_skipped = 1;
+		return;
+	}
+	buffer_create_from(&in, data, size);
 	/* read and apply zone transfer */
-	if(!apply_ixfr_for_zone(nsd, zone, df, nsd->options, udb,
+	if(!apply_ixfr_for_zone(nsd, zone, &in, nsd->options, udb,
 		last_task, TASKLIST(task)->yesno)) {
 		/* soainfo_gone will be communicated from server_reload, unless
 		   preceding updates have been applied  */
 		zone->is_skipped = 1;
 	}
 
-	fclose(df);
+	diff_unmap_xfrfile(data, size);
 }
 
 
@@ -13,6 +13,7 @@
 #include "namedb.h"
 #include "options.h"
 #include "udb.h"
+#include "buffer.h"
 struct nsd;
 struct nsdst;
 
@@ -47,14 +48,22 @@ void diff_update_commit(const char* zone,
 	uint8_t commit, struct nsd* nsd, uint64_t filenumber);
 
 /*
- * These functions read parts of the diff file.
+ * These functions read parts of the diff file, from the file contents
+ * that are mapped into memory.
  */
-int diff_read_32(FILE *in, uint32_t* result);
-int diff_read_8(FILE *in, uint8_t* result);
-int diff_read_str(FILE* in, char* buf, size_t len);
+int diff_read_64(buffer_type* in, uint64_t* result);
+int diff_read_32(buffer_type* in, uint32_t* result);
+int diff_read_8(buffer_type* in, uint8_t* result);
+int diff_read_str(buffer_type* in, char* buf, size_t len);
 
 /* delete the RRs for a zone from memory */
 void delete_zone_rrs(namedb_type* db, zone_type* zone);
+/* delete the RRs for a zone from memory, keep_domains leaves the domain
+ * nodes in the table, for an AXFR that adds most of them again */
+void delete_zone_rrsets(namedb_type* db, zone_type* zone, int keep_domains);
+/* remove the domains that did not get data again after delete_zone_rrsets
+ * with keep_domains, and fix up their is_existing and wildcard matches */
+void prune_zone_domains(namedb_type* db, zone_type* zone);
 /* delete an RR */
 int delete_RR(namedb_type* db, const dname_type* dname,
 	uint16_t type, uint16_t klass,
@@ -54,47 +54,102 @@
 #include "dnstap/dnstap.pb-c.h"
 
 #define DNSTAP_CONTENT_TYPE		"protobuf:dnstap.Dnstap"
-#define DNSTAP_INITIAL_BUF_SIZE		256
+/* frames queued to the I/O thread, a power of 2 */
+#define DNSTAP_INPUT_QUEUE_SIZE		8192
+/* size of the arena that frames are packed into */
+#define DNSTAP_ARENA_SIZE		(256*1024)
 
 struct dt_msg {
 	void		*buf;
 	size_t		len_buf;
+	void		(*free_func)(void *, void *);
+	void		*free_data;
 	Dnstap__Dnstap	d;
 	Dnstap__Message	m;
 };
 
-static int
-dt_pack(const Dnstap__Dnstap *d, void **buf, size_t *sz)
+#if defined(__GNUC__) || defined(__clang__)
+/*
+ * Frames are packed one after the other in an arena, instead of in a
+ * buffer of their own. The I/O thread releases every frame when it is
+ * written, and the arena is freed when the last frame is released and
+ * it is no longer the current arena of the env.
+ */
+struct dt_arena {
+	/* frames not yet released, plus one while it is the current arena */
+	volatile unsigned refs;
+	/* bytes in use */
+	size_t used;
+};
+#define DT_ARENA_DATA(a) ((uint8_t*)(a) + sizeof(struct dt_arena))
+
+static void
+dt_arena_release(void *ATTR_UNUSED(buf), void *free_data)
 {
-	ProtobufCBufferSimple sbuf;
-
-	memset(&sbuf, 0, sizeof(sbuf));
-	sbuf.base.append = protobuf_c_buffer_simple_append;
-	sbuf.len = 0;
-	sbuf.alloced = DNSTAP_INITIAL_BUF_SIZE;
-	sbuf.data = malloc(sbuf.alloced);
-	if (sbuf.data == NULL)
-		return 0;
-	sbuf.must_free_data = 1;
+	struct dt_arena *a = (struct dt_arena *) free_data;
+	if (__sync_sub_and_fetch(&a->refs, 1) == 0)
+		free(a);
+}
+#endif /* __GNUC__ || __clang__ */
 
-	*sz = dnstap__dnstap__pack_to_buffer(d, (ProtobufCBuffer *) &sbuf);
-	if (sbuf.data == NULL)
-		return 0;
-	*buf = sbuf.data;
+/* get space for a frame of len bytes */
+static void *
+dt_alloc_frame(struct dt_env *env, size_t len,
+	void (**free_func)(void *, void *), void **free_data)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	struct dt_arena *a = (struct dt_arena *) env->arena;
+	void *buf;
+	if (len <= DNSTAP_ARENA_SIZE / 4) {
+		if (!a || a->used + len > DNSTAP_ARENA_SIZE) {
+			if (a)
+				dt_arena_release(NULL, a);
+			a = (struct dt_arena *) malloc(sizeof(*a) +
+				DNSTAP_ARENA_SIZE);
+			env->arena = a;
+			if (a) {
+				a->refs = 1;
+				a->used = 0;
+			}
+		}
+		if (a) {
+			buf = DT_ARENA_DATA(a) + a->used;
+			/* keep the frames aligned */
+			a->used += (len + 7) & ~((size_t)7);
+			(void)__sync_add_and_fetch(&a->refs, 1);
+			*free_func = dt_arena_release;
+			*free_data = a;
+			return buf;
+		}
+	}
+#endif
+	*free_func = fstrm_free_wrapper;
+	*free_data = NULL;
+	return malloc(len);
+}
 
+static int
+dt_pack(struct dt_env *env, struct dt_msg *dm)
+{
+	dm->len_buf = dnstap__dnstap__get_packed_size(&dm->d);
+	dm->buf = dt_alloc_frame(env, dm->len_buf, &dm->free_func,
+		&dm->free_data);
+	if (dm->buf == NULL)
+		return 0;
+	(void)dnstap__dnstap__pack(&dm->d, dm->buf);
 	return 1;
 }
 
 static void
-dt_send(const struct dt_env *env, void *buf, size_t len_buf)
+dt_send(const struct dt_env *env, struct dt_msg *dm)
 {
 	fstrm_res res;
-	if (!buf)
+	if (!dm->buf)
 		return;
-	res = fstrm_iothr_submit(env->iothr, env->ioq, buf, len_buf,
-				 fstrm_free_wrapper, NULL);
+	res = fstrm_iothr_submit(env->iothr, env->ioq, dm->buf, dm->len_buf,
+				 dm->free_func, dm->free_data);
 	if (res != fstrm_res_success)
-		free(buf);
+		dm->free_func(dm->buf, dm->free_data);
 }
 
 static void
@@ -172,6 +227,10 @@ dt_create(const char *socket_path, unsigned num_workers)
 
 	fopt = fstrm_iothr_options_init();
 	fstrm_iothr_options_set_num_input_queues(fopt, num_workers);
+	/* room for the batches the collector submits at once */
+	if (fstrm_iothr_options_set_input_queue_size(fopt,
+		DNSTAP_INPUT_QUEUE_SIZE) != fstrm_res_success)
+		log_msg(LOG_ERR, "dt_create: could not set input queue size");
 	env->iothr = fstrm_iothr_init(fopt, &fw);
 	if (env->iothr == NULL) {
 		log_msg(LOG_ERR, "dt_create: fstrm_iothr_init() failed");
@@ -263,6 +322,11 @@ dt_delete(struct dt_env *env)
 		return;
 	VERBOSITY(1, (LOG_INFO, "closing dnstap socket"));
 	fstrm_iothr_destroy(&env->iothr);
+#if defined(__GNUC__) || defined(__clang__)
+	/* the frames are released, the I/O thread has stopped */
+	if (env->arena)
+		dt_arena_release(NULL, env->arena);
+#endif
 	free(env->identity);
 	free(env->version);
 	free(env);
@@ -392,12 +456,10 @@ dt_msg_send_auth_query(struct dt_env *env,
 	struct sockaddr_in* local_addr,
 	struct sockaddr_in* addr,
 #endif
-	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen)
+	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen,
+	const struct timeval* qtime)
 {
 	struct dt_msg dm;
-	struct timeval qtime;
-
-	gettimeofday(&qtime, NULL);
 
 	/* type */
 	dt_msg_init(env, &dm, DNSTAP__MESSAGE__TYPE__AUTH_QUERY);
@@ -410,7 +472,7 @@ dt_msg_send_auth_query(struct dt_env *env,
 	}
 
 	/* query_time */
-	dt_fill_timeval(&qtime,
+	dt_fill_timeval(qtime,
 			&dm.m.query_time_sec, &dm.m.has_query_time_sec,
 			&dm.m.query_time_nsec, &dm.m.has_query_time_nsec);
 
@@ -425,8 +487,8 @@ dt_msg_send_auth_query(struct dt_env *env,
 			&dm.m.query_port, &dm.m.has_query_port);
 
 
-	if (dt_pack(&dm.d, &dm.buf, &dm.len_buf))
-		dt_send(env, dm.buf, dm.len_buf);
+	if (dt_pack(env, &dm))
+		dt_send(env, &dm);
 }
 
 void
@@ -438,12 +500,10 @@ dt_msg_send_auth_response(struct dt_env *env,
 	struct sockaddr_in* local_addr,
 	struct sockaddr_in* addr,
 #endif
-	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen)
+	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen,
+	const struct timeval* rtime)
 {
 	struct dt_msg dm;
-	struct timeval rtime;
-
-	gettimeofday(&rtime, NULL);
 
 	/* type */
 	dt_msg_init(env, &dm, DNSTAP__MESSAGE__TYPE__AUTH_RESPONSE);
@@ -456,7 +516,7 @@ dt_msg_send_auth_response(struct dt_env *env,
 	}
 
 	/* response_time */
-	dt_fill_timeval(&rtime,
+	dt_fill_timeval(rtime,
 			&dm.m.response_time_sec, &dm.m.has_response_time_sec,
 			&dm.m.response_time_nsec, &dm.m.has_response_time_nsec);
 
@@ -470,8 +530,8 @@ dt_msg_send_auth_response(struct dt_env *env,
 			&dm.m.query_address, &dm.m.has_query_address,
 			&dm.m.query_port, &dm.m.has_query_port);
 
-	if (dt_pack(&dm.d, &dm.buf, &dm.len_buf))
-		dt_send(env, dm.buf, dm.len_buf);
+	if (dt_pack(env, &dm))
+		dt_send(env, &dm);
 }
 
 #endif /* USE_DNSTAP */
@@ -40,6 +40,7 @@
 #ifdef USE_DNSTAP
 
 struct nsd_options;
+struct timeval;
 struct fstrm_io;
 struct fstrm_queue;
 
@@ -50,6 +51,9 @@ struct dt_env {
 	/** dnstap I/O thread input queue */
 	struct fstrm_iothr_queue *ioq;
 
+	/** current arena that frames are packed into, or NULL */
+	void *arena;
+
 	/** dnstap "identity" field, NULL if disabled */
 	char *identity;
 
@@ -115,6 +119,7 @@ dt_delete(struct dt_env *env);
  * @param zonelen: length of zone in bytes.
  * @param pkt: query message.
  * @param pktlen: length of pkt.
+ * @param tv: time of the query.
  */
 void
 dt_msg_send_auth_query(struct dt_env *env,
@@ -125,7 +130,8 @@ dt_msg_send_auth_query(struct dt_env *env,
 	struct sockaddr_in* local_addr,
 	struct sockaddr_in* addr,
 #endif
-	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen);
+	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen,
+	const struct timeval* tv);
 
 /**
  * Create and send a new dnstap "Message" event of type AUTH_RESPONSE.
@@ -137,6 +143,7 @@ dt_msg_send_auth_query(struct dt_env *env,
  * @param zonelen: length of zone in bytes.
  * @param pkt: response message.
  * @param pktlen: length of pkt.
+ * @param tv: time of the response.
  */
 void
 dt_msg_send_auth_response(struct dt_env *env,
@@ -147,7 +154,8 @@ dt_msg_send_auth_response(struct dt_env *env,
 	struct sockaddr_in* local_addr,
 	struct sockaddr_in* addr,
 #endif
-	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen);
+	int is_tcp, uint8_t* zone, size_t zonelen, uint8_t* pkt, size_t pktlen,
+	const struct timeval* tv);
 
 #endif /* USE_DNSTAP */
 
@@ -10,6 +10,8 @@
 #include "config.h"
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/time.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -36,6 +38,53 @@
 #include "udb.h"
 #include "rrl.h"
 
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/* full memory barrier between the ring index and data accesses */
+#if defined(__GNUC__) || defined(__clang__)
+#define dt_ring_barrier() __sync_synchronize()
+#else
+#define dt_ring_barrier() /* nothing, rely on volatile */
+#endif
+
+/* size of the data area of a ring, a multiple of 4 */
+#define DT_RING_SIZE (1024*1024)
+/* record length that marks the rest of the ring as unused, continue at
+ * the start of the data area */
+#define DT_RING_WRAP 0xffffffffU
+/* maximum length of a message:
+ * msglen + is_response + time + addrlen + is_tcp + packetlen + packet +
+ * zonelen + zone + spare + local_addr + addr */
+#ifdef INET6
+#define DT_MSG_MAX (4+1+8+4+4+1+4+TCP_MAX_MESSAGE_LEN+4+MAXHOSTNAMELEN + 32 + \
+	sizeof(struct sockaddr_storage) + sizeof(struct sockaddr_storage))
+#else
+#define DT_MSG_MAX (4+1+8+4+4+1+4+TCP_MAX_MESSAGE_LEN+4+MAXHOSTNAMELEN + 32 + \
+	sizeof(struct sockaddr_in) + sizeof(struct sockaddr_in))
+#endif
+
+/* Single producer, single consumer ring in shared memory. The server
+ * process appends messages at tail, the collector consumes them from head.
+ * Both offsets only increase, the position in data is offset % size.
+ * A message is stored as it is marshalled: a 4 byte length and the
+ * content, padded to a multiple of 4. A message never wraps around the
+ * end of the data area, DT_RING_WRAP is written instead. */
+struct dt_ring {
+	/* written by the server process */
+	volatile uint64_t tail;
+	uint8_t pad1[64 - sizeof(uint64_t)];
+	/* written by the collector */
+	volatile uint64_t head;
+	/* set by the collector when the ring is empty and it waits for a
+	 * wakeup on the socket, cleared by the server process that sends
+	 * the wakeup */
+	volatile uint32_t waiting;
+	uint8_t pad2[64 - sizeof(uint64_t) - sizeof(uint32_t)];
+	uint8_t data[DT_RING_SIZE];
+};
+
 struct dt_collector* dt_collector_create(struct nsd* nsd)
 {
 	int i, sv[2];
@@ -43,39 +92,46 @@ struct dt_collector* dt_collector_create(struct nsd* nsd)
 		sizeof(*dt_col));
 	dt_col->count = nsd->child_count * 2;
 	dt_col->dt_env = NULL;
-	dt_col->region = region_create(xalloc, free);
-	dt_col->send_buffer = buffer_create(dt_col->region,
-		/* msglen + is_response + addrlen + is_tcp + packetlen + packet + zonelen + zone + spare + local_addr + addr */
-		4+1+4+1+4+TCP_MAX_MESSAGE_LEN+4+MAXHOSTNAMELEN + 32 +
-#ifdef INET6
-		sizeof(struct sockaddr_storage) + sizeof(struct sockaddr_storage)
-#else
-		sizeof(struct sockaddr_in) + sizeof(struct sockaddr_in)
-#endif
-		);
 
-	/* open communication channels in struct nsd */
+	/* the rings, shared with the forked processes */
+	dt_col->rings = (struct dt_ring*)mmap(NULL,
+		sizeof(struct dt_ring) * dt_col->count, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(dt_col->rings == MAP_FAILED) {
+		error("dnstap_collector: cannot mmap shared memory: %s",
+			strerror(errno));
+	}
+	for(i=0; i<dt_col->count; i++) {
+		dt_col->rings[i].tail = 0;
+		dt_col->rings[i].head = 0;
+		dt_col->rings[i].waiting = 1;
+	}
+
+	/* the sampling and filters that the server processes apply */
+	dt_col->sample_rate = nsd->options->dnstap_sample_rate;
+	if(nsd->options->dnstap_log_qtypes) {
+		dt_col->qtypes = (uint8_t*)xalloc_zero(65536/8);
+		(void)dnstap_parse_qtypes(nsd->options->dnstap_log_qtypes,
+			dt_col->qtypes);
+	}
+	if(nsd->options->dnstap_log_rcodes)
+		(void)dnstap_parse_rcodes(nsd->options->dnstap_log_rcodes,
+			&dt_col->rcodes);
+
+	/* open communication channels in struct nsd, these carry the
+	 * wakeups for the rings */
 	nsd->dt_collector_fd_send = (int*)xalloc_array_zero(dt_col->count,
 		sizeof(int));
 	nsd->dt_collector_fd_recv = (int*)xalloc_array_zero(dt_col->count,
 		sizeof(int));
 	for(i=0; i<dt_col->count; i++) {
 		int sv[2];
-		int bufsz = buffer_capacity(dt_col->send_buffer);
 		sv[0] = -1; /* For receiving by parent (dnstap-collector) */
 		sv[1] = -1; /* For sending   by child  (server childs) */
 		if(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sv) < 0) {
 			error("dnstap_collector: cannot create communication channel: %s",
 				strerror(errno));
 		}
-		if(setsockopt(sv[0], SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof(bufsz))) {
-			log_msg(LOG_ERR, "setting dnstap_collector "
-				"receive buffer size failed: %s", strerror(errno));
-		}
-		if(setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &bufsz, sizeof(bufsz))) {
-			log_msg(LOG_ERR, "setting dnstap_collector "
-				"send buffer size failed: %s", strerror(errno));
-		}
 		nsd->dt_collector_fd_recv[i] = sv[0];
 		nsd->dt_collector_fd_send[i] = sv[1];
 	}
@@ -109,7 +165,12 @@ void dt_collector_destroy(struct dt_collector* dt_col, struct nsd* nsd)
 		free(nsd->dt_collector_fd_swap);
 	nsd->dt_collector_fd_send = NULL;
 	nsd->dt_collector_fd_swap = NULL;
-	region_destroy(dt_col->region);
+	if(dt_col->rings && munmap(dt_col->rings,
+		sizeof(struct dt_ring) * dt_col->count) == -1) {
+		log_msg(LOG_ERR, "dnstap_collector: munmap failed: %s",
+			strerror(errno));
+	}
+	free(dt_col->qtypes);
 	free(dt_col);
 }
 
@@ -150,40 +211,29 @@ dt_handle_cmd_from_nsd(int ATTR_UNUSED(fd), short event, void* arg)
 	}
 }
 
-/* receive data from fd into buffer, 1 when message received, -1 on error */
-static int recv_into_buffer(int fd, struct buffer* buf)
+/* read the wakeups from fd, 0 when read, -1 on error */
+static int recv_wakeups(int fd)
 {
-	size_t msglen;
+	uint8_t buf[64];
 	ssize_t r;
 
-	assert(buffer_position(buf) == 0);
-	r = recv(fd, buffer_current(buf), buffer_capacity(buf), MSG_DONTWAIT);
-	if(r == -1) {
-		if(errno == EAGAIN || errno == EINTR || errno == EMSGSIZE) {
-			/* continue to receive a message later */
-			return 0;
+	for(;;) {
+		r = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if(r == -1) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			if(errno == EINTR)
+				continue;
+			log_msg(LOG_ERR, "dnstap collector: receive failed: %s",
+				strerror(errno));
+			return -1;
+		}
+		if(r == 0) {
+			/* Remote end closed the connection? */
+			log_msg(LOG_ERR, "dnstap collector: remote closed connection");
+			return -1;
 		}
-		log_msg(LOG_ERR, "dnstap collector: receive failed: %s",
-			strerror(errno));
-		return -1;
-	}
-	if(r == 0) {
-		/* Remote end closed the connection? */
-		log_msg(LOG_ERR, "dnstap collector: remote closed connection");
-		return -1;
-	}
-	assert(r > 4);
-	msglen = buffer_read_u32_at(buf, 0);
-	if(msglen != (size_t)(r - 4)) {
-		/* Is this still possible now the communication channel is of
-		 * type SOCK_DGRAM? I think not, but better safe than sorry. */
-		log_msg(LOG_ERR, "dnstap collector: out of sync (msglen: %u)",
-			(unsigned int) msglen);
-		return 0;
 	}
-	buffer_skip(buf, r);
-	buffer_flip(buf);
-	return 1;
 }
 
 /* submit the content of the buffer received to dnstap */
@@ -191,6 +241,7 @@ static void
 dt_submit_content(struct dt_env* dt_env, struct buffer* buf)
 {
 	uint8_t is_response, is_tcp;
+	struct timeval tv;
 #ifdef INET6
 	struct sockaddr_storage local_addr, addr;
 #else
@@ -203,9 +254,11 @@ dt_submit_content(struct dt_env* dt_env, struct buffer* buf)
 	uint8_t* zone;
 
 	/* parse content from buffer */
-	if(!buffer_available(buf, 4+1+4)) return;
+	if(!buffer_available(buf, 4+1+8+4+4)) return;
 	buffer_skip(buf, 4); /* skip msglen */
 	is_response = buffer_read_u8(buf);
+	tv.tv_sec = (time_t)buffer_read_u64(buf);
+	tv.tv_usec = (suseconds_t)buffer_read_u32(buf);
 	addrlen = buffer_read_u32(buf);
 	if(addrlen > sizeof(local_addr) || addrlen > sizeof(addr)) return;
 	if(!buffer_available(buf, 2*addrlen)) return;
@@ -231,10 +284,61 @@ dt_submit_content(struct dt_env* dt_env, struct buffer* buf)
 	/* submit it */
 	if(is_response) {
 		dt_msg_send_auth_response(dt_env, &local_addr, &addr, is_tcp, zone,
-			zonelen, data, pktlen);
+			zonelen, data, pktlen, &tv);
 	} else {
 		dt_msg_send_auth_query(dt_env, &local_addr, &addr, is_tcp, zone,
-			zonelen, data, pktlen);
+			zonelen, data, pktlen, &tv);
+	}
+}
+
+/* submit the messages in the ring to dnstap, until it is empty.  The
+ * messages that are in the ring together are encoded as one batch, each
+ * with the time that the server process wrote it in the ring. */
+static void
+dt_ring_drain(struct dt_env* dt_env, struct dt_ring* ring)
+{
+	uint64_t head = ring->head, tail;
+	struct buffer buf;
+	size_t pos, msglen;
+
+	for(;;) {
+		dt_ring_barrier();
+		tail = ring->tail;
+		if(head == tail) {
+			/* empty, ask for a wakeup and check again, the server
+			 * process stores tail before it looks at waiting */
+			ring->waiting = 1;
+			dt_ring_barrier();
+			if(ring->tail == head)
+				return;
+			ring->waiting = 0;
+			continue;
+		}
+		dt_ring_barrier();
+		while(head != tail) {
+			pos = head % DT_RING_SIZE;
+			msglen = read_uint32(ring->data + pos);
+			if(msglen == DT_RING_WRAP) {
+				head += DT_RING_SIZE - pos;
+				continue;
+			}
+			if(msglen + 4 > DT_RING_SIZE - pos) {
+				log_msg(LOG_ERR, "dnstap collector: out of sync "
+					"(msglen: %u)", (unsigned int)msglen);
+				head = tail;
+				break;
+			}
+			VERBOSITY(4, (LOG_INFO, "dnstap collector: received msg len %d",
+				(int)msglen));
+			if(dt_env) {
+				buffer_create_from(&buf, ring->data + pos, 4+msglen);
+				dt_submit_content(dt_env, &buf);
+			}
+			head += (4 + msglen + 3) & ~((uint64_t)3);
+		}
+		/* done with the data, the server process can reuse it */
+		dt_ring_barrier();
+		ring->head = head;
 	}
 }
 
@@ -244,24 +348,13 @@ dt_handle_input(int fd, short event, void* arg)
 {
 	struct dt_collector_input* dt_input = (struct dt_collector_input*)arg;
 	if((event&EV_READ) != 0) {
-		/* receive */
-		int r = recv_into_buffer(fd, dt_input->buffer);
-		if(r == 0)
-			return;
-		else if(r < 0) {
+		/* clear the wakeups */
+		if(recv_wakeups(fd) < 0) {
 			event_base_loopexit(dt_input->dt_collector->event_base, NULL);
 			return;
 		}
-		/* once data is complete, send it to dnstap */
-		VERBOSITY(4, (LOG_INFO, "dnstap collector: received msg len %d",
-			(int)buffer_remaining(dt_input->buffer)));
-		if(dt_input->dt_collector->dt_env) {
-			dt_submit_content(dt_input->dt_collector->dt_env,
-				dt_input->buffer);
-		}
-		
-		/* clear buffer for next message */
-		buffer_clear(dt_input->buffer);
+		/* the ring has the messages, send them to dnstap */
+		dt_ring_drain(dt_input->dt_collector->dt_env, dt_input->ring);
 	}
 }
 
@@ -346,28 +439,22 @@ static void dt_attach_events(struct dt_collector* dt_col, struct nsd* nsd)
 			log_msg(LOG_ERR, "dnstap collector: event_base_set failed");
 		if(event_add(dt_col->inputs[i].event, NULL) != 0)
 			log_msg(LOG_ERR, "dnstap collector: event_add failed");
-		
-		dt_col->inputs[i].buffer = buffer_create(dt_col->region,
-			/* msglen + is_response + addrlen + is_tcp + packetlen + packet + zonelen + zone + spare + local_addr + addr */
-			4+1+4+1+4+TCP_MAX_MESSAGE_LEN+4+MAXHOSTNAMELEN + 32 +
-#ifdef INET6
-			sizeof(struct sockaddr_storage) + sizeof(struct sockaddr_storage)
-#else
-			sizeof(struct sockaddr_in) + sizeof(struct sockaddr_in)
-#endif
-		);
-		assert(buffer_capacity(dt_col->inputs[i].buffer) ==
-			buffer_capacity(dt_col->send_buffer));
+		dt_col->inputs[i].ring = &dt_col->rings[i];
 	}
 }
 
 /* the dnstap collector process main routine */
 static void dt_collector_run(struct dt_collector* dt_col, struct nsd* nsd)
 {
+	int i;
 	/* init dnstap */
 	VERBOSITY(1, (LOG_INFO, "dnstap collector started"));
 	dt_init_dnstap(dt_col, nsd);
 	dt_attach_events(dt_col, nsd);
+	/* the rings may already have content from before the start */
+	for(i=0; i<dt_col->count; i++) {
+		dt_ring_drain(dt_col->dt_env, dt_col->inputs[i].ring);
+	}
 
 	/* run */
 	if(event_base_loop(dt_col->event_base, 0) == -1) {
@@ -438,6 +525,7 @@ void dt_collector_start(struct dt_collector* dt_col, struct nsd* nsd)
 /* put data for sending to the collector process into the buffer */
 static int
 prep_send_data(struct buffer* buf, uint8_t is_response,
+	const struct timeval* tv,
 #ifdef INET6
 	struct sockaddr_storage* local_addr,
 	struct sockaddr_storage* addr,
@@ -456,10 +544,13 @@ prep_send_data(struct buffer* buf, uint8_t is_response,
 	if(local_addr->sin_family != addr->sin_family)
 		return 0; /* must be same length to send */
 #endif
-	if(!buffer_available(buf, 4+1+4+2*addrlen+1+4+buffer_remaining(packet)))
-		return 0; /* does not fit in send_buffer, log is dropped */
+	if(!buffer_available(buf, 4+1+8+4+4+2*addrlen+1+4+
+		buffer_remaining(packet)))
+		return 0; /* does not fit in buffer, log is dropped */
 	buffer_skip(buf, 4); /* the length of the message goes here */
 	buffer_write_u8(buf, is_response);
+	buffer_write_u64(buf, (uint64_t)tv->tv_sec);
+	buffer_write_u32(buf, (uint32_t)tv->tv_usec);
 	buffer_write_u32(buf, addrlen);
 	buffer_write(buf, local_addr, (size_t)addrlen);
 	buffer_write(buf, addr, (size_t)addrlen);
@@ -496,7 +587,7 @@ static int attempt_to_send(int s, uint8_t* data, size_t len)
 		if(errno == EAGAIN || errno == EINTR ||
 				errno == ENOBUFS || errno == EMSGSIZE) {
 			/* check if pipe is full, if the nonblocking fd blocks,
-			 * then drop the message */
+			 * then a wakeup is already pending */
 			return 0;
 		}
 		/* some sort of error, print it */
@@ -514,6 +605,113 @@ static int attempt_to_send(int s, uint8_t* data, size_t len)
 	return -1;
 }
 
+/* see if the query is logged, by qtype and then by the sample rate.
+ * This looks at the query packet before it is processed. */
+static int
+dt_collector_sample(struct dt_collector* dt_col, struct buffer* packet)
+{
+	if(dt_col->qtypes) {
+		/* the qtype follows the qname in the question */
+		uint8_t* data = buffer_begin(packet);
+		size_t pos = QHEADERSZ, limit = buffer_limit(packet);
+		uint16_t qtype;
+		if(limit <= QHEADERSZ || QDCOUNT(packet) != 1)
+			return 0;
+		while(pos < limit && data[pos] != 0) {
+			if((data[pos]&0xc0))
+				return 0;
+			pos += data[pos]+1;
+		}
+		if(pos+1+2 > limit)
+			return 0;
+		qtype = read_uint16(data+pos+1);
+		if(!(dt_col->qtypes[qtype/8] & (1<<(qtype&7))))
+			return 0;
+	}
+	if(dt_col->sample_rate > 1) {
+		if(++dt_col->sample_count < dt_col->sample_rate)
+			return 0;
+		dt_col->sample_count = 0;
+	}
+	return 1;
+}
+
+/* write the message in the ring of this server process and wake up the
+ * collector if it waits for it. */
+static void
+dt_collector_submit(struct nsd* nsd, uint8_t is_response,
+#ifdef INET6
+	struct sockaddr_storage* local_addr,
+	struct sockaddr_storage* addr,
+#else
+	struct sockaddr_in* local_addr,
+	struct sockaddr_in* addr,
+#endif
+	socklen_t addrlen, int is_tcp, struct buffer* packet,
+	struct zone* zone)
+{
+	int *fd_send = nsd->dt_collector_fd_send < nsd->dt_collector_fd_swap
+		? nsd->dt_collector_fd_send : nsd->dt_collector_fd_swap;
+	int* fd = &nsd->dt_collector_fd_send[nsd->this_child->child_num];
+	struct dt_ring* ring = &nsd->dt_collector->rings[fd - fd_send];
+	uint64_t tail = ring->tail, head;
+	size_t pos, len, reclen, need;
+	struct buffer buf;
+	struct timeval tv;
+
+	len = 4+1+8+4+4+2*addrlen+1+4+buffer_remaining(packet)+4;
+	if(zone && zone->apex && domain_dname(zone->apex))
+		len += domain_dname(zone->apex)->name_size;
+	if(len > DT_MSG_MAX)
+		goto dropped; /* does not fit, log is dropped */
+	reclen = (len + 3) & ~((size_t)3);
+
+	/* space to write the message, contiguous in the data area */
+	head = ring->head;
+	dt_ring_barrier();
+	pos = tail % DT_RING_SIZE;
+	need = reclen;
+	if(DT_RING_SIZE - pos < reclen)
+		need += DT_RING_SIZE - pos;
+	if(DT_RING_SIZE - (size_t)(tail - head) < need)
+		goto dropped; /* the ring is full, log is dropped */
+	if(DT_RING_SIZE - pos < reclen) {
+		write_uint32(ring->data + pos, DT_RING_WRAP);
+		tail += DT_RING_SIZE - pos;
+		pos = 0;
+	}
+
+	/* marshal data into the ring, with the time of the message */
+	gettimeofday(&tv, NULL);
+	buffer_create_from(&buf, ring->data + pos, len);
+	if(!prep_send_data(&buf, is_response, &tv, local_addr, addr, addrlen,
+		is_tcp, packet, zone))
+		goto dropped;
+	assert(buffer_remaining(&buf) == len);
+
+	/* publish it, and then see if the collector has to be woken up */
+	dt_ring_barrier();
+	ring->tail = tail + reclen;
+	dt_ring_barrier();
+	if(ring->waiting) {
+		uint8_t wakeup = 1;
+		ring->waiting = 0;
+		if(attempt_to_send(*fd, &wakeup, sizeof(wakeup))) {
+			/* Something went wrong sending to the socket. Don't
+			 * send to this socket again. */
+			close(*fd);
+			*fd = -1;
+		}
+	}
+	return;
+
+dropped:
+#ifdef BIND8_STATS
+	nsd->st.dnstapdrop++;
+#endif
+	return;
+}
+
 void dt_collector_submit_auth_query(struct nsd* nsd,
 #ifdef INET6
 	struct sockaddr_storage* local_addr,
@@ -522,27 +720,18 @@ void dt_collector_submit_auth_query(struct nsd* nsd,
 	struct sockaddr_in* local_addr,
 	struct sockaddr_in* addr,
 #endif
-	socklen_t addrlen, int is_tcp, struct buffer* packet)
+	socklen_t addrlen, int is_tcp, struct buffer* packet, int* sampled)
 {
+	*sampled = 0;
 	if(!nsd->dt_collector) return;
+	*sampled = dt_collector_sample(nsd->dt_collector, packet);
+	if(!*sampled) return;
 	if(!nsd->options->dnstap_log_auth_query_messages) return;
 	if(nsd->dt_collector_fd_send[nsd->this_child->child_num] == -1) return;
 	VERBOSITY(4, (LOG_INFO, "dnstap submit auth query"));
 
-	/* marshal data into send buffer */
-	if(!prep_send_data(nsd->dt_collector->send_buffer, 0, local_addr, addr, addrlen,
-		is_tcp, packet, NULL))
-		return; /* probably did not fit in buffer */
-
-	/* attempt to send data; do not block */
-	if(attempt_to_send(nsd->dt_collector_fd_send[nsd->this_child->child_num],
-			buffer_begin(nsd->dt_collector->send_buffer),
-			buffer_remaining(nsd->dt_collector->send_buffer))) {
-		/* Something went wrong sending to the socket. Don't send to
-		 * this socket again. */
-		close(nsd->dt_collector_fd_send[nsd->this_child->child_num]);
-		nsd->dt_collector_fd_send[nsd->this_child->child_num] = -1;
-	}
+	dt_collector_submit(nsd, 0, local_addr, addr, addrlen, is_tcp,
+		packet, NULL);
 }
 
 void dt_collector_submit_auth_response(struct nsd* nsd,
@@ -554,25 +743,15 @@ void dt_collector_submit_auth_response(struct nsd* nsd,
 	struct sockaddr_in* addr,
 #endif
 	socklen_t addrlen, int is_tcp, struct buffer* packet,
-	struct zone* zone)
+	struct zone* zone, int sampled)
 {
 	if(!nsd->dt_collector) return;
+	if(!sampled && !(nsd->dt_collector->rcodes & (1<<RCODE(packet))))
+		return;
 	if(!nsd->options->dnstap_log_auth_response_messages) return;
 	if(nsd->dt_collector_fd_send[nsd->this_child->child_num] == -1) return;
 	VERBOSITY(4, (LOG_INFO, "dnstap submit auth response"));
 
-	/* marshal data into send buffer */
-	if(!prep_send_data(nsd->dt_collector->send_buffer, 1, local_addr, addr, addrlen,
-		is_tcp, packet, zone))
-		return; /* probably did not fit in buffer */
-
-	/* attempt to send data; do not block */
-	if(attempt_to_send(nsd->dt_collector_fd_send[nsd->this_child->child_num],
-			buffer_begin(nsd->dt_collector->send_buffer),
-			buffer_remaining(nsd->dt_collector->send_buffer))) {
-		/* Something went wrong sending to the socket. Don't send to
-		 * this socket again. */
-		close(nsd->dt_collector_fd_send[nsd->this_child->child_num]);
-		nsd->dt_collector_fd_send[nsd->this_child->child_num] = -1;
-	}
+	dt_collector_submit(nsd, 1, local_addr, addr, addrlen, is_tcp,
+		packet, zone);
 }
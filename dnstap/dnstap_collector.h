@@ -16,7 +16,7 @@ struct event;
 struct dt_collector_input;
 struct zone;
 struct buffer;
-struct region;
+struct dt_ring;
 
 /* information for the dnstap collector process. It collects information
  * for dnstap from the worker processes.  And writes them to the dnstap
@@ -39,20 +39,27 @@ struct dt_collector {
 	struct event* cmd_event;
 	/* in the collector process, array size count of input per worker */
 	struct dt_collector_input* inputs;
-	/* region for buffers */
-	struct region* region;
-	/* buffer for sending data to the collector */
-	struct buffer* send_buffer;
+	/* shared memory rings, array size count, one per worker channel.
+	 * Mapped before the fork, the worker writes the messages in it and
+	 * the collector reads them. */
+	struct dt_ring* rings;
+	/* log one in sample_rate queries, 0 or 1 logs all. The server
+	 * processes count in sample_count, each in its own copy. */
+	int sample_rate, sample_count;
+	/* qtypes to log, array of 65536 bits, NULL logs all */
+	uint8_t* qtypes;
+	/* rcodes of responses to log also when not sampled, bitmask */
+	uint32_t rcodes;
 };
 
 /* information per worker to get input from that worker. */
 struct dt_collector_input {
 	/* the collector this is part of (for use in callbacks) */
 	struct dt_collector* dt_collector;
-	/* the event to listen to the datagrams to process for that worker*/
+	/* the event to listen to the wakeups from that worker */
 	struct event* event;
-	/* buffer to store the datagrams while they are read in */
-	struct buffer* buffer;
+	/* the ring with messages from that worker */
+	struct dt_ring* ring;
 };
 
 /* create dt_collector process structure and dt_env */
@@ -64,9 +71,10 @@ void dt_collector_close(struct dt_collector* dt_col, struct nsd* nsd);
 /* start the collector process */
 void dt_collector_start(struct dt_collector* dt_col, struct nsd* nsd);
 
-/* submit auth query from worker.  It attempts to send it to the collector,
- * if the nonblocking fails, then it silently skips it.  So it does not block
- * on the log.
+/* submit auth query from worker.  It is written in the shared memory ring
+ * for the collector, if the ring is full, then it is dropped (and counted).
+ * So it does not block on the log.  The query is only logged if it is
+ * sampled, that is stored in sampled, to pass for the response.
  */
 void dt_collector_submit_auth_query(struct nsd* nsd,
 #ifdef INET6
@@ -76,11 +84,12 @@ void dt_collector_submit_auth_query(struct nsd* nsd,
 	struct sockaddr_in* local_addr,
 	struct sockaddr_in* addr,
 #endif
-	socklen_t addrlen, int is_tcp, struct buffer* packet);
+	socklen_t addrlen, int is_tcp, struct buffer* packet, int* sampled);
 
-/* submit auth response from worker.  It attempts to send it to the collector,
- * if the nonblocking fails, then it silently skips it.  So it does not block
- * on the log.
+/* submit auth response from worker.  It is written in the shared memory
+ * ring for the collector, if the ring is full, then it is dropped (and
+ * counted).  So it does not block on the log.  It is logged if the query
+ * was sampled, or if it has one of the dnstap-log-rcodes.
  */
 void dt_collector_submit_auth_response(struct nsd* nsd,
 #ifdef INET6
@@ -91,6 +100,6 @@ void dt_collector_submit_auth_response(struct nsd* nsd,
 	struct sockaddr_in* addr,
 #endif
 	socklen_t addrlen, int is_tcp, struct buffer* packet,
-	struct zone* zone);
+	struct zone* zone, int sampled);
 
 #endif /* DNSTAP_COLLECTOR_H */
@@ -72,6 +72,7 @@ edns_init_record(edns_record_type *edns)
 	edns->nsid = 0;
 	edns->cookie_status = COOKIE_NOT_PRESENT;
 	edns->cookie_len = 0;
+	edns->cookie_created = 0;
 	edns->ede = -1; /* -1 means no Extended DNS Error */
 	edns->ede_text = NULL;
 	edns->ede_text_len = 0;
@@ -197,6 +198,8 @@ edns_reserved_space(edns_record_type *edns)
 
 int siphash(const uint8_t *in, const size_t inlen,
                 const uint8_t *k, uint8_t *out, const size_t outlen);
+int siphash_x2(const uint8_t *in1, const uint8_t *in2, const size_t inlen,
+                const uint8_t *k, uint8_t *out1, uint8_t *out2);
 
 /** RFC 1982 comparison, uses unsigned integers, and tries to avoid
  * compiler optimization (eg. by avoiding a-b<0 comparisons),
@@ -305,15 +308,11 @@ void cookie_verify(query_type *q, struct nsd* nsd, uint32_t *now_p) {
 	}
 }
 
-void cookie_create(query_type *q, struct nsd* nsd, uint32_t *now_p)
+/** put the version, time and client address after the client cookie,
+ * returns the length of the input for the hash */
+static size_t
+cookie_create_input(query_type *q, uint32_t now_uint32)
 {
-	uint8_t  hash[8];
-	uint32_t now_uint32;
-       
-	if (q->edns.cookie_status == COOKIE_VALID_REUSE)
-		return;
-
-	now_uint32 = *now_p ? *now_p : (*now_p = (uint32_t)time(NULL));
 	q->edns.cookie[ 8] = 1;
 	q->edns.cookie[ 9] = 0;
 	q->edns.cookie[10] = 0;
@@ -326,16 +325,64 @@ void cookie_create(query_type *q, struct nsd* nsd, uint32_t *now_p)
 	if (q->addr.ss_family == AF_INET6) {
 		memcpy( q->edns.cookie + 16
 		      , &((struct sockaddr_in6 *)&q->addr)->sin6_addr, 16);
-		siphash(q->edns.cookie, 32, nsd->cookie_secrets[0].cookie_secret, hash, 8);
-	} else {
-		memcpy( q->edns.cookie + 16
-		      , &((struct sockaddr_in *)&q->addr)->sin_addr, 4);
-		siphash(q->edns.cookie, 20, nsd->cookie_secrets[0].cookie_secret, hash, 8);
+		return 32;
 	}
+	memcpy( q->edns.cookie + 16
+	      , &((struct sockaddr_in *)&q->addr)->sin_addr, 4);
+	return 20;
 #else
 	memcpy( q->edns.cookie + 16, &q->addr.sin_addr, 4);
-	siphash(q->edns.cookie, 20, nsd->cookie_secrets[0].cookie_secret, hash, 8);
+	return 20;
 #endif
+}
+
+void cookie_create(query_type *q, struct nsd* nsd, uint32_t *now_p)
+{
+	uint8_t  hash[8];
+	uint32_t now_uint32;
+	size_t len;
+
+	if (q->edns.cookie_status == COOKIE_VALID_REUSE
+	||  q->edns.cookie_created)
+		return;
+
+	now_uint32 = *now_p ? *now_p : (*now_p = (uint32_t)time(NULL));
+	len = cookie_create_input(q, now_uint32);
+	siphash(q->edns.cookie, len, nsd->cookie_secrets[0].cookie_secret, hash, 8);
 	memcpy(q->edns.cookie + 16, hash, 8);
 }
 
+void cookie_create_batch(query_type **queries, int num, struct nsd* nsd,
+	uint32_t *now_p)
+{
+	/* a query that waits for another with the same input length,
+	 * for IPv4 and IPv6 */
+	query_type *pending[2] = { NULL, NULL };
+	uint8_t  hash[8], hash2[8];
+	uint32_t now_uint32;
+	size_t len;
+	int i, ip6;
+
+	for(i = 0; i < num; i++) {
+		query_type *q = queries[i];
+		if (q->edns.status != EDNS_OK
+		||  q->edns.cookie_status == COOKIE_NOT_PRESENT
+		||  q->edns.cookie_status == COOKIE_VALID_REUSE)
+			continue;
+		now_uint32 = *now_p ? *now_p : (*now_p = (uint32_t)time(NULL));
+		len = cookie_create_input(q, now_uint32);
+		ip6 = (len == 32);
+		if (!pending[ip6]) {
+			pending[ip6] = q;
+			continue;
+		}
+		siphash_x2(pending[ip6]->edns.cookie, q->edns.cookie, len,
+			nsd->cookie_secrets[0].cookie_secret, hash, hash2);
+		memcpy(pending[ip6]->edns.cookie + 16, hash, 8);
+		memcpy(q->edns.cookie + 16, hash2, 8);
+		pending[ip6]->edns.cookie_created = 1;
+		q->edns.cookie_created = 1;
+		pending[ip6] = NULL;
+	}
+	/* the ones without a pair are created by cookie_create */
+}
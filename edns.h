@@ -62,6 +62,7 @@ struct edns_record
 	cookie_status_type cookie_status;
 	size_t             cookie_len;
 	uint8_t            cookie[40];
+	int                cookie_created; /* server cookie is in cookie */
 	int                ede; /* RFC 8914 - Extended DNS Errors */
 	char*              ede_text; /* RFC 8914 - Extended DNS Errors text*/
 	uint16_t           ede_text_len;
@@ -102,5 +103,8 @@ void edns_init_nsid(edns_data_type *data, uint16_t nsid_len);
 
 void cookie_verify(struct query *q, struct nsd* nsd, uint32_t *now_p);
 void cookie_create(struct query *q, struct nsd* nsd, uint32_t *now_p);
+/* create the server cookies for the answers to a batch of queries */
+void cookie_create_batch(struct query **queries, int num, struct nsd* nsd,
+	uint32_t *now_p);
 
 #endif /* _EDNS_H_ */
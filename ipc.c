@@ -285,6 +285,9 @@ stats_add(struct nsdst* total, struct nsdst* s)
 	total->raxfr += s->raxfr;
 	total->nona += s->nona;
 	total->rixfr += s->rixfr;
+	total->nsec3hit += s->nsec3hit;
+	total->nsec3miss += s->nsec3miss;
+	total->dnstapdrop += s->dnstapdrop;
 
 	total->db_disk = s->db_disk;
 	total->db_mem = s->db_mem;
@@ -319,6 +322,9 @@ stats_subtract(struct nsdst* total, struct nsdst* s)
 	total->raxfr -= s->raxfr;
 	total->nona -= s->nona;
 	total->rixfr -= s->rixfr;
+	total->nsec3hit -= s->nsec3hit;
+	total->nsec3miss -= s->nsec3miss;
+	total->dnstapdrop -= s->dnstapdrop;
 }
 
 #define FINAL_STATS_TIMEOUT 10 /* seconds */
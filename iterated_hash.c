@@ -20,6 +20,40 @@
 #include "iterated_hash.h"
 #include "util.h"
 
+#if defined(HAVE_SSL) && !(defined(HAVE_SHA1_INIT) && !defined(DEPRECATED_SHA1_INIT))
+/* The digest context and the SHA1 method are kept between calls, the
+ * prehash of a zone calls this for every name, and a new context, and
+ * with OpenSSL 3 the implicit fetch of the method, costs more than the
+ * hash itself.  The processes are single threaded. */
+static EVP_MD_CTX* iterated_hash_ctx = NULL;
+static const EVP_MD* iterated_hash_md = NULL;
+
+/* get the cached digest context, or NULL on failure */
+static EVP_MD_CTX*
+iterated_hash_get_ctx(void)
+{
+	if(!iterated_hash_md) {
+#ifdef HAVE_EVP_MD_FETCH
+		iterated_hash_md = EVP_MD_fetch(NULL, "SHA1", NULL);
+#else
+		iterated_hash_md = EVP_sha1();
+#endif
+		if(!iterated_hash_md) {
+			log_msg(LOG_ERR, "iterated_hash could not fetch SHA1");
+			return NULL;
+		}
+	}
+	if(!iterated_hash_ctx) {
+		iterated_hash_ctx = EVP_MD_CTX_create();
+		if(!iterated_hash_ctx) {
+			log_msg(LOG_ERR, "out of memory in iterated_hash");
+			return NULL;
+		}
+	}
+	return iterated_hash_ctx;
+}
+#endif
+
 int
 iterated_hash(unsigned char out[SHA_DIGEST_LENGTH],
 	const unsigned char *salt, int saltlength,
@@ -34,11 +68,9 @@ iterated_hash(unsigned char out[SHA_DIGEST_LENGTH],
 	int n;
 #if defined(HAVE_SHA1_INIT) && !defined(DEPRECATED_SHA1_INIT)
 #else
-	ctx = EVP_MD_CTX_create();
-	if(!ctx) {
-		log_msg(LOG_ERR, "out of memory in iterated_hash");
+	ctx = iterated_hash_get_ctx();
+	if(!ctx)
 		return 0;
-	}
 #endif
 	assert(in && inlength > 0 && iterations >= 0);
 	for(n=0 ; n <= iterations ; ++n)
@@ -50,8 +82,8 @@ iterated_hash(unsigned char out[SHA_DIGEST_LENGTH],
 			SHA1_Update(&ctx, salt, saltlength);
 		SHA1_Final(out, &ctx);
 #else
-		if(!EVP_DigestInit(ctx, EVP_sha1()))
-			log_msg(LOG_ERR, "iterated_hash could not EVP_DigestInit");
+		if(!EVP_DigestInit_ex(ctx, iterated_hash_md, NULL))
+			log_msg(LOG_ERR, "iterated_hash could not EVP_DigestInit_ex");
 
 		if(!EVP_DigestUpdate(ctx, in, inlength))
 			log_msg(LOG_ERR, "iterated_hash could not EVP_DigestUpdate");
@@ -65,10 +97,6 @@ iterated_hash(unsigned char out[SHA_DIGEST_LENGTH],
 		in=out;
 		inlength=SHA_DIGEST_LENGTH;
 	}
-#if defined(HAVE_SHA1_INIT) && !defined(DEPRECATED_SHA1_INIT)
-#else
-	EVP_MD_CTX_destroy(ctx);
-#endif
 	return SHA_DIGEST_LENGTH;
 #else
 	(void)out; (void)salt; (void)saltlength;
@@ -77,4 +105,21 @@ iterated_hash(unsigned char out[SHA_DIGEST_LENGTH],
 #endif
 }
 
+void
+iterated_hash_cleanup(void)
+{
+#if defined(HAVE_SSL) && !(defined(HAVE_SHA1_INIT) && !defined(DEPRECATED_SHA1_INIT))
+	if(iterated_hash_ctx) {
+		EVP_MD_CTX_destroy(iterated_hash_ctx);
+		iterated_hash_ctx = NULL;
+	}
+#ifdef HAVE_EVP_MD_FETCH
+	if(iterated_hash_md) {
+		EVP_MD_free((EVP_MD*)iterated_hash_md);
+	}
+#endif
+	iterated_hash_md = NULL;
+#endif
+}
+
 #endif /* NSEC3 */
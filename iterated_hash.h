@@ -18,6 +18,8 @@
 int iterated_hash(unsigned char out[SHA_DIGEST_LENGTH],
 	const unsigned char *salt,int saltlength,
 	const unsigned char *in,int inlength,int iterations);
+/* free the digest context and method that iterated_hash keeps */
+void iterated_hash_cleanup(void);
 
 #endif /* NSEC3 */
 #endif /* ITERATED_HASH_H */
@@ -19,6 +19,9 @@
 #  include <sys/stat.h>
 #endif
 #include <unistd.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif /* HAVE_MMAP */
 
 #include "ixfr.h"
 #include "packet.h"
@@ -26,6 +29,7 @@
 #include "axfr.h"
 #include "options.h"
 #include "zonec.h"
+#include "lookup3.h"
 
 /*
  * For optimal compression IXFR response packets are limited in size
@@ -65,6 +69,72 @@ struct pktcompression {
 	uint8_t block[sizeof(struct rrcompress_entry)*1024];
 };
 
+/* The packed reply stream for IXFR queries from a serial. The answer
+ * sections of the packets are stored, for the queries for the same serial
+ * that have the same space in the packets. TSIG is not part of it, it is
+ * added per query. */
+struct ixfr_pack {
+	/* the zone that keeps it, NULL if it is dropped from the cache
+	 * while queries still send from it */
+	struct zone_ixfr* ixfr;
+	/* the ixfr data where the stream starts */
+	struct ixfr_data* data;
+	/* the space in the packets, the maxlen minus reserved space */
+	size_t space;
+	/* the query name in the first packet, that is compressed to */
+	uint8_t* qname;
+	/* length of the query name */
+	size_t qname_len;
+	/* the number of packets */
+	size_t num;
+	/* per packet the start of its answer section in bytes, the
+	 * entry after the last packet is the total length */
+	size_t* offsets;
+	/* per packet the number of RRs in the answer section */
+	uint16_t* ancount;
+	/* the answer sections of the packets */
+	uint8_t* bytes;
+	/* size of the answer sections, in bytes */
+	size_t size;
+	/* while the packets are recorded, the allocated number of packets
+	 * and bytes */
+	size_t num_max, bytes_max;
+	/* if true, the stream is too large to keep, and there are no
+	 * packets. The entry stops the next queries from building it. */
+	int too_large;
+	/* number of queries that send packets from it */
+	size_t refs;
+	/* when it was last used, to replace the least recently used */
+	uint64_t use;
+	/* the list of packed streams in the process, most recently used
+	 * first, for the cache size of the process */
+	struct ixfr_pack* prev, *next;
+};
+
+/* the packed streams of the process, most recently used first */
+static struct ixfr_pack* ixfr_pack_first = NULL, *ixfr_pack_last = NULL;
+/* the total size of the packed streams of the process, in bytes */
+static size_t ixfr_pack_total = 0;
+/* counter for the last use of packed streams */
+static uint64_t ixfr_pack_clock = 0;
+
+/* A condensed change that the zone keeps, for the IXFR queries from
+ * its old serial. */
+struct ixfr_condensed {
+	/* the zone that keeps it, NULL if it is dropped from the cache
+	 * while queries still send from it */
+	struct zone_ixfr* ixfr;
+	/* the condensed change, it is not in the ixfr data tree */
+	struct ixfr_data* data;
+	/* number of queries that send from it */
+	size_t refs;
+	/* when it was last used, to replace the least recently used */
+	uint64_t use;
+};
+
+/* counter for the last use of condensed changes */
+static uint64_t ixfr_condensed_clock = 0;
+
 /* compare two elements in the compression tree. Returns -1, 0, or 1. */
 static int compression_cmp(const void* a, const void* b)
 {
@@ -258,6 +328,78 @@ static int pktcompression_write_dname(struct buffer* packet,
 	return wirelen;
 }
 
+/* the length of the rdata atom at the start of rdata, in uncompressed
+ * wireformat. For a domain name, and for the atoms that run to the end,
+ * it is the rest of the rdata. */
+static size_t rdata_atom_wire_len(uint16_t tp, size_t i, const uint8_t* rr,
+	size_t rdlen)
+{
+	size_t len;
+	switch(rdata_atom_wireformat_type(tp, i)) {
+	case RDATA_WF_COMPRESSED_DNAME:
+	case RDATA_WF_UNCOMPRESSED_DNAME:
+	case RDATA_WF_LITERAL_DNAME:
+		len = rdlen;
+		break;
+	case RDATA_WF_BYTE:
+		len = 1;
+		break;
+	case RDATA_WF_SHORT:
+		len = 2;
+		break;
+	case RDATA_WF_LONG:
+		len = 4;
+		break;
+	case RDATA_WF_TEXTS:
+	case RDATA_WF_LONG_TEXT:
+		len = rdlen;
+		break;
+	case RDATA_WF_TEXT:
+	case RDATA_WF_BINARYWITHLENGTH:
+		len = 1;
+		if(rdlen > len)
+			len += rr[0];
+		break;
+	case RDATA_WF_A:
+		len = 4;
+		break;
+	case RDATA_WF_AAAA:
+		len = 16;
+		break;
+	case RDATA_WF_ILNP64:
+		len = 8;
+		break;
+	case RDATA_WF_EUI48:
+		len = EUI48ADDRLEN;
+		break;
+	case RDATA_WF_EUI64:
+		len = EUI64ADDRLEN;
+		break;
+	case RDATA_WF_BINARY:
+		len = rdlen;
+		break;
+	case RDATA_WF_APL:
+		len = (sizeof(uint16_t)    /* address family */
+			+ sizeof(uint8_t)   /* prefix */
+			+ sizeof(uint8_t)); /* length */
+		if(len <= rdlen)
+			len += (rr[len-1]&APL_LENGTH_MASK);
+		break;
+	case RDATA_WF_IPSECGATEWAY:
+		len = rdlen;
+		break;
+	case RDATA_WF_SVCPARAM:
+		len = 4;
+		if(len <= rdlen)
+			len += read_uint16(rr+2);
+		break;
+	default:
+		len = rdlen;
+		break;
+	}
+	return len;
+}
+
 /* write an RR into the packet with compression for domain names,
  * return 0 and resets position if it does not fit in the packet. */
 static int ixfr_write_rr_pkt(struct query* query, struct buffer* packet,
@@ -327,64 +469,8 @@ static int ixfr_write_rr_pkt(struct query* query, struct buffer* packet,
 			rr += dname_len;
 			rdlen -= dname_len;
 			break;
-		case RDATA_WF_UNCOMPRESSED_DNAME:
-		case RDATA_WF_LITERAL_DNAME:
-			copy_len = rdlen;
-			break;
-		case RDATA_WF_BYTE:
-			copy_len = 1;
-			break;
-		case RDATA_WF_SHORT:
-			copy_len = 2;
-			break;
-		case RDATA_WF_LONG:
-			copy_len = 4;
-			break;
-		case RDATA_WF_TEXTS:
-		case RDATA_WF_LONG_TEXT:
-			copy_len = rdlen;
-			break;
-		case RDATA_WF_TEXT:
-		case RDATA_WF_BINARYWITHLENGTH:
-			copy_len = 1;
-			if(rdlen > copy_len)
-				copy_len += rr[0];
-			break;
-		case RDATA_WF_A:
-			copy_len = 4;
-			break;
-		case RDATA_WF_AAAA:
-			copy_len = 16;
-			break;
-		case RDATA_WF_ILNP64:
-			copy_len = 8;
-			break;
-		case RDATA_WF_EUI48:
-			copy_len = EUI48ADDRLEN;
-			break;
-		case RDATA_WF_EUI64:
-			copy_len = EUI64ADDRLEN;
-			break;
-		case RDATA_WF_BINARY:
-			copy_len = rdlen;
-			break;
-		case RDATA_WF_APL:
-			copy_len = (sizeof(uint16_t)    /* address family */
-                                  + sizeof(uint8_t)   /* prefix */
-                                  + sizeof(uint8_t)); /* length */
-			if(copy_len <= rdlen)
-				copy_len += (rr[copy_len-1]&APL_LENGTH_MASK);
-			break;
-		case RDATA_WF_IPSECGATEWAY:
-			copy_len = rdlen;
-			break;
-		case RDATA_WF_SVCPARAM:
-			copy_len = 4;
-			if(copy_len <= rdlen)
-				copy_len += read_uint16(rr+2);
-			break;
 		default:
-			copy_len = rdlen;
+			copy_len = rdata_atom_wire_len(tp, i, rr, rdlen);
 			break;
 		}
 		if(copy_len) {
@@ -715,6 +801,665 @@ static uint16_t ixfr_copy_rrs_into_packet(struct query* query,
 	return total_added;
 }
 
+/* RR in the condensed change, the RR is found by its wireformat with
+ * the domain names in lowercase */
+struct condense_rr {
+	/* the uncompressed wireformat RR, in the ixfr data */
+	const uint8_t* rr;
+	/* the RR with the owner and rdata domain names in lowercase */
+	const uint8_t* key;
+	/* length of the RR */
+	size_t len;
+	/* hash of the key */
+	uint32_t hash;
+	/* 0 if it is removed from the change, CONDENSE_DEL, CONDENSE_ADD */
+	int state;
+};
+#define CONDENSE_DEL 1
+#define CONDENSE_ADD 2
+
+/* the condensed change that is made from the ixfr data sections */
+struct condense {
+	/* the RRs, in the order that they are seen */
+	struct condense_rr* rrs;
+	/* the number of RRs */
+	size_t num;
+	/* hash table with the RR index plus one, 0 is empty */
+	size_t* slots;
+	/* number of slots, a power of two */
+	size_t size;
+	/* the lowercase copies of the RRs */
+	uint8_t* keys;
+	/* bytes used in keys */
+	size_t keys_len;
+};
+
+/* the type of an uncompressed wireformat RR, that has a valid length */
+static uint16_t condense_rr_type(const uint8_t* rr)
+{
+	size_t i = 0;
+	while(rr[i] != 0)
+		i += rr[i]+1;
+	return read_uint16(rr+i+1);
+}
+
+/* count the number of RRs in a section */
+static size_t condense_count_rrs(const uint8_t* data, size_t len)
+{
+	size_t pos = 0, rrlen, count = 0;
+	while((rrlen = count_rr_length(data, len, pos)) != 0) {
+		pos += rrlen;
+		count++;
+	}
+	return count;
+}
+
+/* lowercase the domain name at pos, that ends before len, returns the
+ * position after the name or 0 if it is malformed */
+static size_t condense_lower_dname(uint8_t* rr, size_t len, size_t pos)
+{
+	while(pos < len && rr[pos] != 0) {
+		size_t i, lablen = rr[pos];
+		if((lablen&0xc0) || pos+1+lablen >= len)
+			return 0;
+		for(i=pos+1; i<=pos+lablen; i++)
+			rr[i] = (uint8_t)tolower((unsigned char)rr[i]);
+		pos += lablen+1;
+	}
+	if(pos >= len)
+		return 0;
+	return pos+1;
+}
+
+/* Copy the RR into key, with the owner name and the domain names in the
+ * rdata in lowercase. The names compare case insensitive, like the
+ * domain table does when the RRs are applied to the zone. */
+static void condense_make_key(uint8_t* key, const uint8_t* rr, size_t len)
+{
+	size_t i, pos, rdend;
+	uint16_t tp;
+	rrtype_descriptor_type* descriptor;
+	memcpy(key, rr, len);
+	pos = condense_lower_dname(key, len, 0);
+	if(pos == 0 || pos+10 > len)
+		return;
+	tp = read_uint16(key+pos);
+	rdend = pos+10+read_uint16(key+pos+8);
+	pos += 10;
+	if(rdend > len)
+		return;
+	descriptor = rrtype_descriptor_by_type(tp);
+	for(i=0; i<descriptor->maximum && pos < rdend; i++) {
+		switch(rdata_atom_wireformat_type(tp, i)) {
+		case RDATA_WF_COMPRESSED_DNAME:
+		case RDATA_WF_UNCOMPRESSED_DNAME:
+			pos = condense_lower_dname(key, rdend, pos);
+			if(pos == 0)
+				return;
+			break;
+		default:
+			pos += rdata_atom_wire_len(tp, i, key+pos, rdend-pos);
+			break;
+		}
+	}
+}
+
+/* find the RR in the change with the state, NULL if not found */
+static struct condense_rr* condense_find(struct condense* c,
+	const uint8_t* key, size_t len, uint32_t hash, int state)
+{
+	size_t slot = hash & (c->size-1);
+	while(c->slots[slot] != 0) {
+		struct condense_rr* e = &c->rrs[c->slots[slot]-1];
+		if(e->state == state && e->hash == hash && e->len == len &&
+			memcmp(e->key, key, len) == 0)
+			return e;
+		slot = (slot+1) & (c->size-1);
+	}
+	return NULL;
+}
+
+/* insert the RR with the state in the change */
+static void condense_insert(struct condense* c, const uint8_t* rr,
+	const uint8_t* key, size_t len, uint32_t hash, int state)
+{
+	size_t slot = hash & (c->size-1);
+	while(c->slots[slot] != 0)
+		slot = (slot+1) & (c->size-1);
+	c->rrs[c->num].rr = rr;
+	c->rrs[c->num].key = key;
+	c->rrs[c->num].len = len;
+	c->rrs[c->num].hash = hash;
+	c->rrs[c->num].state = state;
+	c->slots[slot] = ++c->num;
+}
+
+/* Apply the RRs of a section to the change. An RR that is deleted after
+ * it was added, or added after it was deleted, cancels out. */
+static void condense_section(struct condense* c, const uint8_t* data,
+	size_t len, int state)
+{
+	int other = (state == CONDENSE_DEL)?CONDENSE_ADD:CONDENSE_DEL;
+	size_t pos = 0, rrlen;
+	while((rrlen = count_rr_length(data, len, pos)) != 0) {
+		const uint8_t* rr = data+pos;
+		pos += rrlen;
+		/* the SOA records mark the versions, the condensed change
+		 * gets the first and last SOA */
+		if(condense_rr_type(rr) != TYPE_SOA) {
+			uint8_t* key = c->keys + c->keys_len;
+			uint32_t hash;
+			struct condense_rr* e;
+			condense_make_key(key, rr, rrlen);
+			hash = hashlittle(key, rrlen, 0);
+			e = condense_find(c, key, rrlen, hash, other);
+			if(e) {
+				e->state = 0;
+			} else {
+				condense_insert(c, rr, key, rrlen, hash, state);
+				c->keys_len += rrlen;
+			}
+		}
+	}
+}
+
+/* Make the section for the condensed change, the RRs with the state and
+ * then the new SOA record, returns NULL on alloc failure */
+static uint8_t* condense_make_section(struct condense* c, int state,
+	struct ixfr_data* last, size_t* len)
+{
+	size_t i, pos = 0;
+	uint8_t* data;
+	*len = last->newsoa_len;
+	for(i=0; i<c->num; i++)
+		if(c->rrs[i].state == state)
+			*len += c->rrs[i].len;
+	data = malloc(*len);
+	if(!data)
+		return NULL;
+	for(i=0; i<c->num; i++) {
+		if(c->rrs[i].state == state) {
+			memcpy(data+pos, c->rrs[i].rr, c->rrs[i].len);
+			pos += c->rrs[i].len;
+		}
+	}
+	memcpy(data+pos, last->newsoa, last->newsoa_len);
+	return data;
+}
+
+/* free a condensed ixfr data, the SOA records belong to the ixfr data
+ * that it was made from */
+void ixfr_condensed_free(struct ixfr_data* data)
+{
+	if(!data)
+		return;
+	free(data->del);
+	free(data->add);
+	free(data);
+}
+
+/* Make the condensed change from the ixfr data to the last ixfr data,
+ * the first and last ixfr data are connected. NULL on alloc failure. */
+struct ixfr_data* ixfr_condensed_create(struct zone_ixfr* ixfr,
+	struct ixfr_data* first, struct ixfr_data* last)
+{
+	struct condense c;
+	struct ixfr_data* p, *data;
+	size_t total = 0, bytes = 0;
+
+	/* the RRs of all the versions in between */
+	for(p = first; p; p = (p==last)?NULL:ixfr_data_next(ixfr, p)) {
+		total += condense_count_rrs(p->del, p->del_len) +
+			condense_count_rrs(p->add, p->add_len);
+		bytes += p->del_len + p->add_len;
+	}
+	memset(&c, 0, sizeof(c));
+	c.size = 1;
+	while(c.size < total*2)
+		c.size <<= 1;
+	c.rrs = calloc(total?total:1, sizeof(*c.rrs));
+	c.slots = calloc(c.size, sizeof(*c.slots));
+	c.keys = malloc(bytes?bytes:1);
+	data = calloc(1, sizeof(*data));
+	if(!c.rrs || !c.slots || !c.keys || !data) {
+		free(c.rrs);
+		free(c.slots);
+		free(c.keys);
+		free(data);
+		return NULL;
+	}
+	for(p = first; p; p = (p==last)?NULL:ixfr_data_next(ixfr, p)) {
+		condense_section(&c, p->del, p->del_len, CONDENSE_DEL);
+		condense_section(&c, p->add, p->add_len, CONDENSE_ADD);
+	}
+
+	data->oldserial = first->oldserial;
+	data->newserial = last->newserial;
+	data->oldsoa = first->oldsoa;
+	data->oldsoa_len = first->oldsoa_len;
+	data->newsoa = last->newsoa;
+	data->newsoa_len = last->newsoa_len;
+	data->del = condense_make_section(&c, CONDENSE_DEL, last,
+		&data->del_len);
+	data->add = condense_make_section(&c, CONDENSE_ADD, last,
+		&data->add_len);
+	free(c.rrs);
+	free(c.slots);
+	free(c.keys);
+	if(!data->del || !data->add) {
+		ixfr_condensed_free(data);
+		return NULL;
+	}
+	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "ixfr condensed %u to %u, from %u "
+		"RRs to %u bytes", (unsigned)data->oldserial,
+		(unsigned)data->newserial, (unsigned)total,
+		(unsigned)(data->del_len + data->add_len)));
+	return data;
+}
+
+/* Fill the packet with the RRs, continue with the next ixfr data when
+ * one is done, return number of RRs added */
+static uint16_t ixfr_copy_packet(struct query* query,
+	struct pktcompression* pcomp)
+{
+	uint16_t total_added = ixfr_copy_rrs_into_packet(query, pcomp);
+
+	while(query->ixfr_count_add >= query->ixfr_data->add_len) {
+		/* the end data is the last, or the condensed data that
+		 * is not part of the ixfr data tree */
+		struct ixfr_data* next = (query->ixfr_data ==
+			query->ixfr_end_data)?NULL:ixfr_data_next(
+			query->zone->ixfr, query->ixfr_data);
+		/* finished the ixfr_data */
+		if(next) {
+			/* move to the next IXFR */
+			query->ixfr_data = next;
+			/* we need to skip the SOA records, set len to done*/
+			/* the newsoa count is already done, at end_data len */
+			query->ixfr_count_oldsoa = next->oldsoa_len;
+			/* and then set up to copy the del and add sections */
+			query->ixfr_count_del = 0;
+			query->ixfr_count_add = 0;
+			total_added += ixfr_copy_rrs_into_packet(query, pcomp);
+		} else {
+			/* we finished the IXFR */
+			/* sign the last packet */
+			query->tsig_sign_it = 1;
+			query->ixfr_is_done = 1;
+			break;
+		}
+	}
+	return total_added;
+}
+
+/* free a packed reply stream */
+static void ixfr_pack_free(struct ixfr_pack* pack)
+{
+	if(!pack)
+		return;
+	free(pack->qname);
+	free(pack->offsets);
+	free(pack->ancount);
+	free(pack->bytes);
+	free(pack);
+}
+
+/* remove a packed reply stream from the list of the process */
+static void ixfr_pack_unlink(struct ixfr_pack* pack)
+{
+	if(pack->prev)
+		pack->prev->next = pack->next;
+	else	ixfr_pack_first = pack->next;
+	if(pack->next)
+		pack->next->prev = pack->prev;
+	else	ixfr_pack_last = pack->prev;
+	pack->prev = NULL;
+	pack->next = NULL;
+}
+
+/* put a packed reply stream at the front of the list of the process */
+static void ixfr_pack_link(struct ixfr_pack* pack)
+{
+	pack->prev = NULL;
+	pack->next = ixfr_pack_first;
+	if(ixfr_pack_first)
+		ixfr_pack_first->prev = pack;
+	else	ixfr_pack_last = pack;
+	ixfr_pack_first = pack;
+}
+
+/* drop a packed reply stream from the cache, it is freed when the last
+ * query that sends from it is done */
+static void ixfr_pack_drop(struct ixfr_pack* pack)
+{
+	struct zone_ixfr* ixfr = pack->ixfr;
+	int i;
+	for(i=0; i<IXFR_PACK_NUMBER; i++) {
+		if(ixfr->pack[i] == pack)
+			ixfr->pack[i] = NULL;
+	}
+	ixfr->pack_size -= pack->size;
+	ixfr_pack_total -= pack->size;
+	ixfr_pack_unlink(pack);
+	pack->ixfr = NULL;
+	if(pack->refs == 0)
+		ixfr_pack_free(pack);
+}
+
+/* region cleanup of the query that sends from a packed reply stream */
+static void ixfr_pack_release(void* arg)
+{
+	struct ixfr_pack* pack = (struct ixfr_pack*)arg;
+	pack->refs--;
+	if(pack->refs == 0 && !pack->ixfr)
+		ixfr_pack_free(pack);
+}
+
+/* drop a condensed change from the cache, with the packed reply streams
+ * that start at it. It is freed when the last query that sends from it
+ * is done */
+static void ixfr_condensed_drop(struct ixfr_condensed* cond)
+{
+	struct zone_ixfr* ixfr = cond->ixfr;
+	int i;
+	for(i=0; i<IXFR_PACK_NUMBER; i++) {
+		if(ixfr->pack[i] && ixfr->pack[i]->data == cond->data)
+			ixfr_pack_drop(ixfr->pack[i]);
+	}
+	for(i=0; i<IXFR_CONDENSE_NUMBER; i++) {
+		if(ixfr->condensed[i] == cond)
+			ixfr->condensed[i] = NULL;
+	}
+	cond->ixfr = NULL;
+	if(cond->refs == 0) {
+		ixfr_condensed_free(cond->data);
+		free(cond);
+	}
+}
+
+/* region cleanup of the query that sends from a condensed change */
+static void ixfr_condensed_release(void* arg)
+{
+	struct ixfr_condensed* cond = (struct ixfr_condensed*)arg;
+	cond->refs--;
+	if(cond->refs == 0 && !cond->ixfr) {
+		ixfr_condensed_free(cond->data);
+		free(cond);
+	}
+}
+
+/* Find the condensed change from the ixfr data to the last for the
+ * query, or make it and replace the least recently used one of the zone.
+ * It is kept while the query sends from it. NULL if not available. */
+static struct ixfr_data* ixfr_condensed_find(struct zone_ixfr* ixfr,
+	struct query* query, struct ixfr_data* first, struct ixfr_data* last)
+{
+	struct ixfr_condensed* cond = NULL;
+	int i, slot = 0;
+	for(i=0; i<IXFR_CONDENSE_NUMBER; i++) {
+		if(ixfr->condensed[i] &&
+			ixfr->condensed[i]->data->oldserial == first->oldserial &&
+			ixfr->condensed[i]->data->newserial == last->newserial) {
+			cond = ixfr->condensed[i];
+			break;
+		}
+	}
+	if(!cond) {
+		struct ixfr_data* data = ixfr_condensed_create(ixfr, first,
+			last);
+		if(!data)
+			return NULL;
+		for(i=0; i<IXFR_CONDENSE_NUMBER; i++) {
+			if(!ixfr->condensed[i]) {
+				slot = i;
+				break;
+			}
+			if(ixfr->condensed[i]->use <
+				ixfr->condensed[slot]->use)
+				slot = i;
+		}
+		if(ixfr->condensed[slot])
+			ixfr_condensed_drop(ixfr->condensed[slot]);
+		cond = xalloc_zero(sizeof(*cond));
+		cond->ixfr = ixfr;
+		cond->data = data;
+		ixfr->condensed[slot] = cond;
+	}
+	cond->use = ++ixfr_condensed_clock;
+	cond->refs++;
+	region_add_cleanup(query->region, ixfr_condensed_release, cond);
+	return cond->data;
+}
+
+/* drop the packed reply streams and condensed ixfr data of the zone,
+ * the ixfr data changes */
+static void zone_ixfr_cache_clear(struct zone_ixfr* ixfr)
+{
+	int i;
+	for(i=0; i<IXFR_CONDENSE_NUMBER; i++) {
+		if(ixfr->condensed[i])
+			ixfr_condensed_drop(ixfr->condensed[i]);
+	}
+	for(i=0; i<IXFR_PACK_NUMBER; i++) {
+		if(ixfr->pack[i])
+			ixfr_pack_drop(ixfr->pack[i]);
+	}
+	ixfr->pack_size = 0;
+}
+
+/* the space for RRs in the packets of the query */
+static size_t ixfr_pack_space(struct query* query)
+{
+	return query->maxlen - query->reserved_space;
+}
+
+/* find the packed reply stream for the query, that starts at the data.
+ * The query name is compared in lowercase, the stream only has
+ * compression pointers to the name in the question. */
+static struct ixfr_pack* ixfr_pack_find(struct zone_ixfr* ixfr,
+	struct ixfr_data* data, size_t space, const uint8_t* qname,
+	size_t qname_len)
+{
+	int i;
+	for(i=0; i<IXFR_PACK_NUMBER; i++) {
+		struct ixfr_pack* pack = ixfr->pack[i];
+		if(pack && pack->data == data && pack->space == space &&
+			pack->qname_len == qname_len &&
+			memcmp(pack->qname, qname, qname_len) == 0)
+			return pack;
+	}
+	return NULL;
+}
+
+/* put the packed reply stream in the cache of the zone, it replaces the
+ * least recently used streams of the zone and of the process, so that it
+ * fits in the size of the zone and of the process */
+static void ixfr_pack_insert(struct zone_ixfr* ixfr, struct ixfr_pack* pack,
+	size_t cache_max)
+{
+	struct ixfr_pack* p;
+	int i, slot = 0;
+	for(i=0; i<IXFR_PACK_NUMBER; i++) {
+		if(!ixfr->pack[i]) {
+			slot = i;
+			break;
+		}
+		if(ixfr->pack[i]->use < ixfr->pack[slot]->use)
+			slot = i;
+	}
+	if(ixfr->pack[slot])
+		ixfr_pack_drop(ixfr->pack[slot]);
+	while(ixfr->pack_size + pack->size > IXFR_PACK_SIZE_MAX) {
+		struct ixfr_pack* lru = NULL;
+		for(i=0; i<IXFR_PACK_NUMBER; i++) {
+			if(ixfr->pack[i] && ixfr->pack[i]->size != 0 &&
+				(!lru || ixfr->pack[i]->use < lru->use))
+				lru = ixfr->pack[i];
+		}
+		if(!lru)
+			break;
+		ixfr_pack_drop(lru);
+	}
+	p = ixfr_pack_last;
+	while(p && ixfr_pack_total + pack->size > cache_max) {
+		struct ixfr_pack* prev = p->prev;
+		if(p->size != 0)
+			ixfr_pack_drop(p);
+		p = prev;
+	}
+	pack->ixfr = ixfr;
+	ixfr->pack[slot] = pack;
+	ixfr->pack_size += pack->size;
+	ixfr_pack_total += pack->size;
+	ixfr_pack_link(pack);
+}
+
+/* see if the ixfr data is still in use by the zone, it is in the ixfr
+ * data tree or it is a condensed change that the zone keeps */
+static int ixfr_pack_data_current(struct zone_ixfr* ixfr,
+	struct ixfr_data* data)
+{
+	int i;
+	if(zone_ixfr_find_serial(ixfr, data->oldserial) == data)
+		return 1;
+	for(i=0; i<IXFR_CONDENSE_NUMBER; i++) {
+		if(ixfr->condensed[i] && ixfr->condensed[i]->data == data)
+			return 1;
+	}
+	return 0;
+}
+
+/* Look up the packed reply stream for the IXFR query, and use it for the
+ * packets of the query. If there is none, the packets that the query
+ * makes are recorded, and the stream is put in the cache when the query
+ * is done. The query is set up to start at its ixfr data. Only for TCP,
+ * the UDP answer is one packet. */
+static void ixfr_pack_use(struct zone_ixfr* ixfr, struct query* query,
+	size_t cache_max)
+{
+	struct ixfr_pack* pack;
+	if(!query->tcp || cache_max == 0)
+		return;
+	pack = ixfr_pack_find(ixfr, query->ixfr_data, ixfr_pack_space(query),
+		dname_name(query->qname), query->qname->name_size);
+	if(!pack) {
+		/* record the packets of this query */
+		pack = xalloc_zero(sizeof(*pack));
+		pack->data = query->ixfr_data;
+		pack->space = ixfr_pack_space(query);
+		pack->qname_len = query->qname->name_size;
+		pack->qname = xalloc(pack->qname_len);
+		memcpy(pack->qname, dname_name(query->qname),
+			pack->qname_len);
+		pack->num_max = 16;
+		pack->bytes_max = 4096;
+		pack->offsets = xalloc_array_zero(pack->num_max+1,
+			sizeof(size_t));
+		pack->ancount = xalloc_array_zero(pack->num_max,
+			sizeof(uint16_t));
+		pack->bytes = xalloc(pack->bytes_max);
+		/* freed by the cleanup if it is not put in the cache */
+		pack->refs++;
+		region_add_cleanup(query->region, ixfr_pack_release, pack);
+		query->ixfr_pack_rec = pack;
+		return;
+	}
+	ixfr_pack_unlink(pack);
+	ixfr_pack_link(pack);
+	pack->use = ++ixfr_pack_clock;
+	if(pack->too_large)
+		return;
+	/* the stream is kept while the query sends from it */
+	pack->refs++;
+	region_add_cleanup(query->region, ixfr_pack_release, pack);
+	query->ixfr_pack = pack;
+	query->ixfr_pack_num = 0;
+}
+
+/* put the recorded stream of the query in the cache, unless another
+ * query has put one there already or the ixfr data has changed */
+static void ixfr_pack_publish(struct query* query, struct ixfr_pack* pack,
+	size_t cache_max)
+{
+	struct zone_ixfr* ixfr = query->zone->ixfr;
+	query->ixfr_pack_rec = NULL;
+	if(!ixfr || ixfr_pack_find(ixfr, pack->data, pack->space,
+		pack->qname, pack->qname_len) ||
+		!ixfr_pack_data_current(ixfr, pack->data))
+		return;
+	ixfr_pack_insert(ixfr, pack, cache_max);
+	pack->use = ++ixfr_pack_clock;
+}
+
+/* Record the packet that the query has made from start in the packet
+ * with the added number of RRs. When the query is done, the stream is
+ * put in the cache. If it gets larger than the streams of a zone or the
+ * process can take, the recording stops, and an entry without packets
+ * that is marked too_large is put in the cache. */
+static void ixfr_pack_record(struct query* query, size_t start,
+	uint16_t added, size_t cache_max)
+{
+	struct ixfr_pack* pack = query->ixfr_pack_rec;
+	size_t len = buffer_position(query->packet) - start;
+	size_t max = (cache_max < IXFR_PACK_SIZE_MAX?cache_max:
+		IXFR_PACK_SIZE_MAX);
+	if(added == 0 && !query->ixfr_is_done) {
+		/* no progress, the cleanup frees it */
+		query->ixfr_pack_rec = NULL;
+		return;
+	}
+	if(pack->offsets[pack->num] + len > max) {
+		/* too large to keep, keep a note of that */
+		free(pack->offsets);
+		free(pack->ancount);
+		free(pack->bytes);
+		pack->offsets = NULL;
+		pack->ancount = NULL;
+		pack->bytes = NULL;
+		pack->num = 0;
+		pack->too_large = 1;
+		ixfr_pack_publish(query, pack, cache_max);
+		return;
+	}
+	if(pack->num == pack->num_max) {
+		pack->num_max *= 2;
+		pack->offsets = xrealloc(pack->offsets,
+			(pack->num_max+1)*sizeof(size_t));
+		pack->ancount = xrealloc(pack->ancount,
+			pack->num_max*sizeof(uint16_t));
+	}
+	while(pack->offsets[pack->num] + len > pack->bytes_max) {
+		pack->bytes_max *= 2;
+		pack->bytes = xrealloc(pack->bytes, pack->bytes_max);
+	}
+	memcpy(pack->bytes + pack->offsets[pack->num],
+		buffer_at(query->packet, start), len);
+	pack->ancount[pack->num] = added;
+	pack->offsets[pack->num+1] = pack->offsets[pack->num] + len;
+	pack->num++;
+	if(query->ixfr_is_done) {
+		pack->size = pack->offsets[pack->num];
+		ixfr_pack_publish(query, pack, cache_max);
+	}
+}
+
+/* Copy the next packet from the packed reply stream into the packet,
+ * return number of RRs added */
+static uint16_t ixfr_pack_copy_packet(struct query* query)
+{
+	struct ixfr_pack* pack = query->ixfr_pack;
+	size_t i = query->ixfr_pack_num++;
+	buffer_write(query->packet, pack->bytes + pack->offsets[i],
+		pack->offsets[i+1] - pack->offsets[i]);
+	if(query->ixfr_pack_num >= pack->num) {
+		/* we finished the IXFR */
+		/* sign the last packet */
+		query->tsig_sign_it = 1;
+		query->ixfr_is_done = 1;
+	}
+	return pack->ancount[i];
+}
+
 query_state_type query_ixfr(struct nsd *nsd, struct query *query)
 {
 	uint16_t total_added = 0;
@@ -820,6 +1565,17 @@ query_state_type query_ixfr(struct nsd *nsd, struct query *query)
 		query->ixfr_is_done = 0;
 		/* set up to copy the last version's SOA as first SOA */
 		query->ixfr_end_data = ixfr_data_last(zone->ixfr);
+		if(zone->opts && zone->opts->pattern->condense_ixfr &&
+			ixfr_data != query->ixfr_end_data) {
+			/* send one change from the serial to the current */
+			struct ixfr_data* condensed = ixfr_condensed_find(
+				zone->ixfr, query, ixfr_data,
+				query->ixfr_end_data);
+			if(condensed) {
+				query->ixfr_data = condensed;
+				query->ixfr_end_data = condensed;
+			}
+		}
 		query->ixfr_count_newsoa = 0;
 		query->ixfr_count_oldsoa = 0;
 		query->ixfr_count_del = 0;
@@ -829,6 +1585,9 @@ query_state_type query_ixfr(struct nsd *nsd, struct query *query)
 		pktcompression_insert_with_labels(&pcomp,
 			buffer_at(query->packet, QHEADERSZ),
 			query->qname->name_size, QHEADERSZ);
+		/* use the packed replies that earlier queries made */
+		ixfr_pack_use(zone->ixfr, query,
+			nsd->options->ixfr_pack_cache_size);
 		if(query->tsig.status == TSIG_OK) {
 			query->tsig_sign_it = 1; /* sign first packet in stream */
 		}
@@ -842,29 +1601,14 @@ query_state_type query_ixfr(struct nsd *nsd, struct query *query)
 		query_prepare_response(query);
 	}
 
-	total_added = ixfr_copy_rrs_into_packet(query, &pcomp);
-
-	while(query->ixfr_count_add >= query->ixfr_data->add_len) {
-		struct ixfr_data* next = ixfr_data_next(query->zone->ixfr,
-			query->ixfr_data);
-		/* finished the ixfr_data */
-		if(next) {
-			/* move to the next IXFR */
-			query->ixfr_data = next;
-			/* we need to skip the SOA records, set len to done*/
-			/* the newsoa count is already done, at end_data len */
-			query->ixfr_count_oldsoa = next->oldsoa_len;
-			/* and then set up to copy the del and add sections */
-			query->ixfr_count_del = 0;
-			query->ixfr_count_add = 0;
-			total_added += ixfr_copy_rrs_into_packet(query, &pcomp);
-		} else {
-			/* we finished the IXFR */
-			/* sign the last packet */
-			query->tsig_sign_it = 1;
-			query->ixfr_is_done = 1;
-			break;
-		}
+	if(query->ixfr_pack) {
+		total_added = ixfr_pack_copy_packet(query);
+	} else {
+		size_t start = buffer_position(query->packet);
+		total_added = ixfr_copy_packet(query, &pcomp);
+		if(query->ixfr_pack_rec)
+			ixfr_pack_record(query, start, total_added,
+				nsd->options->ixfr_pack_cache_size);
 	}
 
 	/* return the answer */
@@ -1483,6 +2227,7 @@ static void zone_ixfr_clear(struct zone_ixfr* ixfr)
 	ixfr->total_size = 0;
 	ixfr->oldest_serial = 0;
 	ixfr->newest_serial = 0;
+	zone_ixfr_cache_clear(ixfr);
 }
 
 void zone_ixfr_free(struct zone_ixfr* ixfr)
@@ -1493,6 +2238,7 @@ void zone_ixfr_free(struct zone_ixfr* ixfr)
 		ixfr_tree_del(ixfr->data->root);
 		ixfr->data = NULL;
 	}
+	zone_ixfr_cache_clear(ixfr);
 	free(ixfr);
 }
 
@@ -1571,6 +2317,7 @@ void zone_ixfr_remove(struct zone_ixfr* ixfr, struct ixfr_data* data)
 	rbtree_delete(ixfr->data, data->node.key);
 	ixfr->total_size -= ixfr_data_size(data);
 	ixfr_data_free(data);
+	zone_ixfr_cache_clear(ixfr);
 }
 
 void zone_ixfr_add(struct zone_ixfr* ixfr, struct ixfr_data* data, int isnew)
@@ -1589,6 +2336,7 @@ void zone_ixfr_add(struct zone_ixfr* ixfr, struct ixfr_data* data, int isnew)
 	data->node.key = &data->oldserial;
 	rbtree_insert(ixfr->data, &data->node);
 	ixfr->total_size += ixfr_data_size(data);
+	zone_ixfr_cache_clear(ixfr);
 }
 
 struct ixfr_data* zone_ixfr_find_serial(struct zone_ixfr* ixfr,
@@ -1624,6 +2372,31 @@ static int ixfr_target_number_files(struct zone* zone)
 	return dest_num_files;
 }
 
+/*
+ * The binary IXFR data file has the magic string and a version number,
+ * then the serials, the data size, the zone name and the log string,
+ * and the lengths of the newsoa, oldsoa, del and add sections. After
+ * that the sections follow in uncompressed wireformat, like they are
+ * stored in memory. The file ends with a checksum of the bytes before it.
+ * The numbers are 32bit in network byte order.
+ */
+#define IXFR_BINARY_MAGIC "NSDIXFRB"
+#define IXFR_BINARY_MAGIC_LEN 8
+#define IXFR_BINARY_VERSION 1
+/* magic, version, oldserial, newserial, data_size, zone name length */
+#define IXFR_BINARY_HEADER_LEN (IXFR_BINARY_MAGIC_LEN+5*sizeof(uint32_t))
+
+/* see if the open ixfr file is in binary format, the file is positioned
+ * at the start afterwards */
+static int ixfr_file_is_binary(FILE* in)
+{
+	char magic[IXFR_BINARY_MAGIC_LEN];
+	int r = (fread(magic, sizeof(magic), 1, in) == 1 &&
+		memcmp(magic, IXFR_BINARY_MAGIC, IXFR_BINARY_MAGIC_LEN) == 0);
+	rewind(in);
+	return r;
+}
+
 /* create ixfrfile name in buffer for file_num. The num is 1 .. number. */
 static void make_ixfr_name(char* buf, size_t len, const char* zfile,
 	int file_num)
@@ -1701,6 +2474,44 @@ static int ixfr_unlink_it_temp(const char* zname, const char* zfile,
 	return ixfr_unlink_it_ctmp(zname, zfile, file_num, silent_enoent, 1);
 }
 
+/* read the header of a binary ixfr file */
+static int ixfr_read_file_header_binary(const char* zname, FILE* in,
+	const char* ixfrfile, uint32_t* oldserial, uint32_t* newserial,
+	size_t* data_size)
+{
+	uint8_t buf[IXFR_BINARY_HEADER_LEN];
+	char name[1024];
+	uint32_t name_len;
+	if(fread(buf, sizeof(buf), 1, in) != 1) {
+		log_msg(LOG_ERR, "could not read %s: %s", ixfrfile,
+			strerror(errno));
+		return 0;
+	}
+	if(read_uint32(buf+IXFR_BINARY_MAGIC_LEN) != IXFR_BINARY_VERSION) {
+		log_msg(LOG_ERR, "unsupported binary IXFR file version in %s",
+			ixfrfile);
+		return 0;
+	}
+	name_len = read_uint32(buf+IXFR_BINARY_MAGIC_LEN+4*sizeof(uint32_t));
+	if(name_len >= sizeof(name) ||
+		fread(name, name_len, 1, in) != 1) {
+		log_msg(LOG_ERR, "could not read %s: malformed header",
+			ixfrfile);
+		return 0;
+	}
+	name[name_len] = 0;
+	if(strcmp(name, zname) != 0) {
+		log_msg(LOG_ERR, "file has wrong zone, expected zone %s, but found %s in file %s",
+			zname, name, ixfrfile);
+		return 0;
+	}
+	*oldserial = read_uint32(buf+IXFR_BINARY_MAGIC_LEN+sizeof(uint32_t));
+	*newserial = read_uint32(buf+IXFR_BINARY_MAGIC_LEN+2*sizeof(uint32_t));
+	*data_size = (size_t)read_uint32(buf+IXFR_BINARY_MAGIC_LEN+
+		3*sizeof(uint32_t));
+	return 1;
+}
+
 /* read ixfr file header */
 int ixfr_read_file_header(const char* zname, const char* zfile,
 	int file_num, uint32_t* oldserial, uint32_t* newserial,
@@ -1718,6 +2529,12 @@ int ixfr_read_file_header(const char* zname, const char* zfile,
 				strerror(errno));
 		return 0;
 	}
+	if(ixfr_file_is_binary(in)) {
+		int r = ixfr_read_file_header_binary(zname, in, ixfrfile,
+			oldserial, newserial, data_size);
+		fclose(in);
+		return r;
+	}
 	/* read about 10 lines, this is where the header is */
 	while(!(got_old && got_new && got_datasize) && num_lines < 10) {
 		buf[0]=0;
@@ -2098,6 +2915,61 @@ static int ixfr_write_file_data(struct zone* zone, struct ixfr_data* data,
 	return 1;
 }
 
+/* put number in binary ixfr data, returns position after it */
+static uint8_t* ixfr_binary_put32(uint8_t* p, uint32_t v)
+{
+	write_uint32(p, v);
+	return p+sizeof(uint32_t);
+}
+
+/* put bytes in binary ixfr data, returns position after it */
+static uint8_t* ixfr_binary_putdata(uint8_t* p, const void* data, size_t len)
+{
+	if(len != 0)
+		memmove(p, data, len);
+	return p+len;
+}
+
+/* write the ixfr data file in binary format */
+static int ixfr_write_file_binary(struct zone* zone, struct ixfr_data* data,
+	FILE* out)
+{
+	size_t zname_len = strlen(zone->opts->name);
+	size_t log_len = (data->log_str?strlen(data->log_str):0);
+	size_t total = IXFR_BINARY_HEADER_LEN + zname_len
+		+ sizeof(uint32_t) + log_len + 4*sizeof(uint32_t)
+		+ data->newsoa_len + data->oldsoa_len + data->del_len
+		+ data->add_len + sizeof(uint32_t);
+	uint8_t* buf, *p;
+	int r;
+
+	/* the file is made in memory, to compute the checksum, and
+	 * written at once */
+	buf = xalloc(total);
+	p = ixfr_binary_putdata(buf, IXFR_BINARY_MAGIC, IXFR_BINARY_MAGIC_LEN);
+	p = ixfr_binary_put32(p, IXFR_BINARY_VERSION);
+	p = ixfr_binary_put32(p, data->oldserial);
+	p = ixfr_binary_put32(p, data->newserial);
+	p = ixfr_binary_put32(p, (uint32_t)ixfr_data_size(data));
+	p = ixfr_binary_put32(p, (uint32_t)zname_len);
+	p = ixfr_binary_putdata(p, zone->opts->name, zname_len);
+	p = ixfr_binary_put32(p, (uint32_t)log_len);
+	p = ixfr_binary_putdata(p, data->log_str, log_len);
+	p = ixfr_binary_put32(p, (uint32_t)data->newsoa_len);
+	p = ixfr_binary_put32(p, (uint32_t)data->oldsoa_len);
+	p = ixfr_binary_put32(p, (uint32_t)data->del_len);
+	p = ixfr_binary_put32(p, (uint32_t)data->add_len);
+	p = ixfr_binary_putdata(p, data->newsoa, data->newsoa_len);
+	p = ixfr_binary_putdata(p, data->oldsoa, data->oldsoa_len);
+	p = ixfr_binary_putdata(p, data->del, data->del_len);
+	p = ixfr_binary_putdata(p, data->add, data->add_len);
+	(void)ixfr_binary_put32(p, hashlittle(buf, (size_t)(p-buf), 0));
+
+	r = (fwrite(buf, total, 1, out) == 1 && fflush(out) == 0);
+	free(buf);
+	return r;
+}
+
 int ixfr_write_file(struct zone* zone, struct ixfr_data* data,
 	const char* zfile, int file_num)
 {
@@ -2113,6 +2985,18 @@ int ixfr_write_file(struct zone* zone, struct ixfr_data* data,
 		return 0;
 	}
 
+	if(zone->opts->pattern->binary_ixfr) {
+		if(!ixfr_write_file_binary(zone, data, out)) {
+			log_msg(LOG_ERR, "could not write zone %s IXFR file %s: %s",
+				zone->opts->name, ixfrfile, strerror(errno));
+			fclose(out);
+			return 0;
+		}
+		fclose(out);
+		data->file_num = file_num;
+		return 1;
+	}
+
 	if(!ixfr_write_file_header(zone, data, out)) {
 		log_msg(LOG_ERR, "could not write file header for zone %s IXFR file %s: %s",
 			zone->opts->name, ixfrfile, strerror(errno));
@@ -2520,6 +3404,39 @@ static int ixfr_data_readadd(struct ixfr_data* data, struct zone* zone,
 	return 1;
 }
 
+/* see if the zone already has the configured number of ixfr data items */
+static int ixfr_data_read_full(struct zone* zone, const char* ixfrfile)
+{
+	if(zone->ixfr &&
+		zone->ixfr->data->count == zone->opts->pattern->ixfr_number) {
+		VERBOSITY(3, (LOG_INFO, "zone %s skip %s IXFR data because only %d ixfr-number configured",
+			zone->opts->name, ixfrfile, (int)zone->opts->pattern->ixfr_number));
+		return 1;
+	}
+	return 0;
+}
+
+/* store ixfr data that is read from file in the zone, if it fits in the
+ * configured size. It is freed if not. */
+static int ixfr_data_read_store(struct nsd* nsd, struct zone* zone,
+	struct ixfr_data* data, const char* ixfrfile)
+{
+	if(!zone->ixfr)
+		zone->ixfr = zone_ixfr_create(nsd);
+	if(zone->opts->pattern->ixfr_size != 0 &&
+		zone->ixfr->total_size + ixfr_data_size(data) >
+		zone->opts->pattern->ixfr_size) {
+		VERBOSITY(3, (LOG_INFO, "zone %s skip %s IXFR data because only ixfr-size: %u configured, and it is %u size",
+			zone->opts->name, ixfrfile, (unsigned)zone->opts->pattern->ixfr_size, (unsigned)ixfr_data_size(data)));
+		ixfr_data_free(data);
+		return 0;
+	}
+	zone_ixfr_add(zone->ixfr, data, 0);
+	VERBOSITY(3, (LOG_INFO, "zone %s read %s IXFR data of %u bytes",
+		zone->opts->name, ixfrfile, (unsigned)ixfr_data_size(data)));
+	return 1;
+}
+
 /* read ixfr data from file */
 static int ixfr_data_read(struct nsd* nsd, struct zone* zone, FILE* in,
 	const char* ixfrfile, uint32_t* dest_serial, int file_num)
@@ -2529,12 +3446,8 @@ static int ixfr_data_read(struct nsd* nsd, struct zone* zone, FILE* in,
 	struct domain_table* temptable;
 	struct zone* tempzone;
 
-	if(zone->ixfr &&
-		zone->ixfr->data->count == zone->opts->pattern->ixfr_number) {
-		VERBOSITY(3, (LOG_INFO, "zone %s skip %s IXFR data because only %d ixfr-number configured",
-			zone->opts->name, ixfrfile, (int)zone->opts->pattern->ixfr_number));
+	if(ixfr_data_read_full(zone, ixfrfile))
 		return 0;
-	}
 
 	/* the file has header comments, new soa, old soa, delsection,
 	 * addsection. The delsection and addsection end in a SOA of oldver
@@ -2594,22 +3507,289 @@ static int ixfr_data_read(struct nsd* nsd, struct zone* zone, FILE* in,
 	region_destroy(tempregion);
 	region_destroy(stayregion);
 
-	if(!zone->ixfr)
-		zone->ixfr = zone_ixfr_create(nsd);
-	if(zone->opts->pattern->ixfr_size != 0 &&
-		zone->ixfr->total_size + ixfr_data_size(data) >
-		zone->opts->pattern->ixfr_size) {
-		VERBOSITY(3, (LOG_INFO, "zone %s skip %s IXFR data because only ixfr-size: %u configured, and it is %u size",
-			zone->opts->name, ixfrfile, (unsigned)zone->opts->pattern->ixfr_size, (unsigned)ixfr_data_size(data)));
-		ixfr_data_free(data);
+	return ixfr_data_read_store(nsd, zone, data, ixfrfile);
+}
+
+/* map the ixfr file into memory */
+static uint8_t* ixfr_map_file(FILE* in, const char* ixfrfile, size_t* size)
+{
+	struct stat st;
+	uint8_t* buf;
+	if(fstat(fileno(in), &st) != 0) {
+		log_msg(LOG_ERR, "could not stat %s: %s", ixfrfile,
+			strerror(errno));
+		return NULL;
+	}
+	*size = (size_t)st.st_size;
+	if(*size == 0) {
+		log_msg(LOG_ERR, "IXFR file %s is empty", ixfrfile);
+		return NULL;
+	}
+#ifdef HAVE_MMAP
+	buf = (uint8_t*)mmap(NULL, *size, PROT_READ, MAP_PRIVATE,
+		fileno(in), 0);
+	if(buf == MAP_FAILED) {
+		log_msg(LOG_ERR, "could not mmap %s: %s", ixfrfile,
+			strerror(errno));
+		return NULL;
+	}
+#else
+	buf = (uint8_t*)xalloc(*size);
+	if(fread(buf, *size, 1, in) != 1) {
+		log_msg(LOG_ERR, "could not read %s: %s", ixfrfile,
+			strerror(errno));
+		free(buf);
+		return NULL;
+	}
+#endif /* HAVE_MMAP */
+	return buf;
+}
+
+/* unmap the ixfr file from memory */
+static void ixfr_unmap_file(uint8_t* buf, size_t size)
+{
+#ifdef HAVE_MMAP
+	if(munmap(buf, size) != 0)
+		log_msg(LOG_ERR, "could not munmap IXFR file: %s",
+			strerror(errno));
+#else
+	(void)size;
+	free(buf);
+#endif
+}
+
+/* get number from binary ixfr data */
+static int ixfr_binary_get32(const uint8_t* buf, size_t len, size_t* pos,
+	uint32_t* v)
+{
+	if(*pos + sizeof(uint32_t) > len)
+		return 0;
+	*v = read_uint32(buf + *pos);
+	*pos += sizeof(uint32_t);
+	return 1;
+}
+
+/* get section from binary ixfr data, it is copied into allocated space */
+static int ixfr_binary_getdata(const uint8_t* buf, size_t len, size_t* pos,
+	uint32_t datalen, uint8_t** dest, size_t* dest_len)
+{
+	if((size_t)datalen > len - *pos)
 		return 0;
+	*dest_len = datalen;
+	if(datalen == 0)
+		return 1;
+	*dest = xalloc(datalen);
+	memmove(*dest, buf + *pos, datalen);
+	*pos += datalen;
+	return 1;
+}
+
+/* see if the owner name of the RR in wireformat is the zone apex */
+static int ixfr_binary_owner_is_apex(struct zone* zone, const uint8_t* rr,
+	size_t rrlen)
+{
+	const dname_type* apex = domain_dname(zone->apex);
+	const uint8_t* name = dname_name(apex);
+	size_t i, len = dname_length(rr, rrlen);
+	if(len == 0 || len != apex->name_size)
+		return 0;
+	/* label lengths are below 'A', this compares labels without case */
+	for(i=0; i<len; i++) {
+		if(tolower((unsigned char)rr[i]) != tolower(name[i]))
+			return 0;
 	}
-	zone_ixfr_add(zone->ixfr, data, 0);
-	VERBOSITY(3, (LOG_INFO, "zone %s read %s IXFR data of %u bytes",
-		zone->opts->name, ixfrfile, (unsigned)ixfr_data_size(data)));
 	return 1;
 }
 
+/* check that the section is a list of RRs. Returns the last RR, and
+ * its length, or NULL if malformed */
+static const uint8_t* ixfr_binary_check_section(const uint8_t* data,
+	size_t len, size_t* last_len)
+{
+	size_t pos = 0, rrlen;
+	const uint8_t* last = NULL;
+	while(pos < len) {
+		if((rrlen = count_rr_length(data, len, pos)) == 0)
+			return NULL;
+		last = data+pos;
+		*last_len = rrlen;
+		pos += rrlen;
+	}
+	return last;
+}
+
+/* get the serial of the SOA RR in wireformat, false if it is not
+ * a SOA RR of class IN */
+static int ixfr_binary_soa_serial(const uint8_t* rr, size_t rrlen,
+	uint32_t* serial)
+{
+	size_t dlen = dname_length(rr, rrlen), mlen, rlen, rdlen;
+	const uint8_t* rdata;
+	if(dlen == 0 || dlen+10 > rrlen)
+		return 0;
+	if(read_uint16(rr+dlen) != TYPE_SOA ||
+		read_uint16(rr+dlen+2) != CLASS_IN)
+		return 0;
+	rdlen = read_uint16(rr+dlen+8);
+	rdata = rr+dlen+10;
+	if((mlen = dname_length(rdata, rdlen)) == 0)
+		return 0;
+	if((rlen = dname_length(rdata+mlen, rdlen-mlen)) == 0)
+		return 0;
+	if(mlen+rlen+sizeof(uint32_t) > rdlen)
+		return 0;
+	*serial = read_uint32(rdata+mlen+rlen);
+	return 1;
+}
+
+/* check the binary ixfr sections, the SOA records at the start and the
+ * SOA records that end the del and add sections */
+static int ixfr_binary_check_data(struct zone* zone, struct ixfr_data* data,
+	const char* ixfrfile, uint32_t dest_serial)
+{
+	const uint8_t* rr;
+	size_t rrlen = 0;
+	uint32_t serial;
+	if(count_rr_length(data->newsoa, data->newsoa_len, 0) !=
+		data->newsoa_len || !ixfr_binary_soa_serial(data->newsoa,
+		data->newsoa_len, &serial) || !ixfr_binary_owner_is_apex(zone,
+		data->newsoa, data->newsoa_len)) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: IXFR data does not start with SOA of the zone",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	if(serial != data->newserial || serial != dest_serial) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: IXFR data contains the wrong version, serial %u but want destination serial %u",
+			zone->opts->name, ixfrfile, serial, dest_serial);
+		return 0;
+	}
+	if(count_rr_length(data->oldsoa, data->oldsoa_len, 0) !=
+		data->oldsoa_len || !ixfr_binary_soa_serial(data->oldsoa,
+		data->oldsoa_len, &serial) || !ixfr_binary_owner_is_apex(zone,
+		data->oldsoa, data->oldsoa_len) || serial != data->oldserial) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: IXFR data wrong 2nd SOA",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	if(!(rr = ixfr_binary_check_section(data->del, data->del_len, &rrlen))
+		|| !ixfr_binary_soa_serial(rr, rrlen, &serial) ||
+		serial != data->newserial) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: IXFR data malformed del section",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	if(!(rr = ixfr_binary_check_section(data->add, data->add_len, &rrlen))
+		|| !ixfr_binary_soa_serial(rr, rrlen, &serial) ||
+		serial != data->newserial) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: IXFR data malformed add section",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	return 1;
+}
+
+/* parse the binary ixfr file contents into the ixfr data */
+static int ixfr_binary_parse(struct zone* zone, struct ixfr_data* data,
+	const uint8_t* buf, size_t len, const char* ixfrfile,
+	uint32_t dest_serial)
+{
+	size_t pos = IXFR_BINARY_MAGIC_LEN, zname_len = strlen(zone->opts->name);
+	uint32_t version, data_size, name_len, log_len, newsoa_len,
+		oldsoa_len, del_len, add_len;
+	if(len < IXFR_BINARY_HEADER_LEN + sizeof(uint32_t) ||
+		memcmp(buf, IXFR_BINARY_MAGIC, IXFR_BINARY_MAGIC_LEN) != 0) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: not a binary IXFR file",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	/* the checksum is at the end, and covers the bytes before it */
+	len -= sizeof(uint32_t);
+	if(read_uint32(buf+len) != hashlittle(buf, len, 0)) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: checksum failure",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	if(!ixfr_binary_get32(buf, len, &pos, &version) ||
+		version != IXFR_BINARY_VERSION) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: unsupported binary IXFR file version",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	if(!ixfr_binary_get32(buf, len, &pos, &data->oldserial) ||
+		!ixfr_binary_get32(buf, len, &pos, &data->newserial) ||
+		!ixfr_binary_get32(buf, len, &pos, &data_size) ||
+		!ixfr_binary_get32(buf, len, &pos, &name_len) ||
+		(size_t)name_len > len - pos) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: malformed header",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	if((size_t)name_len != zname_len ||
+		memcmp(buf+pos, zone->opts->name, zname_len) != 0) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: file has wrong zone",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	pos += name_len;
+	if(!ixfr_binary_get32(buf, len, &pos, &log_len) ||
+		(size_t)log_len > len - pos) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: malformed header",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	if(log_len != 0) {
+		data->log_str = xalloc((size_t)log_len+1);
+		memmove(data->log_str, buf+pos, log_len);
+		data->log_str[log_len] = 0;
+		pos += log_len;
+	}
+	if(!ixfr_binary_get32(buf, len, &pos, &newsoa_len) ||
+		!ixfr_binary_get32(buf, len, &pos, &oldsoa_len) ||
+		!ixfr_binary_get32(buf, len, &pos, &del_len) ||
+		!ixfr_binary_get32(buf, len, &pos, &add_len) ||
+		!ixfr_binary_getdata(buf, len, &pos, newsoa_len,
+			&data->newsoa, &data->newsoa_len) ||
+		!ixfr_binary_getdata(buf, len, &pos, oldsoa_len,
+			&data->oldsoa, &data->oldsoa_len) ||
+		!ixfr_binary_getdata(buf, len, &pos, del_len,
+			&data->del, &data->del_len) ||
+		!ixfr_binary_getdata(buf, len, &pos, add_len,
+			&data->add, &data->add_len) ||
+		pos != len) {
+		log_msg(LOG_ERR, "zone %s ixfr data %s: malformed sections",
+			zone->opts->name, ixfrfile);
+		return 0;
+	}
+	return ixfr_binary_check_data(zone, data, ixfrfile, dest_serial);
+}
+
+/* read ixfr data from binary file. The sections are copied from the
+ * file as they are, without parsing the RRs as zonefile text. */
+static int ixfr_data_read_binary(struct nsd* nsd, struct zone* zone,
+	FILE* in, const char* ixfrfile, uint32_t* dest_serial, int file_num)
+{
+	struct ixfr_data* data;
+	uint8_t* buf;
+	size_t len = 0;
+
+	if(ixfr_data_read_full(zone, ixfrfile))
+		return 0;
+	if(!zone->apex)
+		return 0;
+	if(!(buf = ixfr_map_file(in, ixfrfile, &len)))
+		return 0;
+	data = xalloc_zero(sizeof(*data));
+	data->file_num = file_num;
+	if(!ixfr_binary_parse(zone, data, buf, len, ixfrfile, *dest_serial)) {
+		ixfr_data_free(data);
+		ixfr_unmap_file(buf, len);
+		return 0;
+	}
+	ixfr_unmap_file(buf, len);
+	*dest_serial = data->oldserial;
+	return ixfr_data_read_store(nsd, zone, data, ixfrfile);
+}
+
 /* try to read the next ixfr file. returns false if it fails or if it
  * does not fit in the configured sizes */
 static int ixfr_read_one_more_file(struct nsd* nsd, struct zone* zone,
@@ -2631,7 +3811,14 @@ static int ixfr_read_one_more_file(struct nsd* nsd, struct zone* zone,
 		return 0;
 	}
 	warn_if_directory("IXFR data", in, ixfrfile);
-	if(!ixfr_data_read(nsd, zone, in, ixfrfile, dest_serial, file_num)) {
+	if(ixfr_file_is_binary(in)) {
+		if(!ixfr_data_read_binary(nsd, zone, in, ixfrfile,
+			dest_serial, file_num)) {
+			fclose(in);
+			return 0;
+		}
+	} else if(!ixfr_data_read(nsd, zone, in, ixfrfile, dest_serial,
+		file_num)) {
 		fclose(in);
 		return 0;
 	}
@@ -13,6 +13,8 @@ struct nsd;
 #include "query.h"
 #include "rbtree.h"
 struct ixfr_data;
+struct ixfr_pack;
+struct ixfr_condensed;
 struct zone;
 struct buffer;
 struct region;
@@ -21,6 +23,15 @@ struct region;
 #define IXFR_NUMBER_DEFAULT 5 /* number of versions */
 /* default for IXFR storage */
 #define IXFR_SIZE_DEFAULT 1048576 /* in bytes, 1M */
+/* number of packed IXFR reply streams that are kept per zone */
+#define IXFR_PACK_NUMBER 4
+/* maximum size of the packed IXFR reply streams of a zone, in bytes */
+#define IXFR_PACK_SIZE_MAX (4*1048576)
+/* default for the size of the packed IXFR reply streams of a server
+ * process, in bytes */
+#define IXFR_PACK_CACHE_SIZE_DEFAULT (16*1048576)
+/* number of condensed IXFR changes that are kept per zone */
+#define IXFR_CONDENSE_NUMBER 4
 
 /* data structure that stores IXFR contents for a zone. */
 struct zone_ixfr {
@@ -38,6 +49,18 @@ struct zone_ixfr {
 	 * tree, so it is the old_serial of the newest data entry, that
 	 * has an even newer new_serial of that entry */
 	uint32_t newest_serial;
+	/* the packed reply streams for IXFR queries, built by the server
+	 * process on the first query and reused for the next queries for
+	 * the same serial. The least recently used is replaced, and they
+	 * are dropped when the ixfr data changes. */
+	struct ixfr_pack* pack[IXFR_PACK_NUMBER];
+	/* total size of the packed reply streams, in bytes */
+	size_t pack_size;
+	/* the condensed changes from an older serial to the newest serial,
+	 * made by the server process when condense-ixfr is enabled.
+	 * The least recently used is replaced, and they are dropped when
+	 * the ixfr data changes. */
+	struct ixfr_condensed* condensed[IXFR_CONDENSE_NUMBER];
 };
 
 /* Data structure that stores one IXFR.
@@ -229,6 +252,14 @@ void zone_ixfr_add(struct zone_ixfr* ixfr, struct ixfr_data* data, int isnew);
 struct ixfr_data* zone_ixfr_find_serial(struct zone_ixfr* ixfr,
 	uint32_t qserial);
 
+/* make one change from the connected ixfr data first to last, the RRs
+ * that are added and deleted again cancel out. NULL on alloc failure */
+struct ixfr_data* ixfr_condensed_create(struct zone_ixfr* ixfr,
+	struct ixfr_data* first, struct ixfr_data* last);
+
+/* free the change made by ixfr_condensed_create */
+void ixfr_condensed_free(struct ixfr_data* data);
+
 /* size of the ixfr data */
 size_t ixfr_data_size(struct ixfr_data* data);
 
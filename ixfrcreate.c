@@ -16,6 +16,19 @@
 #include "ixfr.h"
 #include "options.h"
 
+/* the rrsets with more RRs than this are matched with a hash table */
+#define RDATA_HASH_MIN_RRS 16
+
+/* hash table with the RRs of an rrset, to find spooled rdata in it */
+struct rdata_hash {
+	/* the rrset with the RRs */
+	struct rrset* rrset;
+	/* number of slots, a power of two */
+	size_t size;
+	/* the slots, with the RR index plus one, 0 is an empty slot */
+	uint32_t* slots;
+};
+
 /* spool a uint16_t to file */
 static int spool_u16(FILE* out, uint16_t val)
 {
@@ -168,6 +181,8 @@ static int spool_zone_to_file(struct zone* zone, char* file_name,
 			file_name, strerror(errno));
 		return 0;
 	}
+	/* the spool is written in many small pieces */
+	(void)setvbuf(out, NULL, _IOFBF, IXFR_CREATE_SPOOL_BUFSIZE);
 	if(!spool_dname(out, domain_dname(zone->apex))) {
 		log_msg(LOG_ERR, "could not write %s: %s",
 			file_name, strerror(errno));
@@ -382,6 +397,81 @@ static int rrset_find_rdata(struct rrset* rrset, uint32_t ttl, uint8_t* rdata,
 	return 0;
 }
 
+/* hash bytes into the running hash value, FNV-1a */
+static uint32_t rdata_hash_bytes(uint32_t h, const uint8_t* p, size_t len)
+{
+	size_t i;
+	for(i=0; i<len; i++) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* hash of the ttl and the uncompressed rdata of an rr, the same value as
+ * spool_rdata_hash for the spooled rdata of that rr */
+static uint32_t rr_rdata_hash(struct rr* rr)
+{
+	uint32_t h = rdata_hash_bytes(2166136261u, (uint8_t*)&rr->ttl,
+		sizeof(rr->ttl));
+	int i;
+	for(i=0; i<rr->rdata_count; i++) {
+		if(rdata_atom_is_domain(rr->type, i)) {
+			h = rdata_hash_bytes(h, dname_name(domain_dname(
+				rr->rdatas[i].domain)), domain_dname(
+				rr->rdatas[i].domain)->name_size);
+		} else {
+			h = rdata_hash_bytes(h, (uint8_t*)&rr->rdatas[i].data[1],
+				rr->rdatas[i].data[0]);
+		}
+	}
+	return h;
+}
+
+/* hash of the ttl and rdata read from the spool */
+static uint32_t spool_rdata_hash(uint32_t ttl, uint8_t* rdata, uint16_t rdlen)
+{
+	uint32_t h = rdata_hash_bytes(2166136261u, (uint8_t*)&ttl,
+		sizeof(ttl));
+	return rdata_hash_bytes(h, rdata, rdlen);
+}
+
+/* setup the hash table for the RRs of the rrset, false on alloc failure */
+static int rdata_hash_init(struct rdata_hash* hash, struct rrset* rrset)
+{
+	int i;
+	hash->rrset = rrset;
+	hash->size = 1;
+	while(hash->size < (size_t)rrset->rr_count*2)
+		hash->size <<= 1;
+	hash->slots = (uint32_t*)calloc(hash->size, sizeof(uint32_t));
+	if(!hash->slots)
+		return 0;
+	for(i=0; i<rrset->rr_count; i++) {
+		size_t slot = rr_rdata_hash(&rrset->rrs[i]) & (hash->size-1);
+		while(hash->slots[slot] != 0)
+			slot = (slot+1) & (hash->size-1);
+		hash->slots[slot] = i+1;
+	}
+	return 1;
+}
+
+/* find an rdata in the rrset with the hash table, true if found */
+static int rdata_hash_find(struct rdata_hash* hash, uint32_t ttl,
+	uint8_t* rdata, uint16_t rdlen, uint16_t* index)
+{
+	size_t slot = spool_rdata_hash(ttl, rdata, rdlen) & (hash->size-1);
+	while(hash->slots[slot] != 0) {
+		struct rr* rr = &hash->rrset->rrs[hash->slots[slot]-1];
+		if(rr->ttl == ttl && rdata_match(rr, rdata, rdlen)) {
+			*index = hash->slots[slot]-1;
+			return 1;
+		}
+		slot = (slot+1) & (hash->size-1);
+	}
+	return 0;
+}
+
 /* sort comparison for uint16 elements */
 static int sort_uint16(const void* x, const void* y)
 {
@@ -403,14 +493,22 @@ static int process_diff_rrset(FILE* spool, struct ixfr_create* ixfrcr,
 	uint8_t buf[MAX_RDLENGTH];
 	uint16_t marked[65536];
 	size_t marked_num = 0, atmarked;
-	int i;
+	struct rdata_hash hash;
+	int i, use_hash = 0;
+	memset(&hash, 0, sizeof(hash));
+	/* large rrsets are matched with a hash table, the linear scan
+	 * per spooled RR is quadratic */
+	if(rrset->rr_count > RDATA_HASH_MIN_RRS)
+		use_hash = rdata_hash_init(&hash, rrset);
 	for(i=0; i<rrcount; i++) {
 		uint16_t rdlen, index;
 		uint32_t ttl;
+		int found;
 		if(!read_spool_u32(spool, &ttl) ||
 		   !read_spool_u16(spool, &rdlen)) {
 			log_msg(LOG_ERR, "error reading file %s: %s",
 				ixfrcr->file_name, strerror(errno));
+			free(hash.slots);
 			return 0;
 		}
 		/* because rdlen is uint16_t always smaller than sizeof(buf)*/
@@ -421,17 +519,23 @@ static int process_diff_rrset(FILE* spool, struct ixfr_create* ixfrcr,
 		if(fread(buf, rdlen, 1, spool) < 1) {
 			log_msg(LOG_ERR, "error reading file %s: %s",
 				ixfrcr->file_name, strerror(errno));
+			free(hash.slots);
 			return 0;
 		}
 		if(tp == TYPE_SOA) {
 			if(!process_store_oldsoa(store,
 				(void*)dname_name(domain_dname(domain)),
 				domain_dname(domain)->name_size, tp, kl, ttl,
-				buf, rdlen))
+				buf, rdlen)) {
+				free(hash.slots);
 				return 0;
+			}
 		}
 		/* see if the rr is in the RRset */
-		if(rrset_find_rdata(rrset, ttl, buf, rdlen, &index)) {
+		if(use_hash)
+			found = rdata_hash_find(&hash, ttl, buf, rdlen, &index);
+		else	found = rrset_find_rdata(rrset, ttl, buf, rdlen, &index);
+		if(found) {
 			/* it is in both, mark it */
 			marked[marked_num++] = index;
 		} else {
@@ -442,10 +546,12 @@ static int process_diff_rrset(FILE* spool, struct ixfr_create* ixfrcr,
 				domain_dname(domain)->name_size,
 				tp, kl, ttl, buf, rdlen)) {
 				log_msg(LOG_ERR, "out of memory");
+				free(hash.slots);
 				return 0;
 			}
 		}
 	}
+	free(hash.slots);
 	/* now that we are done, see if RRs in the rrset are not marked,
 	 * and thus are new rrs that are added */
 	qsort(marked, marked_num, sizeof(marked[0]), &sort_uint16);
@@ -942,6 +1048,7 @@ static int ixfr_perform_init(struct ixfr_create* ixfrcr, struct zone* zone,
 			ixfrcr->file_name, strerror(errno));
 		return 0;
 	}
+	(void)setvbuf(*spool, NULL, _IOFBF, IXFR_CREATE_SPOOL_BUFSIZE);
 	if(!read_spool_header(*spool, ixfrcr)) {
 		fclose(*spool);
 		return 0;
@@ -13,6 +13,9 @@
 struct zone;
 struct nsd;
 
+/* stdio buffer size for the zone spool file */
+#define IXFR_CREATE_SPOOL_BUFSIZE (256*1024)
+
 /* the ixfr create data structure while the ixfr difference from zone files
  * is created. */
 struct ixfr_create {
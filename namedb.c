@@ -228,9 +228,12 @@ do_deldomain(namedb_type* db, domain_type* domain)
 
 	/* see if nsec3-nodes are used */
 	if(domain->nsec3) {
-		if(domain->nsec3->nsec3_node.key)
-			zone_del_domain_in_hash_tree(nsec3_tree_zone(db, domain)
-				->nsec3tree, &domain->nsec3->nsec3_node);
+		if(domain->nsec3->nsec3_node.key) {
+			zone_type* zone = nsec3_tree_zone(db, domain);
+			zone_del_domain_in_hash_tree(zone->nsec3tree,
+				&domain->nsec3->nsec3_node);
+			nsec3_hash_index_delete(zone, domain);
+		}
 		if(domain->nsec3->hash_wc) {
 			if(domain->nsec3->hash_wc->hash.node.key)
 				zone_del_domain_in_hash_tree(nsec3_tree_zone(db, domain)
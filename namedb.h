@@ -68,6 +68,14 @@ struct nsec3_hash_wc_node {
 	nsec3_hash_node_type wc;
 };
 
+/* entry in the sorted array copy of the nsec3tree, for cover lookups */
+typedef struct nsec3_index_entry nsec3_index_entry_type;
+struct nsec3_index_entry {
+	/* hash value of the NSEC3 owner name */
+	uint8_t hash[NSEC3_HASH_LEN];
+	struct domain* domain;
+};
+
 struct nsec3_domain_data {
 	/* (if nsec3 chain complete) always the covering nsec3 record */
 	domain_type* nsec3_cover;
@@ -136,6 +144,9 @@ struct zone
 	rbtree_type* hashtree; /* tree, hashed NSEC3precompiled domains */
 	rbtree_type* wchashtree; /* tree, wildcard hashed domains */
 	rbtree_type* dshashtree; /* tree, ds-parent-hash domains */
+	/* sorted by hash, copy of nsec3tree, NULL until it is made */
+	nsec3_index_entry_type* nsec3index;
+	size_t nsec3index_count;
 #endif
 	struct zone_options* opts;
 	struct zone_ixfr* ixfr;
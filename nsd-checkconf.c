@@ -359,6 +359,8 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		ZONE_GET_INT(ixfr_size, o, zone->pattern);
 		ZONE_GET_INT(ixfr_number, o, zone->pattern);
 		ZONE_GET_BIN(create_ixfr, o, zone->pattern);
+		ZONE_GET_BIN(condense_ixfr, o, zone->pattern);
+		ZONE_GET_BIN(binary_ixfr, o, zone->pattern);
 		printf("Zone option not handled: %s %s\n", z, o);
 		exit(1);
 	} else if(pat) {
@@ -396,6 +398,8 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		ZONE_GET_INT(ixfr_size, o, p);
 		ZONE_GET_INT(ixfr_number, o, p);
 		ZONE_GET_BIN(create_ixfr, o, p);
+		ZONE_GET_BIN(condense_ixfr, o, p);
+		ZONE_GET_BIN(binary_ixfr, o, p);
 		printf("Pattern option not handled: %s %s\n", pat, o);
 		exit(1);
 	} else {
@@ -450,6 +454,7 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_INT(outgoing_tcp_mss, o);
 		SERV_GET_INT(xfrd_tcp_max, o);
 		SERV_GET_INT(xfrd_tcp_pipeline, o);
+		SERV_GET_INT(ixfr_pack_cache_size, o);
 		SERV_GET_INT(ipv4_edns_size, o);
 		SERV_GET_INT(ipv6_edns_size, o);
 		SERV_GET_INT(statistics, o);
@@ -464,6 +469,7 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_INT(rrl_ipv4_prefix_length, o);
 		SERV_GET_INT(rrl_ipv6_prefix_length, o);
 		SERV_GET_INT(rrl_whitelist_ratelimit, o);
+		SERV_GET_BIN(rrl_token_bucket, o);
 #endif
 #ifdef USE_DNSTAP
 		SERV_GET_BIN(dnstap_enable, o);
@@ -474,8 +480,12 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_STR(dnstap_version, o);
 		SERV_GET_BIN(dnstap_log_auth_query_messages, o);
 		SERV_GET_BIN(dnstap_log_auth_response_messages, o);
+		SERV_GET_INT(dnstap_sample_rate, o);
+		SERV_GET_STR(dnstap_log_qtypes, o);
+		SERV_GET_STR(dnstap_log_rcodes, o);
 #endif
 		SERV_GET_INT(zonefiles_write, o);
+		SERV_GET_INT(zonefiles_load_workers, o);
 		/* remote control */
 		SERV_GET_BIN(control_enable, o);
 		SERV_GET_IP(control_interface, control_interface, o);
@@ -548,6 +558,10 @@ static void print_zone_content_elems(pattern_options_type* pat)
 		printf("\tixfr-size: %u\n", (unsigned)pat->ixfr_size);
 	if(!pat->create_ixfr_is_default)
 		printf("\tcreate-ixfr: %s\n", pat->create_ixfr?"yes":"no");
+	if(!pat->condense_ixfr_is_default)
+		printf("\tcondense-ixfr: %s\n", pat->condense_ixfr?"yes":"no");
+	if(!pat->binary_ixfr_is_default)
+		printf("\tbinary-ixfr: %s\n", pat->binary_ixfr?"yes":"no");
 	if(pat->verify_zone != VERIFY_ZONE_INHERIT) {
 		printf("\tverify-zone: ");
 		if(pat->verify_zone) {
@@ -584,6 +598,9 @@ config_test_print_server(nsd_options_type* opt)
 	tls_auth_options_type* tlsauth;
 	zone_options_type* zone;
 	pattern_options_type* pat;
+#ifdef RATELIMIT
+	struct rrl_prefix_option* rrlp;
+#endif
 
 	printf("# Config settings.\n");
 	printf("server:\n");
@@ -634,6 +651,7 @@ config_test_print_server(nsd_options_type* opt)
 	printf("\toutgoing-tcp-mss: %d\n", opt->outgoing_tcp_mss);
 	printf("\txfrd-tcp-max: %d\n", opt->xfrd_tcp_max);
 	printf("\txfrd-tcp-pipeline: %d\n", opt->xfrd_tcp_pipeline);
+	printf("\tixfr-pack-cache-size: %d\n", (int)opt->ixfr_pack_cache_size);
 	printf("\tipv4-edns-size: %d\n", (int) opt->ipv4_edns_size);
 	printf("\tipv6-edns-size: %d\n", (int) opt->ipv6_edns_size);
 	print_string_var("pidfile:", opt->pidfile);
@@ -681,9 +699,14 @@ config_test_print_server(nsd_options_type* opt)
 	printf("\trrl-ipv4-prefix-length: %d\n", (int)opt->rrl_ipv4_prefix_length);
 	printf("\trrl-ipv6-prefix-length: %d\n", (int)opt->rrl_ipv6_prefix_length);
 	printf("\trrl-whitelist-ratelimit: %d\n", (int)opt->rrl_whitelist_ratelimit);
+	printf("\trrl-token-bucket: %s\n", opt->rrl_token_bucket?"yes":"no");
+	for(rrlp = opt->rrl_prefixes; rrlp; rrlp = rrlp->next)
+		printf("\trrl-prefix-ratelimit: %s %d\n", rrlp->address,
+			(int)rrlp->ratelimit);
 #endif
 	printf("\tzonefiles-check: %s\n", opt->zonefiles_check?"yes":"no");
 	printf("\tzonefiles-write: %d\n", opt->zonefiles_write);
+	printf("\tzonefiles-load-workers: %d\n", opt->zonefiles_load_workers);
 	print_string_var("tls-service-key:", opt->tls_service_key);
 	print_string_var("tls-service-pem:", opt->tls_service_pem);
 	print_string_var("tls-service-ocsp:", opt->tls_service_ocsp);
@@ -705,6 +728,9 @@ config_test_print_server(nsd_options_type* opt)
 	print_string_var("dnstap-version:", opt->dnstap_version);
 	printf("\tdnstap-log-auth-query-messages: %s\n", opt->dnstap_log_auth_query_messages?"yes":"no");
 	printf("\tdnstap-log-auth-response-messages: %s\n", opt->dnstap_log_auth_response_messages?"yes":"no");
+	printf("\tdnstap-sample-rate: %d\n", opt->dnstap_sample_rate);
+	print_string_var("dnstap-log-qtypes:", opt->dnstap_log_qtypes);
+	print_string_var("dnstap-log-rcodes:", opt->dnstap_log_rcodes);
 #endif
 
 	printf("\nremote-control:\n");
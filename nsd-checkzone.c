@@ -24,6 +24,9 @@
 #include "ixfr.h"
 #include "ixfrcreate.h"
 #include "difffile.h"
+#include "udb.h"
+#include "udbzone.h"
+#include "iterated_hash.h"
 
 struct nsd nsd;
 
@@ -39,13 +42,65 @@ usage (void)
 	fprintf(stderr, "\t-i <old zone file>\tcreate an IXFR from the differences between the\n\t\told zone file and the new zone file. Writes to \n\t\t<zonefile>.ixfr and renames other <zonefile>.ixfr files to\n\t\t<zonefile>.ixfr.num+1.\n");
 	fprintf(stderr, "\t-n <ixfr number>\tnumber of IXFR versions to store, at most.\n\t\tdefault %d.\n", (int)IXFR_NUMBER_DEFAULT);
 	fprintf(stderr, "\t-s <ixfr size>\tsize of IXFR to store, at most. default %d.\n", (int)IXFR_SIZE_DEFAULT);
+	fprintf(stderr, "\t-c <database>\tcompile the zone into the database file,\n\t\tthe nsd.db, so nsd does not have to parse the\n\t\tzone file on startup.\n");
 	fprintf(stderr, "Version %s. Report bugs to <%s>.\n",
 		PACKAGE_VERSION, PACKAGE_BUGREPORT);
 }
 
+#ifdef HAVE_MMAP
+/* store the zone, with the zonefile name and mtime, in the database file */
+static void
+compile_zone(zone_type* zone, const char* name, const char* fname,
+	const char* dbfile)
+{
+	udb_base* udb;
+	struct timespec mtime;
+	int nonexist = 0;
+	if(!file_get_mtime(fname, &mtime, &nonexist)) {
+		error("cannot stat %s: %s", fname, strerror(errno));
+	}
+	if(access(dbfile, F_OK) == 0) {
+		if(!(udb = udb_base_create_read(dbfile, &namedb_walkfunc,
+			NULL))) {
+			error("cannot read database %s", dbfile);
+		}
+		if(udb_base_get_userflags(udb) != 0) {
+			udb_base_free(udb);
+			error("%s was not closed properly, it might be "
+				"corrupted", dbfile);
+		}
+	} else {
+		if(!(udb = udb_base_create_new(dbfile, &namedb_walkfunc,
+			NULL))) {
+			error("cannot create database %s", dbfile);
+		}
+		if(!udb_dns_init_file(udb)) {
+			udb_base_free(udb);
+			error("cannot initialize database %s", dbfile);
+		}
+	}
+	if(!write_zone_to_udb(udb, zone, &mtime, fname)) {
+		udb_ptr z;
+		/* remove the partially stored zone from the database */
+		if(udb_zone_search(udb, &z, dname_name(domain_dname(
+			zone->apex)), domain_dname(zone->apex)->name_size)) {
+			udb_zone_delete(udb, &z);
+			udb_ptr_unlink(&z, udb);
+		}
+		udb_base_close(udb);
+		udb_base_free(udb);
+		error("failed to store zone %s in %s", name, dbfile);
+	}
+	udb_base_close(udb);
+	udb_base_free(udb);
+	printf("zone %s compiled into %s\n", name, dbfile);
+}
+#endif /* HAVE_MMAP */
+
 static void
 check_zone(struct nsd* nsd, const char* name, const char* fname, FILE *out,
-	const char* oldzone, uint32_t ixfr_number, uint64_t ixfr_size)
+	const char* oldzone, uint32_t ixfr_number, uint64_t ixfr_size,
+	const char* dbfile)
 {
 	const dname_type* dname;
 	zone_options_type* zo;
@@ -103,6 +158,13 @@ check_zone(struct nsd* nsd, const char* name, const char* fname, FILE *out,
 		printf("zone %s created IXFR %s.ixfr\n", name, fname);
 		ixfr_create_free(ixfrcr);
 	}
+	if(dbfile) {
+#ifdef HAVE_MMAP
+		compile_zone(zone, name, fname, dbfile);
+#else
+		error("no mmap(), cannot compile into database %s", dbfile);
+#endif
+	}
 	if (out) {
 		print_rrs(out, zone);
 		printf("; ");
@@ -139,14 +201,18 @@ main(int argc, char *argv[])
 	uint32_t ixfr_number = IXFR_NUMBER_DEFAULT;
 	uint64_t ixfr_size = IXFR_SIZE_DEFAULT;
 	char* oldzone = NULL;
+	char* dbfile = NULL;
 	struct nsd nsd;
 	memset(&nsd, 0, sizeof(nsd));
 
 	log_init("nsd-checkzone");
 
 	/* Parse the command line... */
-	while ((c = getopt(argc, argv, "hi:n:ps:")) != -1) {
+	while ((c = getopt(argc, argv, "c:hi:n:ps:")) != -1) {
 		switch (c) {
+		case 'c':
+			dbfile = optarg;
+			break;
 		case 'h':
 			usage();
 			exit(0);
@@ -185,8 +251,11 @@ main(int argc, char *argv[])
 		verbosity = nsd.options->verbosity;
 
 	check_zone(&nsd, argv[0], argv[1], print_zone ? stdout : NULL,
-		oldzone, ixfr_number, ixfr_size);
+		oldzone, ixfr_number, ixfr_size, dbfile);
 	region_destroy(nsd.options->region);
+#ifdef NSEC3
+	iterated_hash_cleanup();
+#endif
 	/* yylex_destroy(); but, not available in all versions of flex */
 
 	exit(0);
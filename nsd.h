@@ -313,6 +313,10 @@ struct	nsd
 		/* Dropped, truncated, queries for nonconfigured zone, tx errors */
 		stc_type dropped, truncated, wrongzone, txerr, rxerr;
 		stc_type edns, ednserr, raxfr, nona, rixfr;
+		/* query-time NSEC3 hash cache hits and misses */
+		stc_type nsec3hit, nsec3miss;
+		/* dnstap messages dropped because the ring was full */
+		stc_type dnstapdrop;
 		uint64_t db_disk, db_mem;
 	} st;
 	/* per zone stats, each an array per zone-stat-idx, stats per zone is
@@ -331,7 +335,8 @@ struct	nsd
 #ifdef USE_DNSTAP
 	/* the dnstap collector process info */
 	struct dt_collector* dt_collector;
-	/* the pipes from server processes to the dt_collector,
+	/* the pipes from server processes to the dt_collector, that wake
+	 * up the collector for the messages in the shared memory rings,
 	 * arrays of size child_count * 2.  Kept open for (re-)forks. */
 	int *dt_collector_fd_send, *dt_collector_fd_recv;
 	/* the pipes from server processes to the dt_collector. Initially
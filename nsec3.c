@@ -10,6 +10,13 @@
 #ifdef NSEC3
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
 
 #include "nsec3.h"
 #include "iterated_hash.h"
@@ -21,6 +28,15 @@
 
 #define NSEC3_RDATA_BITMAP 5
 
+#if defined(HAVE_MMAP) && defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define	MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/* number of processes that compute the hashes for a precompile */
+static int nsec3_precompile_workers = 1;
+/* below this number of names the fork costs more than the hashes */
+#define NSEC3_PRECOMPILE_PARALLEL_MIN 10000
+
 /* compare nsec3 hashes in nsec3 tree */
 static int
 cmp_hash_tree(const void* x, const void* y)
@@ -432,6 +448,7 @@ nsec3_clear_precompile(struct namedb* db, zone_type* zone)
 	hash_tree_clear(zone->hashtree);
 	hash_tree_clear(zone->wchashtree);
 	hash_tree_clear(zone->dshashtree);
+	nsec3_hash_index_clear(zone);
 	/* wipe hashes */
 
 	/* wipe precompile */
@@ -554,6 +571,29 @@ nsec3_find_cover(zone_type* zone, uint8_t* hash, size_t hashlen,
 	assert(result);
 	assert(zone->nsec3_param && zone->nsec3tree);
 
+	if(zone->nsec3index && hashlen == NSEC3_HASH_LEN) {
+		/* binary search in the sorted array, for the first entry
+		 * that is larger than the hash */
+		size_t lo = 0, hi = zone->nsec3index_count, mid;
+		while(lo < hi) {
+			int c;
+			mid = lo + (hi-lo)/2;
+			c = memcmp(zone->nsec3index[mid].hash, hash,
+				NSEC3_HASH_LEN);
+			if(c == 0) {
+				*result = zone->nsec3index[mid].domain;
+				return 1;
+			}
+			if(c < 0)
+				lo = mid+1;
+			else	hi = mid;
+		}
+		if(lo == 0)
+			*result = zone->nsec3_last;
+		else	*result = zone->nsec3index[lo-1].domain;
+		return 0;
+	}
+
 	exact = rbtree_find_less_equal(zone->nsec3tree, &d, &r);
 	if(r) {
 		*result = (domain_type*)r->key;
@@ -634,6 +674,95 @@ parse_nsec3_name(const dname_type* dname, uint8_t* hash, size_t buflen)
 	(void)b32_pton((char*)wire+1, hash, buflen);
 }
 
+void
+nsec3_hash_index_clear(struct zone* zone)
+{
+	free(zone->nsec3index);
+	zone->nsec3index = NULL;
+	zone->nsec3index_count = 0;
+}
+
+/* create the sorted array of the nsec3tree, used by nsec3_find_cover.
+ * The nsec3tree is sorted on the b32 text, and that sorts the same as
+ * the hash value, so the array is in the order of the tree walk */
+static void
+nsec3_hash_index_create(struct zone* zone)
+{
+	rbnode_type* n;
+	size_t i = 0;
+	nsec3_hash_index_clear(zone);
+	if(!zone->nsec3tree || zone->nsec3tree->count == 0)
+		return;
+	zone->nsec3index = (nsec3_index_entry_type*)xmallocarray(
+		zone->nsec3tree->count, sizeof(nsec3_index_entry_type));
+	RBTREE_FOR(n, rbnode_type*, zone->nsec3tree) {
+		domain_type* d = (domain_type*)n->key;
+		uint8_t hash[NSEC3_HASH_LEN+1];
+		parse_nsec3_name(domain_dname(d), hash, sizeof(hash));
+		memcpy(zone->nsec3index[i].hash, hash, NSEC3_HASH_LEN);
+		zone->nsec3index[i].domain = d;
+		i++;
+	}
+	zone->nsec3index_count = i;
+}
+
+/* position in the sorted array of the first entry that is not smaller
+ * than the hash */
+static size_t
+nsec3_hash_index_pos(struct zone* zone, const uint8_t* hash)
+{
+	size_t lo = 0, hi = zone->nsec3index_count, mid;
+	while(lo < hi) {
+		mid = lo + (hi-lo)/2;
+		if(memcmp(zone->nsec3index[mid].hash, hash,
+			NSEC3_HASH_LEN) < 0)
+			lo = mid+1;
+		else	hi = mid;
+	}
+	return lo;
+}
+
+/* put the NSEC3 domain in the sorted array, if the array exists */
+static void
+nsec3_hash_index_insert(struct zone* zone, struct domain* domain)
+{
+	uint8_t hash[NSEC3_HASH_LEN+1];
+	size_t pos;
+	if(!zone->nsec3index)
+		return;
+	parse_nsec3_name(domain_dname(domain), hash, sizeof(hash));
+	pos = nsec3_hash_index_pos(zone, hash);
+	if(pos < zone->nsec3index_count &&
+		zone->nsec3index[pos].domain == domain)
+		return; /* already in the array */
+	zone->nsec3index = (nsec3_index_entry_type*)xrealloc(
+		zone->nsec3index, (zone->nsec3index_count+1)*
+		sizeof(nsec3_index_entry_type));
+	memmove(&zone->nsec3index[pos+1], &zone->nsec3index[pos],
+		(zone->nsec3index_count-pos)*sizeof(nsec3_index_entry_type));
+	memcpy(zone->nsec3index[pos].hash, hash, NSEC3_HASH_LEN);
+	zone->nsec3index[pos].domain = domain;
+	zone->nsec3index_count++;
+}
+
+void
+nsec3_hash_index_delete(struct zone* zone, struct domain* domain)
+{
+	uint8_t hash[NSEC3_HASH_LEN+1];
+	size_t pos;
+	if(!zone->nsec3index)
+		return;
+	parse_nsec3_name(domain_dname(domain), hash, sizeof(hash));
+	pos = nsec3_hash_index_pos(zone, hash);
+	if(pos >= zone->nsec3index_count ||
+		zone->nsec3index[pos].domain != domain)
+		return;
+	memmove(&zone->nsec3index[pos], &zone->nsec3index[pos+1],
+		(zone->nsec3index_count-pos-1)*
+		sizeof(nsec3_index_entry_type));
+	zone->nsec3index_count--;
+}
+
 void
 nsec3_precompile_nsec3rr(namedb_type* db, struct domain* domain,
 	struct zone* zone)
@@ -642,12 +771,169 @@ nsec3_precompile_nsec3rr(namedb_type* db, struct domain* domain,
 	/* add into nsec3tree */
 	zone_add_domain_in_hash_tree(db->region, &zone->nsec3tree,
 		cmp_nsec3_tree, domain, &domain->nsec3->nsec3_node);
+	nsec3_hash_index_insert(zone, domain);
 	/* fixup the last in the zone */
 	if(rbtree_last(zone->nsec3tree)->key == domain) {
 		zone->nsec3_last = domain;
 	}
 }
 
+void
+nsec3_set_precompile_workers(int num)
+{
+	nsec3_precompile_workers = num;
+}
+
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+/** domain that needs hashes for the precompile */
+struct nsec3_prehash_item {
+	domain_type* domain;
+	/* the hash and wildcard hash are needed */
+	int hash;
+	/* the ds hash is needed */
+	int dshash;
+};
+
+/** hashes computed by a worker, in memory shared with the workers */
+struct nsec3_prehash_result {
+	uint8_t hash[NSEC3_HASH_LEN];
+	uint8_t wc[NSEC3_HASH_LEN];
+	uint8_t ds[NSEC3_HASH_LEN];
+	/* set when the hashes have been computed */
+	uint8_t done;
+};
+
+/** compute the hashes for an item */
+static void
+nsec3_prehash_compute(zone_type* zone, struct nsec3_prehash_item* item,
+	struct nsec3_prehash_result* res, region_type* tmpregion)
+{
+	const dname_type* dname = domain_dname(item->domain);
+	if(item->hash) {
+		const dname_type* wcard;
+		nsec3_hash_and_store(zone, dname, res->hash);
+		wcard = dname_parse(tmpregion, "*");
+		wcard = dname_concatenate(tmpregion, wcard, dname);
+		nsec3_hash_and_store(zone, wcard, res->wc);
+		region_free_all(tmpregion);
+	}
+	if(item->dshash)
+		nsec3_hash_and_store(zone, dname, res->ds);
+	res->done = 1;
+}
+
+/** Compute the hashes for the precompile of the zone with worker
+ * processes, and store them in the domains.  The precompile then finds
+ * the hashes present and only builds the trees and cover pointers. */
+static void
+nsec3_precompile_hash_parallel(namedb_type* db, zone_type* zone)
+{
+	struct nsec3_prehash_item* items = NULL;
+	struct nsec3_prehash_result* results;
+	size_t num = 0, max = 0, i;
+	int workers = nsec3_precompile_workers, w;
+	pid_t* pids;
+	region_type* tmpregion;
+	domain_type* walk;
+
+	for(walk=zone->apex; walk && domain_is_subdomain(walk, zone->apex);
+		walk = domain_next(walk)) {
+		int h = nsec3_condition_hash(walk, zone) &&
+			!(walk->nsec3 && walk->nsec3->hash_wc);
+		int d = nsec3_condition_dshash(walk, zone) &&
+			!(walk->nsec3 && walk->nsec3->ds_parent_hash);
+		if(!h && !d)
+			continue;
+		if(num == max) {
+			max = (max==0?1024:max*2);
+			items = (struct nsec3_prehash_item*)xrealloc(items,
+				max*sizeof(*items));
+		}
+		items[num].domain = walk;
+		items[num].hash = h;
+		items[num].dshash = d;
+		num++;
+	}
+	if(num < NSEC3_PRECOMPILE_PARALLEL_MIN) {
+		free(items);
+		return;
+	}
+	results = (struct nsec3_prehash_result*)mmap(NULL,
+		num*sizeof(*results), PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(results == MAP_FAILED) {
+		log_msg(LOG_ERR, "nsec3 precompile: mmap failed: %s",
+			strerror(errno));
+		free(items);
+		return;
+	}
+	memset(results, 0, num*sizeof(*results));
+	tmpregion = region_create(xalloc, free);
+
+	pids = (pid_t*)xalloc_array_zero((size_t)workers, sizeof(pid_t));
+	for(w=0; w<workers; w++) {
+		pids[w] = fork();
+		if(pids[w] == -1) {
+			log_msg(LOG_ERR, "nsec3 precompile: fork failed: %s",
+				strerror(errno));
+			break;
+		} else if(pids[w] == 0) {
+			for(i=(size_t)w; i<num; i+=(size_t)workers)
+				nsec3_prehash_compute(zone, &items[i],
+					&results[i], tmpregion);
+			/* no exit handlers and stdio flush of the
+			 * server's state in the worker */
+			_exit(0);
+		}
+	}
+	for(w=0; w<workers; w++) {
+		int status;
+		if(pids[w] <= 0)
+			continue;
+		while(waitpid(pids[w], &status, 0) == -1) {
+			if(errno != EINTR) {
+				log_msg(LOG_ERR, "waitpid: %s",
+					strerror(errno));
+				break;
+			}
+		}
+	}
+	free(pids);
+
+	/* store the hashes, and compute those that a worker did not */
+	for(i=0; i<num; i++) {
+		domain_type* domain = items[i].domain;
+		if(!results[i].done)
+			nsec3_prehash_compute(zone, &items[i], &results[i],
+				tmpregion);
+		allocate_domain_nsec3(db->domains, domain);
+		if(items[i].hash) {
+			domain->nsec3->hash_wc = (nsec3_hash_wc_node_type *)
+				region_alloc(db->region,
+				sizeof(nsec3_hash_wc_node_type));
+			domain->nsec3->hash_wc->hash.node.key = NULL;
+			domain->nsec3->hash_wc->wc.node.key = NULL;
+			memcpy(domain->nsec3->hash_wc->hash.hash,
+				results[i].hash, NSEC3_HASH_LEN);
+			memcpy(domain->nsec3->hash_wc->wc.hash,
+				results[i].wc, NSEC3_HASH_LEN);
+		}
+		if(items[i].dshash) {
+			domain->nsec3->ds_parent_hash = (nsec3_hash_node_type *)
+				region_alloc(db->region,
+				sizeof(nsec3_hash_node_type));
+			domain->nsec3->ds_parent_hash->node.key = NULL;
+			memcpy(domain->nsec3->ds_parent_hash->hash,
+				results[i].ds, NSEC3_HASH_LEN);
+		}
+	}
+	region_destroy(tmpregion);
+	if(munmap(results, num*sizeof(*results)) == -1)
+		log_msg(LOG_ERR, "munmap: %s", strerror(errno));
+	free(items);
+}
+#endif /* HAVE_MMAP && MAP_ANONYMOUS */
+
 void
 nsec3_precompile_newparam(namedb_type* db, zone_type* zone)
 {
@@ -656,7 +942,13 @@ nsec3_precompile_newparam(namedb_type* db, zone_type* zone)
 	time_t s = time(NULL);
 	unsigned long n = 0, c = 0;
 
-	/* add nsec3s of chain to nsec3tree */
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+	if(nsec3_precompile_workers > 1)
+		nsec3_precompile_hash_parallel(db, zone);
+#endif
+
+	/* add nsec3s of chain to nsec3tree, the index is made after that */
+	nsec3_hash_index_clear(zone);
 	for(walk=zone->apex; walk && domain_is_subdomain(walk, zone->apex);
 		walk = domain_next(walk)) {
 		n++;
@@ -664,6 +956,7 @@ nsec3_precompile_newparam(namedb_type* db, zone_type* zone)
 			nsec3_precompile_nsec3rr(db, walk, zone);
 		}
 	}
+	nsec3_hash_index_create(zone);
 	/* hash and precompile zone */
 	for(walk=zone->apex; walk && domain_is_subdomain(walk, zone->apex);
 		walk = domain_next(walk)) {
@@ -915,7 +1208,12 @@ void prehash_zone(struct namedb* db, struct zone* zone)
 	if(!check_apex_soa(db, zone, 0)) {
 		zone->nsec3_param = NULL;
 		zone->nsec3_last = NULL;
+		nsec3_hash_index_clear(zone);
+		return;
 	}
+	/* the nsec3tree is complete again, for lookups */
+	if(!zone->nsec3index)
+		nsec3_hash_index_create(zone);
 }
 
 /* add the NSEC3 rrset to the query answer at the given domain */
@@ -930,7 +1228,163 @@ nsec3_add_rrset(struct query* query, struct answer* answer,
 	}
 }
 
-/* this routine does hashing at query-time. slow. */
+/* number of names in the query-time hash cache, power of two */
+#define NSEC3_HASH_CACHE_SIZE 1024
+
+/* hash of a name, made at query-time, with the nsec3 that covers it */
+struct nsec3_hash_cache_entry {
+	/* zone and NSEC3PARAM the hash is made with, NULL if unused */
+	zone_type* zone;
+	rr_type* param;
+	/* the hashed name, in wireformat */
+	uint8_t name[MAXDOMAINLEN];
+	uint8_t name_size;
+	uint8_t exact;
+	uint8_t hash[NSEC3_HASH_LEN];
+	domain_type* cover;
+	/* next in the hash bucket */
+	struct nsec3_hash_cache_entry* bucket_next;
+	/* lru list, the front is the most recently used */
+	struct nsec3_hash_cache_entry* lru_prev, *lru_next;
+};
+
+/* the cache is per process, the serve processes do not change the
+ * zones, and get a new (empty) cache when forked after a reload */
+static struct nsec3_hash_cache_entry* nsec3_hash_cache = NULL;
+static struct nsec3_hash_cache_entry** nsec3_hash_cache_bucket = NULL;
+static struct nsec3_hash_cache_entry* nsec3_hash_cache_lru_first = NULL;
+static struct nsec3_hash_cache_entry* nsec3_hash_cache_lru_last = NULL;
+/* statistics of the process, counts the hits and misses */
+static struct nsdst* nsec3_hash_cache_stats = NULL;
+
+void
+nsec3_set_hash_cache_stats(struct nsdst* st)
+{
+	nsec3_hash_cache_stats = st;
+}
+
+static void
+nsec3_hash_cache_init(void)
+{
+	size_t i;
+	nsec3_hash_cache = (struct nsec3_hash_cache_entry*)xalloc_array_zero(
+		NSEC3_HASH_CACHE_SIZE, sizeof(struct nsec3_hash_cache_entry));
+	nsec3_hash_cache_bucket = (struct nsec3_hash_cache_entry**)
+		xalloc_array_zero(NSEC3_HASH_CACHE_SIZE,
+		sizeof(struct nsec3_hash_cache_entry*));
+	/* all the entries are on the lru list, unused ones at the end */
+	for(i=0; i<NSEC3_HASH_CACHE_SIZE; i++) {
+		nsec3_hash_cache[i].lru_prev = (i==0?NULL:&nsec3_hash_cache[i-1]);
+		nsec3_hash_cache[i].lru_next = (i==NSEC3_HASH_CACHE_SIZE-1?
+			NULL:&nsec3_hash_cache[i+1]);
+	}
+	nsec3_hash_cache_lru_first = &nsec3_hash_cache[0];
+	nsec3_hash_cache_lru_last = &nsec3_hash_cache[NSEC3_HASH_CACHE_SIZE-1];
+}
+
+/* FNV-1a over the zone and the name, to select the bucket */
+static size_t
+nsec3_hash_cache_bucketnum(zone_type* zone, const uint8_t* name, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i, z = (size_t)zone;
+	for(i=0; i<sizeof(z); i++) {
+		h ^= (uint8_t)(z >> (i*8));
+		h *= 16777619u;
+	}
+	for(i=0; i<len; i++) {
+		h ^= name[i];
+		h *= 16777619u;
+	}
+	return (size_t)(h & (NSEC3_HASH_CACHE_SIZE-1));
+}
+
+static void
+nsec3_hash_cache_lru_touch(struct nsec3_hash_cache_entry* e)
+{
+	if(e == nsec3_hash_cache_lru_first)
+		return;
+	/* remove from the list */
+	e->lru_prev->lru_next = e->lru_next;
+	if(e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else	nsec3_hash_cache_lru_last = e->lru_prev;
+	/* insert at the front */
+	e->lru_prev = NULL;
+	e->lru_next = nsec3_hash_cache_lru_first;
+	nsec3_hash_cache_lru_first->lru_prev = e;
+	nsec3_hash_cache_lru_first = e;
+}
+
+static void
+nsec3_hash_cache_bucket_remove(struct nsec3_hash_cache_entry* e, size_t b)
+{
+	struct nsec3_hash_cache_entry** p = &nsec3_hash_cache_bucket[b];
+	while(*p) {
+		if(*p == e) {
+			*p = e->bucket_next;
+			break;
+		}
+		p = &(*p)->bucket_next;
+	}
+	e->bucket_next = NULL;
+}
+
+/* hash the name and find the cover for it, the cache makes sure that a
+ * name that is queried often, like in a flood of random names below a
+ * wildcard, is hashed once. Returns true if the hash is an exact match. */
+static int
+nsec3_hash_and_find_cover(zone_type* zone, const dname_type* dname,
+	uint8_t* hash, domain_type** cover)
+{
+	const uint8_t* name = dname_name(dname);
+	size_t b;
+	struct nsec3_hash_cache_entry* e;
+	int exact;
+
+	if(!nsec3_hash_cache)
+		nsec3_hash_cache_init();
+	b = nsec3_hash_cache_bucketnum(zone, name, dname->name_size);
+	for(e = nsec3_hash_cache_bucket[b]; e; e = e->bucket_next) {
+		if(e->zone == zone && e->param == zone->nsec3_param &&
+			e->name_size == dname->name_size &&
+			memcmp(e->name, name, dname->name_size) == 0) {
+#ifdef BIND8_STATS
+			if(nsec3_hash_cache_stats)
+				nsec3_hash_cache_stats->nsec3hit++;
+#endif
+			nsec3_hash_cache_lru_touch(e);
+			memcpy(hash, e->hash, NSEC3_HASH_LEN);
+			*cover = e->cover;
+			return e->exact;
+		}
+	}
+#ifdef BIND8_STATS
+	if(nsec3_hash_cache_stats)
+		nsec3_hash_cache_stats->nsec3miss++;
+#endif
+	nsec3_hash_and_store(zone, dname, hash);
+	exact = nsec3_find_cover(zone, hash, NSEC3_HASH_LEN, cover);
+
+	/* store it in the least recently used entry */
+	e = nsec3_hash_cache_lru_last;
+	if(e->zone)
+		nsec3_hash_cache_bucket_remove(e, nsec3_hash_cache_bucketnum(
+			e->zone, e->name, e->name_size));
+	e->zone = zone;
+	e->param = zone->nsec3_param;
+	memcpy(e->name, name, dname->name_size);
+	e->name_size = dname->name_size;
+	memcpy(e->hash, hash, NSEC3_HASH_LEN);
+	e->cover = *cover;
+	e->exact = (exact?1:0);
+	e->bucket_next = nsec3_hash_cache_bucket[b];
+	nsec3_hash_cache_bucket[b] = e;
+	nsec3_hash_cache_lru_touch(e);
+	return exact;
+}
+
+/* this routine does hashing at query-time. slow, cached per name. */
 static void
 nsec3_add_nonexist_proof(struct query* query, struct answer* answer,
         struct domain* encloser, const dname_type* qname)
@@ -944,8 +1398,7 @@ nsec3_add_nonexist_proof(struct query* query, struct answer* answer,
 	to_prove = dname_partial_copy(query->region, qname,
 		dname_label_match_count(qname, domain_dname(encloser))+1);
 	/* generate proof that one label below closest encloser does not exist */
-	nsec3_hash_and_store(query->zone, to_prove, hash);
-	if(nsec3_find_cover(query->zone, hash, sizeof(hash), &cover))
+	if(nsec3_hash_and_find_cover(query->zone, to_prove, hash, &cover))
 	{
 		/* exact match, hash collision */
 		domain_type* walk;
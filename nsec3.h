@@ -102,8 +102,18 @@ void nsec3_precompile_domain_ds(struct namedb* db, struct domain* domain,
 /* put nsec3 into nsec3tree and adjust zonelast */
 void nsec3_precompile_nsec3rr(struct namedb* db, struct domain* domain,
 	struct zone* zone);
+/* free the sorted array index of the nsec3tree */
+void nsec3_hash_index_clear(struct zone* zone);
+/* remove the domain from the sorted array index, when it is removed from
+ * the nsec3tree */
+void nsec3_hash_index_delete(struct zone* zone, struct domain* domain);
 /* precompile entire zone, assumes all is null at start */
 void nsec3_precompile_newparam(struct namedb* db, struct zone* zone);
+/* set the number of processes that compute the hashes for a precompile */
+void nsec3_set_precompile_workers(int num);
+/* set the statistics that count the query-time hash cache hits, misses */
+struct nsdst;
+void nsec3_set_hash_cache_stats(struct nsdst* st);
 /* create b32.zone for a hash, allocated in the region */
 const struct dname* nsec3_b32_create(struct region* region, struct zone* zone,
 	unsigned char* hash);
@@ -94,6 +94,7 @@ nsd_options_create(region_type* region)
 	opt->reuseport = 0;
 	opt->xfrd_tcp_max = 128;
 	opt->xfrd_tcp_pipeline = 128;
+	opt->ixfr_pack_cache_size = IXFR_PACK_CACHE_SIZE_DEFAULT;
 	opt->statistics = 0;
 	opt->chroot = 0;
 	opt->username = USER;
@@ -113,6 +114,8 @@ nsd_options_create(region_type* region)
 	opt->rrl_ratelimit = RRL_LIMIT/2;
 	opt->rrl_whitelist_ratelimit = RRL_WLIST_LIMIT/2;
 #  endif
+	opt->rrl_prefixes = NULL;
+	opt->rrl_token_bucket = 0;
 #endif
 #ifdef USE_DNSTAP
 	opt->dnstap_enable = 0;
@@ -123,11 +126,15 @@ nsd_options_create(region_type* region)
 	opt->dnstap_version = NULL;
 	opt->dnstap_log_auth_query_messages = 0;
 	opt->dnstap_log_auth_response_messages = 0;
+	opt->dnstap_sample_rate = 0;
+	opt->dnstap_log_qtypes = NULL;
+	opt->dnstap_log_rcodes = NULL;
 #endif
 	opt->zonefiles_check = 1;
 	if(opt->database == NULL || opt->database[0] == 0)
 		opt->zonefiles_write = ZONEFILES_WRITE_INTERVAL;
 	else	opt->zonefiles_write = 0;
+	opt->zonefiles_load_workers = 1;
 	opt->xfrd_reload_timeout = 1;
 	opt->tls_service_key = NULL;
 	opt->tls_service_ocsp = NULL;
@@ -901,6 +908,10 @@ pattern_options_create(region_type* region)
 	p->ixfr_number_is_default = 1;
 	p->create_ixfr = 0;
 	p->create_ixfr_is_default = 1;
+	p->condense_ixfr = 0;
+	p->condense_ixfr_is_default = 1;
+	p->binary_ixfr = 0;
+	p->binary_ixfr_is_default = 1;
 	p->verify_zone = VERIFY_ZONE_INHERIT;
 	p->verify_zone_is_default = 1;
 	p->verifier = NULL;
@@ -1104,6 +1115,10 @@ copy_pat_fixed(region_type* region, struct pattern_options* orig,
 	orig->ixfr_number_is_default = p->ixfr_number_is_default;
 	orig->create_ixfr = p->create_ixfr;
 	orig->create_ixfr_is_default = p->create_ixfr_is_default;
+	orig->condense_ixfr = p->condense_ixfr;
+	orig->condense_ixfr_is_default = p->condense_ixfr_is_default;
+	orig->binary_ixfr = p->binary_ixfr;
+	orig->binary_ixfr_is_default = p->binary_ixfr_is_default;
 	orig->verify_zone = p->verify_zone;
 	orig->verify_zone_is_default = p->verify_zone_is_default;
 	orig->verifier_timeout = p->verifier_timeout;
@@ -1233,6 +1248,10 @@ pattern_options_equal(struct pattern_options* p, struct pattern_options* q)
 	if(!booleq(p->ixfr_number_is_default,q->ixfr_number_is_default)) return 0;
 	if(!booleq(p->create_ixfr,q->create_ixfr)) return 0;
 	if(!booleq(p->create_ixfr_is_default,q->create_ixfr_is_default)) return 0;
+	if(!booleq(p->condense_ixfr,q->condense_ixfr)) return 0;
+	if(!booleq(p->condense_ixfr_is_default,q->condense_ixfr_is_default)) return 0;
+	if(!booleq(p->binary_ixfr,q->binary_ixfr)) return 0;
+	if(!booleq(p->binary_ixfr_is_default,q->binary_ixfr_is_default)) return 0;
 	if(p->verify_zone != q->verify_zone) return 0;
 	if(!booleq(p->verify_zone_is_default,
 		q->verify_zone_is_default)) return 0;
@@ -1461,6 +1480,10 @@ pattern_options_marshal(struct buffer* b, struct pattern_options* p)
 	marshal_u8(b, p->ixfr_number_is_default);
 	marshal_u8(b, p->create_ixfr);
 	marshal_u8(b, p->create_ixfr_is_default);
+	marshal_u8(b, p->condense_ixfr);
+	marshal_u8(b, p->condense_ixfr_is_default);
+	marshal_u8(b, p->binary_ixfr);
+	marshal_u8(b, p->binary_ixfr_is_default);
 	marshal_u8(b, p->verify_zone);
 	marshal_u8(b, p->verify_zone_is_default);
 	marshal_strv(b, p->verifier);
@@ -1511,6 +1534,10 @@ pattern_options_unmarshal(region_type* r, struct buffer* b)
 	p->ixfr_number_is_default = unmarshal_u8(b);
 	p->create_ixfr = unmarshal_u8(b);
 	p->create_ixfr_is_default = unmarshal_u8(b);
+	p->condense_ixfr = unmarshal_u8(b);
+	p->condense_ixfr_is_default = unmarshal_u8(b);
+	p->binary_ixfr = unmarshal_u8(b);
+	p->binary_ixfr_is_default = unmarshal_u8(b);
 	p->verify_zone = unmarshal_u8(b);
 	p->verify_zone_is_default = unmarshal_u8(b);
 	p->verifier = unmarshal_strv(r, b);
@@ -1574,6 +1601,7 @@ key_options_desetup(region_type* region, struct key_options* key)
 	if(!key->tsig_key)
 		return;
 	/* name stays the same */
+	tsig_key_clear_template(key->tsig_key);
 	if(key->tsig_key->data) {
 		/* wipe secret! */
 		memset(key->tsig_key->data, 0xdd, key->tsig_key->size);
@@ -1604,6 +1632,9 @@ key_options_setup(region_type* region, struct key_options* key)
 		}
 		key->tsig_key->size = 0;
 		key->tsig_key->data = NULL;
+		key->tsig_key->hmac_template = NULL;
+		key->tsig_key->hmac_template_algorithm = NULL;
+		key->tsig_key->hmac_template_serial = 0;
 	}
 	size = b64_pton(key->secret, data, sizeof(data));
 	if(size == -1) {
@@ -2331,6 +2362,14 @@ config_apply_pattern(struct pattern_options *dest, const char* name)
 		dest->create_ixfr = pat->create_ixfr;
 		dest->create_ixfr_is_default = 0;
 	}
+	if(!pat->condense_ixfr_is_default) {
+		dest->condense_ixfr = pat->condense_ixfr;
+		dest->condense_ixfr_is_default = 0;
+	}
+	if(!pat->binary_ixfr_is_default) {
+		dest->binary_ixfr = pat->binary_ixfr;
+		dest->binary_ixfr_is_default = 0;
+	}
 	dest->size_limit_xfr = pat->size_limit_xfr;
 #ifdef RATELIMIT
 	dest->rrl_whitelist |= pat->rrl_whitelist;
@@ -2572,3 +2611,87 @@ resolve_interface_names(struct nsd_options* options)
 	(void)options;
 #endif /* HAVE_GETIFADDRS */
 }
+
+/* get the next word of the list in buf, returns false at the end or when
+ * it does not fit */
+static int
+dnstap_list_next(const char** p, char* buf, size_t bufsize)
+{
+	size_t len;
+	while(**p == ' ' || **p == '\t' || **p == ',')
+		(*p)++;
+	len = strcspn(*p, " \t,");
+	if(len == 0 || len >= bufsize)
+		return 0;
+	memmove(buf, *p, len);
+	buf[len] = 0;
+	*p += len;
+	return 1;
+}
+
+int
+dnstap_parse_qtypes(const char* str, uint8_t* bits)
+{
+	char buf[32];
+	uint16_t t;
+	int n = 0;
+	while(dnstap_list_next(&str, buf, sizeof(buf))) {
+		/* the meta types are not in the rrtype table */
+		if(strcasecmp(buf, "ANY") == 0)
+			t = TYPE_ANY;
+		else if(strcasecmp(buf, "AXFR") == 0)
+			t = TYPE_AXFR;
+		else if(strcasecmp(buf, "IXFR") == 0)
+			t = TYPE_IXFR;
+		else if((t = rrtype_from_string(buf)) == 0)
+			return 0;
+		if(bits)
+			bits[t/8] |= (1<<(t&7));
+		n++;
+	}
+	return n > 0 && *str == 0;
+}
+
+static lookup_table_type dnstap_rcode_table[] = {
+	{ RCODE_OK, "NOERROR" },
+	{ RCODE_FORMAT, "FORMERR" },
+	{ RCODE_SERVFAIL, "SERVFAIL" },
+	{ RCODE_NXDOMAIN, "NXDOMAIN" },
+	{ RCODE_IMPL, "NOTIMP" },
+	{ RCODE_REFUSE, "REFUSED" },
+	{ RCODE_YXDOMAIN, "YXDOMAIN" },
+	{ RCODE_YXRRSET, "YXRRSET" },
+	{ RCODE_NXRRSET, "NXRRSET" },
+	{ RCODE_NOTAUTH, "NOTAUTH" },
+	{ RCODE_NOTZONE, "NOTZONE" },
+	{ 0, NULL }
+};
+
+int
+dnstap_parse_rcodes(const char* str, uint32_t* mask)
+{
+	char buf[32];
+	lookup_table_type* rc;
+	char* end;
+	long v;
+	int n = 0, r;
+	while(dnstap_list_next(&str, buf, sizeof(buf))) {
+		if((rc = lookup_by_name(dnstap_rcode_table, buf)) != NULL) {
+			r = rc->id;
+		} else {
+			/* a number, no sign, the header has 4 bits for
+			 * the rcode */
+			if(buf[0] < '0' || buf[0] > '9')
+				return 0;
+			errno = 0;
+			v = strtol(buf, &end, 10);
+			if(errno != 0 || *end != 0 || v < 0 || v > 15)
+				return 0;
+			r = (int)v;
+		}
+		if(mask)
+			*mask |= (1<<r);
+		n++;
+	}
+	return n > 0 && *str == 0;
+}
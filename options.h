@@ -111,6 +111,8 @@ struct nsd_options {
 	int xfrd_reload_timeout;
 	int zonefiles_check;
 	int zonefiles_write;
+	/* number of processes that read zonefiles in parallel */
+	int zonefiles_load_workers;
 	int log_time_ascii;
 	int round_robin;
 	int minimal_responses;
@@ -120,6 +122,8 @@ struct nsd_options {
 	int xfrd_tcp_max;
 	/* max number of simultaneous requests on xfrd tcp socket */
 	int xfrd_tcp_pipeline;
+	/* size of the packed IXFR reply streams per server process */
+	size_t ixfr_pack_cache_size;
 
 	/* private key file for TLS */
 	char* tls_service_key;
@@ -159,6 +163,10 @@ struct nsd_options {
 	size_t rrl_ipv6_prefix_length;
 	/** max qps for whitelisted queries, 0 is nolimit */
 	size_t rrl_whitelist_ratelimit;
+	/** max qps for the queries from netblocks */
+	struct rrl_prefix_option* rrl_prefixes;
+	/** use token buckets with millisecond resolution */
+	int rrl_token_bucket;
 #endif
 	/** if dnstap is enabled */
 	int dnstap_enable;
@@ -176,6 +184,13 @@ struct nsd_options {
 	int dnstap_log_auth_query_messages;
 	/** true to log dnstap AUTH_RESPONSE message events */
 	int dnstap_log_auth_response_messages;
+	/** log one in this many queries with dnstap, 0 or 1 logs all */
+	int dnstap_sample_rate;
+	/** qtypes of the queries to log with dnstap, NULL logs all */
+	char* dnstap_log_qtypes;
+	/** rcodes of responses that are logged with dnstap, also when the
+	 * query is not sampled, NULL for none */
+	char* dnstap_log_rcodes;
 
 	/** do answer with server cookie when request contained cookie option */
 	int answer_cookie;
@@ -228,6 +243,14 @@ struct cpu_map_option {
 	int cpu;
 };
 
+struct rrl_prefix_option {
+	struct rrl_prefix_option* next;
+	/* the netblock, address/prefixlen */
+	char* address;
+	/* max qps, 0 is nolimit */
+	size_t ratelimit;
+};
+
 /*
  * Defines for min_expire_time_expr value
  */
@@ -286,6 +309,10 @@ struct pattern_options {
 	uint8_t ixfr_number_is_default;
 	uint8_t create_ixfr;
 	uint8_t create_ixfr_is_default;
+	uint8_t condense_ixfr;
+	uint8_t condense_ixfr_is_default;
+	uint8_t binary_ixfr;
+	uint8_t binary_ixfr_is_default;
 	uint8_t verify_zone;
 	uint8_t verify_zone_is_default;
 	char **verifier;
@@ -549,5 +576,11 @@ void warn_if_directory(const char* filetype, FILE* f, const char* fname);
  * and "control-interface:" into the ip-addresses associated with those
  * names. */
 void resolve_interface_names(struct nsd_options* options);
+/* parse the dnstap-log-qtypes list, set the types in bits (an array of
+ * 65536 bits) if not NULL.  Returns false on a parse error. */
+int dnstap_parse_qtypes(const char* str, uint8_t* bits);
+/* parse the dnstap-log-rcodes list, set the rcodes in mask if not NULL.
+ * Returns false on a parse error. */
+int dnstap_parse_rcodes(const char* str, uint32_t* mask);
 
 #endif /* OPTIONS_H */
@@ -251,6 +251,9 @@ query_reset(query_type *q, size_t maxlen, int is_tcp)
 	q->ixfr_count_oldsoa = 0;
 	q->ixfr_count_del = 0;
 	q->ixfr_count_add = 0;
+	q->ixfr_pack = NULL;
+	q->ixfr_pack_num = 0;
+	q->ixfr_pack_rec = NULL;
 
 #ifdef RATELIMIT
 	q->wildcard_domain = NULL;
@@ -18,6 +18,7 @@
 #include "packet.h"
 #include "tsig.h"
 struct ixfr_data;
+struct ixfr_pack;
 
 enum query_state {
 	QUERY_PROCESSED,
@@ -136,11 +137,22 @@ struct query {
 	size_t ixfr_count_add;
 	/* position for the end of SOA record, for UDP truncation */
 	size_t ixfr_pos_of_newsoa;
+	/* the packed reply stream the packets are copied from, or NULL */
+	struct ixfr_pack* ixfr_pack;
+	/* the next packet of the packed reply stream */
+	size_t ixfr_pack_num;
+	/* the packed reply stream that the packets of the query are
+	 * recorded in, for the next queries, or NULL */
+	struct ixfr_pack* ixfr_pack_rec;
 
 #ifdef RATELIMIT
 	/* if we encountered a wildcard, its domain */
 	domain_type *wildcard_domain;
 #endif
+#ifdef USE_DNSTAP
+	/* if the query is sampled for dnstap, the response is logged too */
+	int dnstap_sampled;
+#endif
 };
 
 
@@ -23,7 +23,7 @@ typedef struct region region_type;
  * mmap allocator constants
  *
  */
-#ifdef USE_MMAP_ALLOC
+#if defined(USE_MMAP_ALLOC) || defined(USE_NAMEDB_ARENA)
 
 /* header starts with size_t containing allocated size info and has at least 16 bytes to align the returned memory */
 #define MMAP_ALLOC_HEADER_SIZE (sizeof(size_t) >= 16 ? (sizeof(size_t)) : 16)
@@ -33,7 +33,17 @@ typedef struct region region_type;
 #define MMAP_ALLOC_LARGE_OBJECT_SIZE	(MMAP_ALLOC_CHUNK_SIZE / 8)
 #define MMAP_ALLOC_INITIAL_CLEANUP_SIZE	16
 
-#endif /* USE_MMAP_ALLOC */
+#endif /* USE_MMAP_ALLOC || USE_NAMEDB_ARENA */
+
+#ifdef USE_NAMEDB_ARENA
+/* the namedb arena uses slabs of 256 4kB pages, so that zone data is packed
+ * together and away from the transient heap allocations of the processes
+ * that share the pages after fork. Large objects use the mmap allocator
+ * limit, so that the recycle bin stays small. */
+#define NAMEDB_ARENA_CHUNK_SIZE		((256 * 4096) - MMAP_ALLOC_HEADER_SIZE)
+#define NAMEDB_ARENA_LARGE_OBJECT_SIZE	MMAP_ALLOC_LARGE_OBJECT_SIZE
+#define NAMEDB_ARENA_INITIAL_CLEANUP_SIZE	MMAP_ALLOC_INITIAL_CLEANUP_SIZE
+#endif /* USE_NAMEDB_ARENA */
 
 /*
  * Create a new region.
@@ -1069,7 +1069,7 @@ print_zonestatus(RES* ssl, xfrd_state_type* xfrd, struct zone_options* zo)
 		if(!print_soa_status(ssl, "notified-serial", &xz->soa_notified,
 			xz->soa_notified_acquired))
 			return 0;
-	} else if(xz->event_added) {
+	} else if(xz->event_added || (xz->zone_handler_flags&EV_TIMEOUT)) {
 		if(!ssl_printf(ssl, "\twait: \"%lu sec between attempts\"\n",
 			(unsigned long)xz->timeout.tv_sec))
 			return 0;
@@ -2673,6 +2673,21 @@ print_stat_block(RES* ssl, char* n, char* d, struct nsdst* st)
 	if(!ssl_printf(ssl, "%s%snum.rixfr=%lu\n", n, d, (unsigned long)st->rixfr))
 		return;
 
+	/* query-time NSEC3 hash cache */
+	if(!ssl_printf(ssl, "%s%snum.nsec3cache.hit=%lu\n", n, d,
+		(unsigned long)st->nsec3hit))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.nsec3cache.miss=%lu\n", n, d,
+		(unsigned long)st->nsec3miss))
+		return;
+
+#ifdef USE_DNSTAP
+	/* dnstap messages dropped by the server processes */
+	if(!ssl_printf(ssl, "%s%snum.dnstap.drop=%lu\n", n, d,
+		(unsigned long)st->dnstapdrop))
+		return;
+#endif
+
 	/* truncated */
 	if(!ssl_printf(ssl, "%s%snum.truncated=%lu\n", n, d,
 		(unsigned long)st->truncated))
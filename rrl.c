@@ -6,6 +6,7 @@
  */
 #include "config.h"
 #include <errno.h>
+#include <sys/time.h>
 #include "rrl.h"
 #include "util.h"
 #include "lookup3.h"
@@ -25,10 +26,14 @@
  * The rate limiting data structure bucket, this represents one rate of
  * packets from a single source.
  * Smoothed average rates.
+ * In token bucket mode, counter is the number of tokens in 1/1000 of a
+ * query, stamp is the time in milliseconds and rate is 1 when blocked.
  */
 struct rrl_bucket {
 	/* the source netmask */
 	uint64_t source;
+	/* the second half of an IPv6 source netmask, for the log */
+	uint64_t source_low;
 	/* rate, in queries per second, which due to rate=r(t)+r(t-1)/2 is
 	 * equal to double the queries per second */
 	uint32_t rate;
@@ -41,6 +46,14 @@ struct rrl_bucket {
 	int32_t stamp;
 	/* flags for the source mask and type */
 	uint16_t flags;
+	/* the source is blocked by the rate summed over the processes */
+	uint8_t shard_block;
+	/* the rate of the source in the other processes, at shard_stamp */
+	uint32_t shard_rate;
+	/* timestep of shard_rate, not the stamp if not computed */
+	int32_t shard_stamp;
+	/* prefix length of the source netmask, for the log */
+	uint8_t prefixlen;
 };
 
 /* the (global) array of RRL buckets */
@@ -50,12 +63,62 @@ static uint32_t rrl_ratelimit = RRL_LIMIT; /* 2x qps */
 static uint8_t rrl_slip_ratio = RRL_SLIP;
 static uint8_t rrl_ipv4_prefixlen = RRL_IPV4_PREFIX_LENGTH;
 static uint8_t rrl_ipv6_prefixlen = RRL_IPV6_PREFIX_LENGTH;
-static uint64_t rrl_ipv6_mask; /* max prefixlen 64 */
+static uint8_t rrl_ipv6_mask[16];
 static uint32_t rrl_whitelist_ratelimit = RRL_WLIST_LIMIT; /* 2x qps */
+static int rrl_token_bucket = 0;
 
 /* the array of mmaps for the children (saved between reloads) */
 static void** rrl_maps = NULL;
 static size_t rrl_maps_num = 0;
+/* the index of rrl_array in rrl_maps, or rrl_maps_num if not there */
+static size_t rrl_array_shard = 0;
+
+/** ratelimit for a netblock, from rrl-prefix-ratelimit */
+struct rrl_prefix {
+	/* the masked address */
+	uint8_t addr[16];
+	/* ratelimit, 2x qps, 0 is nolimit */
+	uint32_t limit;
+};
+
+/** the netblocks with the same address family and prefix length */
+struct rrl_prefix_group {
+	int family;
+	uint8_t prefixlen;
+	/* array sorted by address */
+	struct rrl_prefix* prefixes;
+	size_t num;
+};
+
+/* the netblocks, groups with the longest prefix length first */
+static struct rrl_prefix* rrl_prefixes = NULL;
+static struct rrl_prefix_group* rrl_prefix_groups = NULL;
+static size_t rrl_prefix_groups_num = 0;
+
+/** set the first prefixlen bits of the mask, of len bytes */
+static void rrl_make_mask(uint8_t* mask, size_t len, size_t prefixlen)
+{
+	size_t i;
+	for(i=0; i<len; i++) {
+		if(prefixlen >= 8) {
+			mask[i] = 0xff;
+			prefixlen -= 8;
+		} else {
+			mask[i] = (uint8_t)(0xff << (8-prefixlen));
+			prefixlen = 0;
+		}
+	}
+}
+
+/** and the address with the mask for the prefix length */
+static void rrl_mask_addr(uint8_t* addr, size_t len, size_t prefixlen)
+{
+	uint8_t mask[16];
+	size_t i;
+	rrl_make_mask(mask, len, prefixlen);
+	for(i=0; i<len; i++)
+		addr[i] &= mask[i];
+}
 
 void rrl_mmap_init(int numch, size_t numbuck, size_t lm, size_t wlm, size_t sm,
 	size_t plf, size_t pls)
@@ -69,12 +132,7 @@ void rrl_mmap_init(int numch, size_t numbuck, size_t lm, size_t wlm, size_t sm,
 	rrl_slip_ratio = sm;
 	rrl_ipv4_prefixlen = plf;
 	rrl_ipv6_prefixlen = pls;
-	if (pls <= 32) {
-		rrl_ipv6_mask = ((uint64_t) htonl(0xffffffff << (32-pls))) << 32;
-	} else {
-		rrl_ipv6_mask =  ((uint64_t) htonl(0xffffffff << (64-pls))) |
-			(((uint64_t)0xffffffff)<<32);
-	}
+	rrl_make_mask(rrl_ipv6_mask, sizeof(rrl_ipv6_mask), pls);
 	rrl_whitelist_ratelimit = wlm*2;
 #ifdef HAVE_MMAP
 	/* allocate the ratelimit hashtable in a memory map so it is
@@ -128,13 +186,194 @@ void rrl_set_limit(size_t lm, size_t wlm, size_t sm)
 	rrl_slip_ratio = sm;
 }
 
+void rrl_set_token_bucket(int on)
+{
+	rrl_token_bucket = on;
+}
+
+int rrl_prefix_parse(const char* str, int* family, uint8_t* addr,
+	uint8_t* prefixlen)
+{
+	char buf[128];
+	char* slash;
+	uint8_t a[16];
+	int f, len, maxlen;
+	if(strlcpy(buf, str, sizeof(buf)) >= sizeof(buf))
+		return 0;
+	slash = strchr(buf, '/');
+	if(slash)
+		*slash++ = 0;
+	memset(a, 0, sizeof(a));
+	if(inet_pton(AF_INET, buf, a) == 1) {
+		f = AF_INET;
+		maxlen = 32;
+#ifdef INET6
+	} else if(inet_pton(AF_INET6, buf, a) == 1) {
+		f = AF_INET6;
+		maxlen = 128;
+#endif
+	} else {
+		return 0;
+	}
+	len = maxlen;
+	if(slash) {
+		char* end;
+		long l = strtol(slash, &end, 10);
+		if(*slash == 0 || *end != 0 || l < 0 || l > maxlen)
+			return 0;
+		len = (int)l;
+	}
+	rrl_mask_addr(a, sizeof(a), (size_t)len);
+	if(family) *family = f;
+	if(addr) memmove(addr, a, sizeof(a));
+	if(prefixlen) *prefixlen = (uint8_t)len;
+	return 1;
+}
+
+/** netblock with its place in the config, used to sort the netblocks */
+struct rrl_prefix_sort {
+	int family;
+	uint8_t prefixlen;
+	size_t index;
+	struct rrl_prefix prefix;
+};
+
+/** sort on family, the longest prefix first, address, config order */
+static int rrl_prefix_sort_cmp(const void* x, const void* y)
+{
+	const struct rrl_prefix_sort* a = (const struct rrl_prefix_sort*)x;
+	const struct rrl_prefix_sort* b = (const struct rrl_prefix_sort*)y;
+	int c;
+	if(a->family != b->family)
+		return (a->family < b->family)?-1:1;
+	if(a->prefixlen != b->prefixlen)
+		return (a->prefixlen > b->prefixlen)?-1:1;
+	c = memcmp(a->prefix.addr, b->prefix.addr, sizeof(a->prefix.addr));
+	if(c != 0)
+		return c;
+	if(a->index != b->index)
+		return (a->index < b->index)?-1:1;
+	return 0;
+}
+
+void rrl_set_prefixes(struct rrl_prefix_option* list)
+{
+	struct rrl_prefix_option* p;
+	struct rrl_prefix_sort* s;
+	size_t num = 0, i, n = 0;
+
+	free(rrl_prefixes);
+	free(rrl_prefix_groups);
+	rrl_prefixes = NULL;
+	rrl_prefix_groups = NULL;
+	rrl_prefix_groups_num = 0;
+	for(p = list; p; p = p->next)
+		num++;
+	if(num == 0)
+		return;
+
+	s = (struct rrl_prefix_sort*)xalloc_array_zero(num, sizeof(*s));
+	for(p = list; p; p = p->next) {
+		if(!rrl_prefix_parse(p->address, &s[n].family,
+			s[n].prefix.addr, &s[n].prefixlen)) {
+			log_msg(LOG_ERR, "rrl-prefix-ratelimit: cannot parse %s",
+				p->address);
+			continue;
+		}
+		s[n].index = n;
+		s[n].prefix.limit = (uint32_t)p->ratelimit*2;
+		n++;
+	}
+	qsort(s, n, sizeof(*s), rrl_prefix_sort_cmp);
+
+	/* copy into the groups, if a netblock is listed twice the last
+	 * one in the config is used */
+	rrl_prefixes = (struct rrl_prefix*)xalloc_array_zero(num,
+		sizeof(struct rrl_prefix));
+	rrl_prefix_groups = (struct rrl_prefix_group*)xalloc_array_zero(num,
+		sizeof(struct rrl_prefix_group));
+	num = 0;
+	for(i=0; i<n; i++) {
+		struct rrl_prefix_group* g = NULL;
+		if(i+1 < n && s[i+1].family == s[i].family &&
+			s[i+1].prefixlen == s[i].prefixlen &&
+			memcmp(s[i+1].prefix.addr, s[i].prefix.addr,
+			sizeof(s[i].prefix.addr)) == 0)
+			continue;
+		if(rrl_prefix_groups_num > 0)
+			g = &rrl_prefix_groups[rrl_prefix_groups_num-1];
+		if(!g || g->family != s[i].family ||
+			g->prefixlen != s[i].prefixlen) {
+			g = &rrl_prefix_groups[rrl_prefix_groups_num++];
+			g->family = s[i].family;
+			g->prefixlen = s[i].prefixlen;
+			g->prefixes = &rrl_prefixes[num];
+			g->num = 0;
+		}
+		rrl_prefixes[num++] = s[i].prefix;
+		g->num++;
+	}
+	free(s);
+}
+
+int rrl_prefix_lookup(query_type* query, uint32_t* lm)
+{
+	uint8_t a[16], m[16];
+	int family;
+	size_t i, len;
+#ifdef INET6
+	family = ((struct sockaddr_in*)&query->addr)->sin_family;
+	if(family == AF_INET6) {
+		len = 16;
+		memmove(a, &((struct sockaddr_in6*)&query->addr)->sin6_addr,
+			len);
+	} else {
+		len = 4;
+		memmove(a, &((struct sockaddr_in*)&query->addr)->sin_addr,
+			len);
+	}
+#else
+	family = AF_INET;
+	len = 4;
+	memmove(a, &query->addr.sin_addr, len);
+#endif
+	memset(a+len, 0, sizeof(a)-len);
+
+	/* the groups have the longest prefix first, the first group with
+	 * a match has the longest matching prefix */
+	for(i=0; i<rrl_prefix_groups_num; i++) {
+		struct rrl_prefix_group* g = &rrl_prefix_groups[i];
+		size_t lo = 0, hi = g->num;
+		if(g->family != family)
+			continue;
+		memmove(m, a, sizeof(m));
+		rrl_mask_addr(m, len, g->prefixlen);
+		while(lo < hi) {
+			size_t mid = lo + (hi-lo)/2;
+			int c = memcmp(g->prefixes[mid].addr, m, len);
+			if(c == 0) {
+				*lm = g->prefixes[mid].limit;
+				return 1;
+			}
+			if(c < 0)
+				lo = mid+1;
+			else	hi = mid;
+		}
+	}
+	return 0;
+}
+
 void rrl_init(size_t ch)
 {
+	rrl_array_shard = rrl_maps_num;
 	if(!rrl_maps || ch >= rrl_maps_num)
 	    rrl_array = xalloc_array_zero(sizeof(struct rrl_bucket),
 	    	rrl_array_size);
 #ifdef HAVE_MMAP
-	else rrl_array = (struct rrl_bucket*)rrl_maps[ch];
+	else {
+		rrl_array = (struct rrl_bucket*)rrl_maps[ch];
+		rrl_array_shard = ch;
+	}
 #endif
 }
 
@@ -146,23 +385,32 @@ void rrl_deinit(size_t ch)
 }
 
 /** return the source netblock of the query, this is the genuine source
- * for genuine queries and the target for reflected packets */
-static uint64_t rrl_get_source(query_type* query, uint16_t* c2)
+ * for genuine queries and the target for reflected packets.  For IPv6
+ * prefixes longer than 64, the second half is returned in low, the
+ * bucket is selected with the hash over both halves. */
+static uint64_t rrl_get_source(query_type* query, uint16_t* c2, uint64_t* low)
 {
 	/* note there is an IPv6 subnet, that maps
 	 * to the same buckets as IPv4 space, but there is a flag in c2
 	 * that makes the hash different */
+	*low = 0;
 #ifdef INET6
 	if( ((struct sockaddr_in*)&query->addr)->sin_family == AF_INET) {
 		*c2 = 0;
 		return ((struct sockaddr_in*)&query->addr)->
 			sin_addr.s_addr & htonl(0xffffffff << (32-rrl_ipv4_prefixlen));
 	} else {
+		uint8_t a[16];
 		uint64_t s;
+		size_t i;
 		*c2 = rrl_ip6;
-		memmove(&s, &((struct sockaddr_in6*)&query->addr)->sin6_addr,
-			sizeof(s));
-		return s & rrl_ipv6_mask;
+		memmove(a, &((struct sockaddr_in6*)&query->addr)->sin6_addr,
+			sizeof(a));
+		for(i=0; i<sizeof(a); i++)
+			a[i] &= rrl_ipv6_mask[i];
+		memmove(&s, a, sizeof(s));
+		memmove(low, a+sizeof(s), sizeof(*low));
+		return s;
 	}
 #else
 	*c2 = 0;
@@ -170,8 +418,18 @@ static uint64_t rrl_get_source(query_type* query, uint16_t* c2)
 #endif
 }
 
+/** set the source in the bucket for the log, source has the first half
+ * and the hash of the bucket is made with the full source */
+static void rrl_bucket_source(struct rrl_bucket* b, query_type* query)
+{
+	uint16_t c2;
+	(void)rrl_get_source(query, &c2, &b->source_low);
+	b->prefixlen = (c2?rrl_ipv6_prefixlen:rrl_ipv4_prefixlen);
+}
+
 /** debug source to string */
-static const char* rrlsource2str(uint64_t s, uint16_t c2)
+static const char* rrlsource2str(uint64_t s, uint64_t low, uint16_t c2,
+	uint8_t prefixlen)
 {
 	static char buf[64];
 	struct in_addr a4;
@@ -181,17 +439,19 @@ static const char* rrlsource2str(uint64_t s, uint16_t c2)
 		struct in6_addr a6;
 		memset(&a6, 0, sizeof(a6));
 		memmove(&a6, &s, sizeof(s));
+		memmove(((uint8_t*)&a6)+sizeof(s), &low, sizeof(low));
 		if(!inet_ntop(AF_INET6, &a6, buf, sizeof(buf)))
 			strlcpy(buf, "[ip6 ntop failed]", sizeof(buf));
 		else {
 			static char prefix[5];
-			snprintf(prefix, sizeof(prefix), "/%d", rrl_ipv6_prefixlen);
+			snprintf(prefix, sizeof(prefix), "/%d", (int)prefixlen);
 			strlcat(buf, &prefix[0], sizeof(buf));
 		}
 		return buf;
 	}
 #else
 	(void)c2;
+	(void)low;
 #endif
 	/* ipv4 */
 	a4.s_addr = (uint32_t)s;
@@ -199,7 +459,7 @@ static const char* rrlsource2str(uint64_t s, uint16_t c2)
 		strlcpy(buf, "[ip4 ntop failed]", sizeof(buf));
 	else {
 		static char prefix[5];
-		snprintf(prefix, sizeof(prefix), "/%d", rrl_ipv4_prefixlen);
+		snprintf(prefix, sizeof(prefix), "/%d", (int)prefixlen);
 		strlcat(buf, &prefix[0], sizeof(buf));
 	}
 	return buf;
@@ -308,30 +568,36 @@ static void examine_query(query_type* query, uint32_t* hash, uint64_t* source,
 {
 	/* compile a binary string representing the query */
 	uint16_t c, c2;
+	uint64_t low;
 	/* size with 16 bytes to spare */
-	uint8_t buf[MAXDOMAINLEN + sizeof(*source) + sizeof(c) + 16];
+	uint8_t buf[MAXDOMAINLEN + sizeof(*source) + sizeof(low) + sizeof(c)
+		+ 16];
+	const size_t pre = sizeof(*source) + sizeof(low) + sizeof(c);
 	const uint8_t* dname = NULL; size_t dname_len = 0;
 	uint32_t r = 0x267fcd16;
 
-	*source = rrl_get_source(query, &c2);
+	*source = rrl_get_source(query, &c2, &low);
 	c = rrl_classify(query, &dname, &dname_len);
 	if(query->zone && query->zone->opts &&
 		(query->zone->opts->pattern->rrl_whitelist & c))
 		*lm = rrl_whitelist_ratelimit;
+	if(rrl_prefix_groups_num != 0)
+		(void)rrl_prefix_lookup(query, lm);
 	if(*lm == 0) return;
 	c |= c2;
 	*flags = c;
 	memmove(buf, source, sizeof(*source));
-	memmove(buf+sizeof(*source), &c, sizeof(c));
+	memmove(buf+sizeof(*source), &low, sizeof(low));
+	memmove(buf+sizeof(*source)+sizeof(low), &c, sizeof(c));
 
 	DEBUG(DEBUG_QUERY, 1, (LOG_INFO, "rrl_examine type %s name %s", rrltype2str(c), dname?wiredname2str(dname):"NULL"));
 
 	/* and hash it */
 	if(dname && dname_len <= MAXDOMAINLEN) {
-		memmove(buf+sizeof(*source)+sizeof(c), dname, dname_len);
-		*hash = hashlittle(buf, sizeof(*source)+sizeof(c)+dname_len, r);
+		memmove(buf+pre, dname, dname_len);
+		*hash = hashlittle(buf, pre+dname_len, r);
 	} else
-		*hash = hashlittle(buf, sizeof(*source)+sizeof(c), r);
+		*hash = hashlittle(buf, pre, r);
 }
 
 /* age the bucket because elapsed time steps have gone by */
@@ -356,18 +622,19 @@ rrl_msg(query_type* query, const char* str)
 	uint16_t c, c2, wl = 0;
 	const uint8_t* d = NULL;
 	size_t d_len;
-	uint64_t s;
+	uint64_t s, low;
 	char address[128];
 	if(verbosity < 1) return;
 	addr2str(&query->addr, address, sizeof(address));
-	s = rrl_get_source(query, &c2);
+	s = rrl_get_source(query, &c2, &low);
 	c = rrl_classify(query, &d, &d_len) | c2;
 	if(query->zone && query->zone->opts &&
 		(query->zone->opts->pattern->rrl_whitelist & c))
 		wl = 1;
 	log_msg(LOG_INFO, "ratelimit %s %s type %s%s target %s query %s %s",
 		str, d?wiredname2str(d):"", rrltype2str(c),
-		wl?"(whitelisted)":"", rrlsource2str(s, c2),
+		wl?"(whitelisted)":"", rrlsource2str(s, low, c2,
+		(c2?rrl_ipv6_prefixlen:rrl_ipv4_prefixlen)),
 		address, rrtype_to_string(query->qtype));
 }
 
@@ -397,16 +664,20 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 			addr2str(&query->addr, address, sizeof(address));
 			log_msg(LOG_INFO, "ratelimit unblock ~ type %s target %s query %s %s (%s collision)",
 				rrltype2str(b->flags),
-				rrlsource2str(b->source, b->flags),
+				rrlsource2str(b->source, b->source_low,
+				b->flags&rrl_ip6, b->prefixlen),
 				address, rrtype_to_string(query->qtype),
 				(b->hash!=hash?"bucket":"hash"));
 		}
 		b->hash = hash;
 		b->source = source;
+		rrl_bucket_source(b, query);
 		b->flags = flags;
 		b->counter = 1;
 		b->rate = 0;
 		b->stamp = now;
+		b->shard_block = 0;
+		b->shard_stamp = now-1;
 		return 1;
 	}
 	/* this is the same source */
@@ -453,15 +724,184 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 	return b->rate;
 }
 
-int rrl_process_query(query_type* query)
+/** number of processes, this one included, that had queries from the
+ * source in the last second, in token bucket mode */
+static uint32_t rrl_shards_active(uint32_t hash, uint64_t source,
+	uint16_t flags, int32_t now_ms)
+{
+	uint32_t active = 1;
+#ifdef HAVE_MMAP
+	size_t i, idx = hash % rrl_array_size;
+	for(i=0; i<rrl_maps_num; i++) {
+		struct rrl_bucket* b;
+		int32_t bstamp;
+		if(i == rrl_array_shard)
+			continue;
+		b = &((struct rrl_bucket*)rrl_maps[i])[idx];
+		if(b->source != source || b->flags != flags || b->hash != hash)
+			continue;
+		bstamp = b->stamp;
+		if(now_ms - bstamp < 1000 && bstamp - now_ms < 1000)
+			active++;
+	}
+#else
+	(void)hash; (void)source; (void)flags; (void)now_ms;
+#endif
+	return active;
+}
+
+/** the token bucket cap for qps, the counter is an uint32 */
+static uint64_t rrl_token_cap(uint32_t qps)
+{
+	uint64_t cap = (uint64_t)qps*1000;
+	return (cap > 0xffffffff ? 0xffffffff : cap);
+}
+
+/** update the token bucket, return true if it has no token for the query.
+ * The bucket holds up to the ratelimit in qps number of queries, and is
+ * refilled continuously with the ratelimit per second. */
+int rrl_update_token(query_type* query, uint32_t hash, uint64_t source,
+	uint16_t flags, int32_t now_ms, uint32_t lm)
+{
+	struct rrl_bucket* b = &rrl_array[hash % rrl_array_size];
+	/* lm is 2x qps, tokens are counted in 1/1000 of a query, and
+	 * the refill per millisecond is qps/1000 queries */
+	uint32_t qps = (lm/2 > 0 ? lm/2 : 1);
+	uint64_t cap = rrl_token_cap(qps);
+
+	/* check if different source */
+	if(b->source != source || b->flags != flags || b->hash != hash) {
+		b->hash = hash;
+		b->source = source;
+		rrl_bucket_source(b, query);
+		b->flags = flags;
+		b->counter = (uint32_t)(cap - 1000);
+		b->rate = 0;
+		b->stamp = now_ms;
+		return 0;
+	}
+	/* if this process used more than its share of the bucket, the
+	 * source is also seen by other processes, and the processes that
+	 * are active for the source share the refill and the cap */
+	if(rrl_array_shard < rrl_maps_num && rrl_maps_num > 1 &&
+		b->counter < cap - cap / rrl_maps_num) {
+		uint32_t active = rrl_shards_active(hash, source, flags,
+			now_ms);
+		if(active > 1) {
+			qps = (qps/active > 0 ? qps/active : 1);
+			cap = rrl_token_cap(qps);
+			if(b->counter > cap)
+				b->counter = (uint32_t)cap;
+		}
+	}
+	/* circular arith for time */
+	if(now_ms - b->stamp > 0) {
+		uint64_t t = (uint64_t)b->counter +
+			(uint64_t)(now_ms - b->stamp)*qps;
+		b->counter = (uint32_t)(t > cap ? cap : t);
+	} else if(now_ms != b->stamp) {
+		/* robust, timestamp from the future */
+		b->counter = (uint32_t)cap;
+	}
+	b->stamp = now_ms;
+
+	if(b->counter >= 1000) {
+		b->counter -= 1000;
+		if(b->rate) {
+			rrl_msg(query, "unblock");
+			b->rate = 0;
+		}
+		return 0;
+	}
+	if(!b->rate) {
+		rrl_msg(query, "block");
+		b->rate = 1;
+	}
+	return 1;
+}
+
+/** the rate of a bucket at time now, without changing the bucket */
+static uint32_t rrl_bucket_rate(uint32_t rate, uint32_t counter,
+	int32_t stamp, int32_t now)
+{
+	int32_t elapsed = now - stamp;
+	if(elapsed == 0) {
+		if(counter > rate/2)
+			return counter + rate/2;
+		return rate;
+	}
+	if(elapsed < 0 || elapsed > 16)
+		return 0;
+	if(elapsed == 1)
+		return rate/2 + counter;
+	return (rate>>elapsed) + (counter>>(elapsed-1));
+}
+
+/** The queries from one source are spread over the server processes,
+ * by the kernel with reuseport, and every process counts them in its own
+ * table.  Return the sum of the rates in the tables of the other
+ * processes for the bucket, those tables are read, not written, so the
+ * processes do not contend for the buckets.  The sum is made once per
+ * timestep and kept in the bucket of this process. */
+static uint32_t rrl_shards_rate(uint32_t hash, uint64_t source,
+	uint16_t flags, int32_t now)
+{
+	uint32_t rate = 0;
+#ifdef HAVE_MMAP
+	struct rrl_bucket* own = &rrl_array[hash % rrl_array_size];
+	size_t i, idx = hash % rrl_array_size;
+	if(own->shard_stamp == now)
+		return own->shard_rate;
+	for(i=0; i<rrl_maps_num; i++) {
+		struct rrl_bucket* b;
+		uint32_t brate, bcounter;
+		int32_t bstamp;
+		if(i == rrl_array_shard)
+			continue;
+		b = &((struct rrl_bucket*)rrl_maps[i])[idx];
+		if(b->source != source || b->flags != flags || b->hash != hash)
+			continue;
+		/* the other process can change the bucket concurrently,
+		 * the values are read once, and a stale or mixed value
+		 * changes the rate by the queries of one time step. */
+		brate = b->rate;
+		bcounter = b->counter;
+		bstamp = b->stamp;
+		rate += rrl_bucket_rate(brate, bcounter, bstamp, now);
+	}
+	own->shard_rate = rate;
+	own->shard_stamp = now;
+#else
+	(void)hash; (void)source; (void)flags; (void)now;
+#endif
+	return rate;
+}
+
+/** log when the rate summed over the processes starts and stops to block
+ * the source, once, like rrl_update does for the rate of this process. */
+static int rrl_shards_block(query_type* query, uint32_t hash, int block)
+{
+	struct rrl_bucket* b = &rrl_array[hash % rrl_array_size];
+	if(block && !b->shard_block) {
+		rrl_msg(query, "block");
+		b->shard_block = 1;
+	} else if(!block && b->shard_block) {
+		rrl_msg(query, "unblock");
+		b->shard_block = 0;
+	}
+	return block;
+}
+
+int rrl_process_query(query_type* query, uint32_t* now_p, uint64_t* now_ms_p)
 {
 	uint64_t source;
 	uint32_t hash;
 	/* we can use circular arithmetic here, so int32 works after 2038 */
-	int32_t now = (int32_t)time(NULL);
-	uint32_t lm = rrl_ratelimit;
+	int32_t now;
+	uint32_t lm = rrl_ratelimit, rate;
 	uint16_t flags;
-	if(rrl_ratelimit == 0 && rrl_whitelist_ratelimit == 0)
+	if(rrl_ratelimit == 0 && rrl_whitelist_ratelimit == 0 &&
+		rrl_prefix_groups_num == 0)
 		return 0;
 
 	/* examine query */
@@ -470,8 +910,29 @@ int rrl_process_query(query_type* query)
 	if(lm == 0)
 		return 0; /* no limit for this */
 
+	if(rrl_token_bucket) {
+		if(*now_ms_p == 0) {
+			struct timeval tv;
+			if(gettimeofday(&tv, NULL) == -1) {
+				tv.tv_sec = time(NULL);
+				tv.tv_usec = 0;
+			}
+			*now_ms_p = ((uint64_t)tv.tv_sec)*1000 +
+				(uint64_t)tv.tv_usec/1000;
+		}
+		return rrl_update_token(query, hash, source, flags,
+			(int32_t)*now_ms_p, lm);
+	}
+	now = (int32_t)(*now_p ? *now_p : (*now_p = (uint32_t)time(NULL)));
+
 	/* update rate */
-	return (rrl_update(query, hash, source, flags, now, lm) >= lm);
+	rate = rrl_update(query, hash, source, flags, now, lm);
+	if(rate >= lm)
+		return 1;
+	/* the total over the processes could be over the limit */
+	if(rrl_array_shard < rrl_maps_num && rrl_maps_num > 1)
+		rate += rrl_shards_rate(hash, source, flags, now);
+	return rrl_shards_block(query, hash, rate >= lm);
 }
 
 query_state_type rrl_slip(query_type* query)
@@ -62,9 +62,11 @@ void rrl_mmap_deinit_keep_mmap(void);
 /**
  * Process query that happens, the query structure contains the
  * information about the query and the answer.
+ * now_p and now_ms_p are the time in seconds and in milliseconds, if 0
+ * the time is fetched and stored there, for the other queries of the batch.
  * returns true if the query is ratelimited.
  */
-int rrl_process_query(query_type* query);
+int rrl_process_query(query_type* query, uint32_t* now_p, uint64_t* now_ms_p);
 
 /**
  * Deny the query, with slip.
@@ -82,5 +84,24 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 	uint16_t flags, int32_t now, uint32_t lm);
 /** set the rate limit counters, pass variables in qps */
 void rrl_set_limit(size_t lm, size_t wlm, size_t sm);
+/** set if token buckets with millisecond resolution are used */
+void rrl_set_token_bucket(int on);
+/** for unit test, update rrl token bucket; return true if limited */
+int rrl_update_token(query_type* query, uint32_t hash, uint64_t source,
+	uint16_t flags, int32_t now_ms, uint32_t lm);
+
+struct rrl_prefix_option;
+/**
+ * Parse the address or address/prefixlen of a rrl-prefix-ratelimit.
+ * family (AF_INET or AF_INET6), addr (16 bytes, masked) and prefixlen
+ * are returned if not NULL.  Returns false on a parse failure.
+ */
+int rrl_prefix_parse(const char* str, int* family, uint8_t* addr,
+	uint8_t* prefixlen);
+/** set the rate limits for netblocks, pass rrl-prefix-ratelimit list */
+void rrl_set_prefixes(struct rrl_prefix_option* list);
+/** for unit test, lookup the rate limit for the query source, with the
+ * longest prefix match.  Returns false if no netblock matches. */
+int rrl_prefix_lookup(query_type* query, uint32_t* lm);
 
 #endif /* RRL_H */
@@ -82,6 +82,7 @@
 #include "lookup3.h"
 #include "rrl.h"
 #include "ixfr.h"
+#include "iterated_hash.h"
 #ifdef USE_DNSTAP
 #include "dnstap/dnstap_collector.h"
 #endif
@@ -1435,8 +1436,16 @@ server_prepare(struct nsd *nsd)
 		nsd->options->rrl_slip,
 		nsd->options->rrl_ipv4_prefix_length,
 		nsd->options->rrl_ipv6_prefix_length);
+	rrl_set_prefixes(nsd->options->rrl_prefixes);
+	rrl_set_token_bucket(nsd->options->rrl_token_bucket);
 #endif /* RATELIMIT */
 
+#ifdef NSEC3
+	nsec3_set_precompile_workers(nsd->options->zonefiles_load_workers);
+#ifdef BIND8_STATS
+	nsec3_set_hash_cache_stats(&nsd->st);
+#endif
+#endif
 	/* Open the database... */
 	if ((nsd->db = namedb_open(nsd->dbfile, nsd->options)) == NULL) {
 		log_msg(LOG_ERR, "unable to open the database %s: %s",
@@ -1536,6 +1545,9 @@ server_shutdown(struct nsd *nsd)
 	}
 
 	tsig_finalize();
+#ifdef NSEC3
+	iterated_hash_cleanup();
+#endif
 #ifdef HAVE_SSL
 	daemon_remote_delete(nsd->rc); /* ssl-delete secret keys */
 	if (nsd->tls_ctx)
@@ -2882,18 +2894,20 @@ server_process_query(struct nsd *nsd, struct query *query, uint32_t *now_p)
 }
 
 static query_state_type
-server_process_query_udp(struct nsd *nsd, struct query *query, uint32_t *now_p)
+server_process_query_udp(struct nsd *nsd, struct query *query, uint32_t *now_p,
+	uint64_t *now_ms_p)
 {
 #ifdef RATELIMIT
 	if(query_process(query, nsd, now_p) != QUERY_DISCARDED) {
 		if(query->edns.cookie_status != COOKIE_VALID
 		&& query->edns.cookie_status != COOKIE_VALID_REUSE
-		&& rrl_process_query(query))
+		&& rrl_process_query(query, now_p, now_ms_p))
 			return rrl_slip(query);
 		else	return QUERY_PROCESSED;
 	}
 	return QUERY_DISCARDED;
 #else
+	(void)now_ms_p;
 	return query_process(query, nsd, now_p);
 #endif
 }
@@ -3584,6 +3598,7 @@ handle_udp(int fd, short event, void* arg)
 	int received, sent, recvcount, i;
 	struct query *q;
 	uint32_t now = 0;
+	uint64_t now_ms = 0;
 
 	if (!(event & EV_READ)) {
 		return;
@@ -3639,11 +3654,12 @@ handle_udp(int fd, short event, void* arg)
 		log_addr("query from client", &q->addr);
 		log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
 		dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &q->addr, q->addrlen,
-			q->tcp, q->packet);
+			q->tcp, q->packet, &q->dnstap_sampled);
 #endif /* USE_DNSTAP */
 
 		/* Process and answer the query... */
-		if (server_process_query_udp(data->nsd, q, &now) != QUERY_DISCARDED) {
+		if (server_process_query_udp(data->nsd, q, &now, &now_ms)
+			!= QUERY_DISCARDED) {
 			if (RCODE(q->packet) == RCODE_OK && !AA(q->packet)) {
 				STATUP(data->nsd, nona);
 				ZTATUP(data->nsd, q->zone, nona);
@@ -3656,31 +3672,6 @@ handle_udp(int fd, short event, void* arg)
 				ZTATUP(data->nsd, q->zone, qudp6);
 			}
 #endif
-
-			/* Add EDNS0 and TSIG info if necessary.  */
-			query_add_optional(q, data->nsd, &now);
-
-			buffer_flip(q->packet);
-			iovecs[i].iov_len = buffer_remaining(q->packet);
-#ifdef BIND8_STATS
-			/* Account the rcode & TC... */
-			STATUP2(data->nsd, rcode, RCODE(q->packet));
-			ZTATUP2(data->nsd, q->zone, rcode, RCODE(q->packet));
-			if (TC(q->packet)) {
-				STATUP(data->nsd, truncated);
-				ZTATUP(data->nsd, q->zone, truncated);
-			}
-#endif /* BIND8_STATS */
-#ifdef USE_DNSTAP
-			/*
-			 * sending UDP-response with server address (local) and client address to dnstap process
-			 */
-			log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
-			log_addr("response to client", &q->addr);
-			dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr,
-				&q->addr, q->addrlen, q->tcp, q->packet,
-				q->zone);
-#endif /* USE_DNSTAP */
 		} else {
 			query_reset(queries[i], UDP_MAX_MESSAGE_LEN, 0);
 			iovecs[i].iov_len = buffer_remaining(q->packet);
@@ -3706,6 +3697,39 @@ handle_udp(int fd, short event, void* arg)
 		}
 	}
 
+	/* The queries that are answered are at the start of the batch,
+	 * make the server cookies for their answers together */
+	if (data->nsd->do_answer_cookie)
+		cookie_create_batch(queries, recvcount, data->nsd, &now);
+	for (i = 0; i < recvcount; i++) {
+		q = queries[i];
+
+		/* Add EDNS0 and TSIG info if necessary.  */
+		query_add_optional(q, data->nsd, &now);
+
+		buffer_flip(q->packet);
+		iovecs[i].iov_len = buffer_remaining(q->packet);
+#ifdef BIND8_STATS
+		/* Account the rcode & TC... */
+		STATUP2(data->nsd, rcode, RCODE(q->packet));
+		ZTATUP2(data->nsd, q->zone, rcode, RCODE(q->packet));
+		if (TC(q->packet)) {
+			STATUP(data->nsd, truncated);
+			ZTATUP(data->nsd, q->zone, truncated);
+		}
+#endif /* BIND8_STATS */
+#ifdef USE_DNSTAP
+		/*
+		 * sending UDP-response with server address (local) and client address to dnstap process
+		 */
+		log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
+		log_addr("response to client", &q->addr);
+		dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr,
+			&q->addr, q->addrlen, q->tcp, q->packet,
+			q->zone, q->dnstap_sampled);
+#endif /* USE_DNSTAP */
+	}
+
 	/* send until all are sent */
 	i = 0;
 	while(i<recvcount) {
@@ -3999,7 +4023,8 @@ handle_tcp_reading(int fd, short event, void* arg)
 	log_addr("query from client", &data->query->addr);
 	log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
 	dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->addr,
-		data->query->addrlen, data->query->tcp, data->query->packet);
+		data->query->addrlen, data->query->tcp, data->query->packet,
+		&data->query->dnstap_sampled);
 #endif /* USE_DNSTAP */
 	data->query_state = server_process_query(data->nsd, data->query, &now);
 	if (data->query_state == QUERY_DISCARDED) {
@@ -4053,7 +4078,7 @@ handle_tcp_reading(int fd, short event, void* arg)
 	log_addr("response to client", &data->query->addr);
 	dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->addr,
 		data->query->addrlen, data->query->tcp, data->query->packet,
-		data->query->zone);
+		data->query->zone, data->query->dnstap_sampled);
 #endif /* USE_DNSTAP */
 	data->bytes_transmitted = 0;
 
@@ -4492,7 +4517,8 @@ handle_tls_reading(int fd, short event, void* arg)
 	log_addr("query from client", &data->query->addr);
 	log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
 	dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->addr,
-		data->query->addrlen, data->query->tcp, data->query->packet);
+		data->query->addrlen, data->query->tcp, data->query->packet,
+		&data->query->dnstap_sampled);
 #endif /* USE_DNSTAP */
 	data->query_state = server_process_query(data->nsd, data->query, &now);
 	if (data->query_state == QUERY_DISCARDED) {
@@ -4546,7 +4572,7 @@ handle_tls_reading(int fd, short event, void* arg)
 	log_addr("response to client", &data->query->addr);
 	dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->addr,
 		data->query->addrlen, data->query->tcp, data->query->packet,
-		data->query->zone);
+		data->query->zone, data->query->dnstap_sampled);
 #endif /* USE_DNSTAP */
 	data->bytes_transmitted = 0;
 
@@ -168,3 +168,92 @@ int siphash(const uint8_t *in, const size_t inlen, const uint8_t *k,
 
     return 0;
 }
+
+/* SipHash-2-4 with 8 byte output of two inputs of the same length with
+ * the same key.  The rounds of the two inputs are interleaved, so the
+ * cpu can execute them in parallel, and the key is loaded once.  The
+ * cROUNDS and dROUNDS rounds are written out. */
+#define SIPROUND2                                                              \
+    do {                                                                       \
+        v0 += v1;                                                              \
+        w0 += w1;                                                              \
+        v1 = ROTL(v1, 13);                                                     \
+        w1 = ROTL(w1, 13);                                                     \
+        v1 ^= v0;                                                              \
+        w1 ^= w0;                                                              \
+        v0 = ROTL(v0, 32);                                                     \
+        w0 = ROTL(w0, 32);                                                     \
+        v2 += v3;                                                              \
+        w2 += w3;                                                              \
+        v3 = ROTL(v3, 16);                                                     \
+        w3 = ROTL(w3, 16);                                                     \
+        v3 ^= v2;                                                              \
+        w3 ^= w2;                                                              \
+        v0 += v3;                                                              \
+        w0 += w3;                                                              \
+        v3 = ROTL(v3, 21);                                                     \
+        w3 = ROTL(w3, 21);                                                     \
+        v3 ^= v0;                                                              \
+        w3 ^= w0;                                                              \
+        v2 += v1;                                                              \
+        w2 += w1;                                                              \
+        v1 = ROTL(v1, 17);                                                     \
+        w1 = ROTL(w1, 17);                                                     \
+        v1 ^= v2;                                                              \
+        w1 ^= w2;                                                              \
+        v2 = ROTL(v2, 32);                                                     \
+        w2 = ROTL(w2, 32);                                                     \
+    } while (0)
+
+int siphash_x2(const uint8_t *in1, const uint8_t *in2, const size_t inlen,
+            const uint8_t *k, uint8_t *out1, uint8_t *out2) {
+    uint64_t k0 = U8TO64_LE(k);
+    uint64_t k1 = U8TO64_LE(k + 8);
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+    uint64_t w0 = v0, w1 = v1, w2 = v2, w3 = v3;
+    uint64_t m, n;
+    size_t pos, i;
+    const size_t end = inlen - (inlen % sizeof(uint64_t));
+    uint64_t b = ((uint64_t)inlen) << 56;
+    uint64_t c = b;
+
+    for (pos = 0; pos != end; pos += 8) {
+        m = U8TO64_LE(in1 + pos);
+        n = U8TO64_LE(in2 + pos);
+        v3 ^= m;
+        w3 ^= n;
+        SIPROUND2;
+        SIPROUND2;
+        v0 ^= m;
+        w0 ^= n;
+    }
+
+    for (i = 0; pos + i < inlen; i++) {
+        b |= ((uint64_t)in1[pos + i]) << (8 * i);
+        c |= ((uint64_t)in2[pos + i]) << (8 * i);
+    }
+
+    v3 ^= b;
+    w3 ^= c;
+    SIPROUND2;
+    SIPROUND2;
+    v0 ^= b;
+    w0 ^= c;
+
+    v2 ^= 0xff;
+    w2 ^= 0xff;
+    SIPROUND2;
+    SIPROUND2;
+    SIPROUND2;
+    SIPROUND2;
+
+    b = v0 ^ v1 ^ v2 ^ v3;
+    U64TO8_LE(out1, b);
+    c = w0 ^ w1 ^ w2 ^ w3;
+    U64TO8_LE(out2, c);
+
+    return 0;
+}
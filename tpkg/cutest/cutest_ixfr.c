@@ -0,0 +1,503 @@
+/*
+	test ixfr.c
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "tpkg/cutest/cutest.h"
+#include "region-allocator.h"
+#include "util.h"
+#include "nsd.h"
+#include "options.h"
+#include "ixfr.h"
+
+static void ixfr_condense_1(CuTest *tc);
+static void ixfr_condense_2(CuTest *tc);
+static void ixfr_binary_1(CuTest *tc);
+static void ixfr_binary_2(CuTest *tc);
+
+char* udbtest_get_temp_file(char* suffix);
+
+CuSuite* reg_cutest_ixfr(void)
+{
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, ixfr_condense_1);
+	SUITE_ADD_TEST(suite, ixfr_condense_2);
+	SUITE_ADD_TEST(suite, ixfr_binary_1);
+	SUITE_ADD_TEST(suite, ixfr_binary_2);
+	return suite;
+}
+
+/* a section of uncompressed wireformat RRs */
+struct section {
+	uint8_t* data;
+	size_t len;
+};
+
+/* append the domain name in text to the buffer, the case is kept */
+static void
+append_name(uint8_t* buf, size_t* len, const char* name)
+{
+	while(*name) {
+		const char* dot = strchr(name, '.');
+		size_t lablen = dot?(size_t)(dot-name):strlen(name);
+		buf[(*len)++] = (uint8_t)lablen;
+		memcpy(buf+*len, name, lablen);
+		*len += lablen;
+		name += lablen;
+		if(*name == '.')
+			name++;
+	}
+	buf[(*len)++] = 0;
+}
+
+/* append an RR to the section, the rdata is the text for the type */
+static void
+append_rr(struct section* sec, const char* owner, uint16_t type,
+	const char* rdata)
+{
+	uint8_t rr[1024];
+	size_t len = 0, rdpos;
+	append_name(rr, &len, owner);
+	write_uint16(rr+len, type);
+	write_uint16(rr+len+2, CLASS_IN);
+	write_uint32(rr+len+4, 3600);
+	len += 8;
+	rdpos = len;
+	len += 2;
+	if(type == TYPE_A) {
+		if(inet_pton(AF_INET, rdata, rr+len) != 1)
+			abort();
+		len += 4;
+	} else if(type == TYPE_MX) {
+		write_uint16(rr+len, (uint16_t)atoi(rdata));
+		len += 2;
+		append_name(rr, &len, strchr(rdata, ' ')+1);
+	} else if(type == TYPE_SOA) {
+		append_name(rr, &len, "ns.example.org.");
+		append_name(rr, &len, "hostmaster.example.org.");
+		write_uint32(rr+len, (uint32_t)atol(rdata));
+		write_uint32(rr+len+4, 28800);
+		write_uint32(rr+len+8, 7200);
+		write_uint32(rr+len+12, 604800);
+		write_uint32(rr+len+16, 3600);
+		len += 20;
+	} else {
+		/* NS, CNAME, a domain name */
+		append_name(rr, &len, rdata);
+	}
+	write_uint16(rr+rdpos, (uint16_t)(len-rdpos-2));
+	sec->data = xrealloc(sec->data, sec->len+len);
+	memcpy(sec->data+sec->len, rr, len);
+	sec->len += len;
+}
+
+/* make the ixfr data from old to new, the sections get the new SOA */
+static struct ixfr_data*
+make_data(uint32_t oldserial, uint32_t newserial, struct section* del,
+	struct section* add)
+{
+	struct ixfr_data* data = xalloc_zero(sizeof(*data));
+	struct section soa;
+	char buf[32];
+	data->oldserial = oldserial;
+	data->newserial = newserial;
+	memset(&soa, 0, sizeof(soa));
+	snprintf(buf, sizeof(buf), "%u", (unsigned)oldserial);
+	append_rr(&soa, "example.org.", TYPE_SOA, buf);
+	data->oldsoa = soa.data;
+	data->oldsoa_len = soa.len;
+	memset(&soa, 0, sizeof(soa));
+	snprintf(buf, sizeof(buf), "%u", (unsigned)newserial);
+	append_rr(&soa, "example.org.", TYPE_SOA, buf);
+	data->newsoa = soa.data;
+	data->newsoa_len = soa.len;
+	append_rr(del, "example.org.", TYPE_SOA, buf);
+	append_rr(add, "example.org.", TYPE_SOA, buf);
+	data->del = del->data;
+	data->del_len = del->len;
+	data->add = add->data;
+	data->add_len = add->len;
+	return data;
+}
+
+/* the section must be the RRs in expect, followed by the SOA */
+static void
+check_section(CuTest* tc, const char* desc, uint8_t* data, size_t len,
+	struct section* expect, uint32_t serial)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%u", (unsigned)serial);
+	append_rr(expect, "example.org.", TYPE_SOA, buf);
+	CuAssert(tc, desc, len == expect->len &&
+		memcmp(data, expect->data, len) == 0);
+	free(expect->data);
+}
+
+/* An RR that is added and then deleted cancels out, and so does an RR
+ * that is deleted and added back. An RR that is re-added after it
+ * cancelled out is in the change again. */
+static void ixfr_condense_1(CuTest *tc)
+{
+	struct nsd nsd;
+	struct zone_ixfr* ixfr;
+	struct ixfr_data* d1, *d2, *d3, *c;
+	struct section del, add, expect;
+	memset(&nsd, 0, sizeof(nsd));
+	nsd.region = region_create(xalloc, free);
+	ixfr = zone_ixfr_create(&nsd);
+
+	/* 1 to 2 */
+	memset(&del, 0, sizeof(del));
+	memset(&add, 0, sizeof(add));
+	append_rr(&del, "old.example.org.", TYPE_A, "10.0.0.1");
+	append_rr(&del, "gone.example.org.", TYPE_A, "10.0.0.2");
+	append_rr(&add, "www.example.org.", TYPE_A, "10.0.0.3");
+	append_rr(&add, "tmp.example.org.", TYPE_A, "10.0.0.4");
+	d1 = make_data(1, 2, &del, &add);
+	zone_ixfr_add(ixfr, d1, 1);
+	/* 2 to 3 */
+	memset(&del, 0, sizeof(del));
+	memset(&add, 0, sizeof(add));
+	append_rr(&del, "www.example.org.", TYPE_A, "10.0.0.3");
+	append_rr(&del, "tmp.example.org.", TYPE_A, "10.0.0.4");
+	append_rr(&add, "new.example.org.", TYPE_A, "10.0.0.5");
+	d2 = make_data(2, 3, &del, &add);
+	zone_ixfr_add(ixfr, d2, 1);
+	/* 3 to 4 */
+	memset(&del, 0, sizeof(del));
+	memset(&add, 0, sizeof(add));
+	append_rr(&add, "old.example.org.", TYPE_A, "10.0.0.1");
+	append_rr(&add, "www.example.org.", TYPE_A, "10.0.0.3");
+	d3 = make_data(3, 4, &del, &add);
+	zone_ixfr_add(ixfr, d3, 1);
+
+	c = ixfr_condensed_create(ixfr, d1, d3);
+	CuAssert(tc, "condensed", c != NULL);
+	CuAssert(tc, "oldserial", c->oldserial == 1);
+	CuAssert(tc, "newserial", c->newserial == 4);
+	CuAssert(tc, "oldsoa", c->oldsoa == d1->oldsoa);
+	CuAssert(tc, "newsoa", c->newsoa == d3->newsoa);
+	/* old is deleted and added back, www is added, deleted and added
+	 * again, tmp is added and deleted */
+	memset(&expect, 0, sizeof(expect));
+	append_rr(&expect, "gone.example.org.", TYPE_A, "10.0.0.2");
+	check_section(tc, "del section", c->del, c->del_len, &expect, 4);
+	memset(&expect, 0, sizeof(expect));
+	append_rr(&expect, "new.example.org.", TYPE_A, "10.0.0.5");
+	append_rr(&expect, "www.example.org.", TYPE_A, "10.0.0.3");
+	check_section(tc, "add section", c->add, c->add_len, &expect, 4);
+	ixfr_condensed_free(c);
+
+	/* from the middle version */
+	c = ixfr_condensed_create(ixfr, d2, d3);
+	CuAssert(tc, "condensed", c != NULL);
+	CuAssert(tc, "oldserial", c->oldserial == 2);
+	memset(&expect, 0, sizeof(expect));
+	append_rr(&expect, "tmp.example.org.", TYPE_A, "10.0.0.4");
+	check_section(tc, "del section", c->del, c->del_len, &expect, 4);
+	memset(&expect, 0, sizeof(expect));
+	append_rr(&expect, "new.example.org.", TYPE_A, "10.0.0.5");
+	append_rr(&expect, "old.example.org.", TYPE_A, "10.0.0.1");
+	check_section(tc, "add section", c->add, c->add_len, &expect, 4);
+	ixfr_condensed_free(c);
+
+	zone_ixfr_free(ixfr);
+	region_destroy(nsd.region);
+}
+
+/* The owner names and the domain names in the rdata compare case
+ * insensitive, other rdata compares exactly. */
+static void ixfr_condense_2(CuTest *tc)
+{
+	struct nsd nsd;
+	struct zone_ixfr* ixfr;
+	struct ixfr_data* d1, *d2, *c;
+	struct section del, add, expect;
+	memset(&nsd, 0, sizeof(nsd));
+	nsd.region = region_create(xalloc, free);
+	ixfr = zone_ixfr_create(&nsd);
+
+	memset(&del, 0, sizeof(del));
+	memset(&add, 0, sizeof(add));
+	append_rr(&add, "WWW.Example.ORG.", TYPE_A, "10.0.0.3");
+	append_rr(&add, "example.org.", TYPE_MX, "10 Mail.Example.org.");
+	append_rr(&add, "example.org.", TYPE_NS, "ns2.example.org.");
+	append_rr(&add, "alias.example.org.", TYPE_CNAME, "www.example.org.");
+	d1 = make_data(10, 11, &del, &add);
+	zone_ixfr_add(ixfr, d1, 1);
+	memset(&del, 0, sizeof(del));
+	memset(&add, 0, sizeof(add));
+	append_rr(&del, "www.example.org.", TYPE_A, "10.0.0.3");
+	append_rr(&del, "EXAMPLE.org.", TYPE_MX, "10 mail.example.ORG.");
+	append_rr(&del, "example.org.", TYPE_NS, "NS2.example.org.");
+	/* not the same rdata, in the other case */
+	append_rr(&del, "alias.example.org.", TYPE_CNAME, "ftp.example.org.");
+	append_rr(&del, "example.org.", TYPE_MX, "20 mail.example.org.");
+	d2 = make_data(11, 12, &del, &add);
+	zone_ixfr_add(ixfr, d2, 1);
+
+	c = ixfr_condensed_create(ixfr, d1, d2);
+	CuAssert(tc, "condensed", c != NULL);
+	memset(&expect, 0, sizeof(expect));
+	append_rr(&expect, "alias.example.org.", TYPE_CNAME, "ftp.example.org.");
+	append_rr(&expect, "example.org.", TYPE_MX, "20 mail.example.org.");
+	check_section(tc, "del section", c->del, c->del_len, &expect, 12);
+	memset(&expect, 0, sizeof(expect));
+	append_rr(&expect, "alias.example.org.", TYPE_CNAME, "www.example.org.");
+	check_section(tc, "add section", c->add, c->add_len, &expect, 12);
+	ixfr_condensed_free(c);
+
+	zone_ixfr_free(ixfr);
+	region_destroy(nsd.region);
+}
+
+/* make the zone example.org. at the serial in the db, to write and read
+ * the ixfr files of */
+static struct zone*
+make_zone(struct namedb* db, uint32_t serial, int binary_ixfr)
+{
+	region_type* region = db->region;
+	struct zone* zone = region_alloc_zero(region, sizeof(*zone));
+	rr_type* rr = region_alloc_zero(region, sizeof(*rr));
+	uint16_t* serial_data = region_alloc_zero(region, 3*sizeof(uint16_t));
+	zone->opts = zone_options_create(region);
+	zone->opts->name = region_strdup(region, "example.org");
+	zone->opts->pattern = pattern_options_create(region);
+	zone->opts->pattern->binary_ixfr = binary_ixfr;
+	zone->apex = domain_table_insert(db->domains,
+		dname_parse(region, "example.org."));
+	/* only the serial of the SOA is used, it is the third rdata */
+	serial_data[0] = 4;
+	write_uint32(serial_data+1, serial);
+	rr->owner = zone->apex;
+	rr->type = TYPE_SOA;
+	rr->klass = CLASS_IN;
+	rr->rdata_count = 3;
+	rr->rdatas = region_alloc_zero(region, 3*sizeof(rdata_atom_type));
+	rr->rdatas[2].data = serial_data;
+	zone->soa_rrset = region_alloc_zero(region, sizeof(rrset_type));
+	zone->soa_rrset->zone = zone;
+	zone->soa_rrset->rrs = rr;
+	zone->soa_rrset->rr_count = 1;
+	return zone;
+}
+
+/* the ixfr data from 5 to 6, with a log string, it is stored in the
+ * ixfr to free it later */
+static struct ixfr_data*
+make_data_5_6(struct zone_ixfr* written)
+{
+	struct section del, add;
+	struct ixfr_data* data;
+	memset(&del, 0, sizeof(del));
+	memset(&add, 0, sizeof(add));
+	append_rr(&del, "old.example.org.", TYPE_A, "10.0.0.1");
+	append_rr(&del, "example.org.", TYPE_MX, "10 mail.example.org.");
+	append_rr(&add, "www.example.org.", TYPE_A, "10.0.0.3");
+	append_rr(&add, "example.org.", TYPE_NS, "ns2.example.org.");
+	append_rr(&add, "alias.example.org.", TYPE_CNAME, "www.example.org.");
+	data = make_data(5, 6, &del, &add);
+	data->log_str = xstrdup("transfer from 192.0.2.1");
+	zone_ixfr_add(written, data, 1);
+	return data;
+}
+
+/* read the ixfr file back into the zone, returns the data or NULL */
+static struct ixfr_data*
+read_back(struct nsd* nsd, struct zone* zone, const char* zfile)
+{
+	if(!zone->ixfr)
+		zone->ixfr = zone_ixfr_create(nsd);
+	ixfr_read_from_file(nsd, zone, zfile);
+	if(zone->ixfr->data->count != 1)
+		return NULL;
+	return zone_ixfr_find_serial(zone->ixfr, 5);
+}
+
+/* the data read back must be the data that was written */
+static void
+check_data(CuTest* tc, struct ixfr_data* r, struct ixfr_data* data)
+{
+	CuAssert(tc, "read back", r != NULL);
+	CuAssert(tc, "serials", r->oldserial == data->oldserial &&
+		r->newserial == data->newserial);
+	CuAssert(tc, "newsoa", r->newsoa_len == data->newsoa_len &&
+		memcmp(r->newsoa, data->newsoa, r->newsoa_len) == 0);
+	CuAssert(tc, "oldsoa", r->oldsoa_len == data->oldsoa_len &&
+		memcmp(r->oldsoa, data->oldsoa, r->oldsoa_len) == 0);
+	CuAssert(tc, "del section", r->del_len == data->del_len &&
+		memcmp(r->del, data->del, r->del_len) == 0);
+	CuAssert(tc, "add section", r->add_len == data->add_len &&
+		memcmp(r->add, data->add, r->add_len) == 0);
+	CuAssert(tc, "file num", r->file_num == 1);
+}
+
+/* The binary file reads back the data that was written, and it is the
+ * same data as the text file reads back. */
+static void ixfr_binary_1(CuTest *tc)
+{
+	struct nsd nsd;
+	struct namedb* db;
+	struct zone* zone;
+	struct zone_ixfr* written;
+	struct ixfr_data* data, *r;
+	char* zfile = udbtest_get_temp_file("ixfr.zone");
+	char ixfrfile[1024+24];
+	memset(&nsd, 0, sizeof(nsd));
+	nsd.region = region_create(xalloc, free);
+	/* the db sets up the zone parser for the text file */
+	db = namedb_open("", NULL);
+	zone = make_zone(db, 6, 1);
+	written = zone_ixfr_create(&nsd);
+	data = make_data_5_6(written);
+	snprintf(ixfrfile, sizeof(ixfrfile), "%s.ixfr", zfile);
+
+	CuAssert(tc, "write binary", ixfr_write_file(zone, data, zfile, 1));
+	r = read_back(&nsd, zone, zfile);
+	check_data(tc, r, data);
+	CuAssert(tc, "log string", r && r->log_str &&
+		strcmp(r->log_str, data->log_str) == 0);
+
+	/* the text file, overwrites the binary file */
+	zone->opts->pattern->binary_ixfr = 0;
+	CuAssert(tc, "write text", ixfr_write_file(zone, data, zfile, 1));
+	r = read_back(&nsd, zone, zfile);
+	check_data(tc, r, data);
+
+	/* the binary file must match the zone serial, like the text file */
+	zone->opts->pattern->binary_ixfr = 1;
+	CuAssert(tc, "write binary", ixfr_write_file(zone, data, zfile, 1));
+	write_uint32(&zone->soa_rrset->rrs[0].rdatas[2].data[1], 7);
+	CuAssert(tc, "wrong serial", read_back(&nsd, zone, zfile) == NULL);
+
+	unlink(ixfrfile);
+	free(zfile);
+	zone_ixfr_free(zone->ixfr);
+	zone_ixfr_free(written);
+	namedb_close(db);
+	region_destroy(nsd.region);
+}
+
+/* read the file into an allocated buffer */
+static uint8_t*
+file_contents(const char* fname, size_t* len)
+{
+	FILE* in = fopen(fname, "r");
+	uint8_t* buf;
+	long size;
+	if(!in)
+		return NULL;
+	if(fseek(in, 0, SEEK_END) != 0 || (size = ftell(in)) <= 0) {
+		fclose(in);
+		return NULL;
+	}
+	rewind(in);
+	buf = xalloc((size_t)size);
+	if(fread(buf, (size_t)size, 1, in) != 1) {
+		free(buf);
+		fclose(in);
+		return NULL;
+	}
+	fclose(in);
+	*len = (size_t)size;
+	return buf;
+}
+
+/* write the buffer as the contents of the file */
+static int
+file_write_contents(const char* fname, uint8_t* buf, size_t len)
+{
+	FILE* out = fopen(fname, "w");
+	if(!out)
+		return 0;
+	if(len != 0 && fwrite(buf, len, 1, out) != 1) {
+		fclose(out);
+		return 0;
+	}
+	return fclose(out) == 0;
+}
+
+/* A binary file with a changed byte or that is cut short is not read. */
+static void ixfr_binary_2(CuTest *tc)
+{
+	struct nsd nsd;
+	struct namedb* db;
+	struct zone* zone;
+	struct zone_ixfr* written;
+	struct ixfr_data* data;
+	char* zfile = udbtest_get_temp_file("ixfr.zone");
+	char ixfrfile[1024+24];
+	uint8_t* buf;
+	size_t len = 0, i, cut[6];
+	memset(&nsd, 0, sizeof(nsd));
+	nsd.region = region_create(xalloc, free);
+	/* the db sets up the zone parser for the text file */
+	db = namedb_open("", NULL);
+	zone = make_zone(db, 6, 1);
+	written = zone_ixfr_create(&nsd);
+	data = make_data_5_6(written);
+	snprintf(ixfrfile, sizeof(ixfrfile), "%s.ixfr", zfile);
+	CuAssert(tc, "write binary", ixfr_write_file(zone, data, zfile, 1));
+	buf = file_contents(ixfrfile, &len);
+	CuAssert(tc, "file contents", buf != NULL && len > 64);
+	if(!buf) {
+		free(zfile);
+		zone_ixfr_free(written);
+		namedb_close(db);
+		region_destroy(nsd.region);
+		return;
+	}
+	CuAssert(tc, "read back", read_back(&nsd, zone, zfile) != NULL);
+
+	/* a changed byte in the version, the name, a section and the
+	 * checksum itself */
+	for(i=8; i<len; i+=len/7) {
+		buf[i] ^= 0x20;
+		CuAssert(tc, "write", file_write_contents(ixfrfile, buf, len));
+		CuAssert(tc, "corrupt not read",
+			read_back(&nsd, zone, zfile) == NULL);
+		buf[i] ^= 0x20;
+	}
+	buf[len-1] ^= 0x01;
+	CuAssert(tc, "write", file_write_contents(ixfrfile, buf, len));
+	CuAssert(tc, "bad checksum not read",
+		read_back(&nsd, zone, zfile) == NULL);
+	buf[len-1] ^= 0x01;
+
+	/* cut short, in the checksum, in the sections, in the header and in
+	 * the magic */
+	cut[0] = len-1;
+	cut[1] = len-4;
+	cut[2] = len-5;
+	cut[3] = len/2;
+	cut[4] = 30;
+	cut[5] = 4;
+	for(i=0; i<sizeof(cut)/sizeof(cut[0]); i++) {
+		CuAssert(tc, "write", file_write_contents(ixfrfile, buf,
+			cut[i]));
+		CuAssert(tc, "truncated not read",
+			read_back(&nsd, zone, zfile) == NULL);
+	}
+
+	/* the intact file reads again */
+	CuAssert(tc, "write", file_write_contents(ixfrfile, buf, len));
+	CuAssert(tc, "intact read", read_back(&nsd, zone, zfile) != NULL);
+
+	unlink(ixfrfile);
+	free(buf);
+	free(zfile);
+	zone_ixfr_free(zone->ixfr);
+	zone_ixfr_free(written);
+	namedb_close(db);
+	region_destroy(nsd.region);
+}
@@ -25,6 +25,7 @@
 
 static void namedb_1(CuTest *tc);
 static void namedb_2(CuTest *tc);
+static void namedb_5(CuTest *tc);
 #ifdef NSEC3
 static void namedb_3(CuTest *tc);
 static void namedb_4(CuTest *tc);
@@ -40,6 +41,7 @@ CuSuite* reg_cutest_namedb(void)
 
 	SUITE_ADD_TEST(suite, namedb_1);
 	SUITE_ADD_TEST(suite, namedb_2);
+	SUITE_ADD_TEST(suite, namedb_5);
 #ifdef NSEC3
 	SUITE_ADD_TEST(suite, namedb_3);
 	SUITE_ADD_TEST(suite, namedb_4);
@@ -1762,3 +1764,97 @@ static void namedb_4(CuTest *tc)
 	region_destroy(region);
 }
 #endif /* NSEC3 */
+
+/** see if a domain is in the domain table */
+static domain_type*
+find_domain(namedb_type* db, char* name)
+{
+	region_type* t = region_create(xalloc, free);
+	const dname_type* d = dname_parse(t, name);
+	domain_type* domain;
+	if(!d) {
+		printf("cannot parse domain name %s\n", name);
+		exit(1);
+	}
+	domain = domain_table_find(db->domains, d);
+	region_destroy(t);
+	return domain;
+}
+
+/* apply an AXFR to the zone, like apply_ixfr does: the rrsets are deleted
+ * but the domains are kept, the new contents is added, then pruned */
+static void
+test_axfr_prune(CuTest *tc, namedb_type* db)
+{
+	zone_type* zone = find_zone(db, "example.org");
+	domain_type* wc;
+	udb_ptr udbz;
+	if(!udb_zone_search(db->udb, &udbz,
+		dname_name(domain_dname(zone->apex)),
+		domain_dname(zone->apex)->name_size)) {
+		printf("cannot find udbzone\n");
+		exit(1);
+	}
+	check_namedb(tc, db);
+	wc = find_domain(db, "wc.example.org.");
+	CuAssertTrue(tc, wc && wc->wildcard_child_closest_match ==
+		find_domain(db, "*.wc.example.org."));
+
+	delete_zone_rrsets(db, zone, 1);
+	udb_zone_clear(db->udb, &udbz);
+	/* the domains are still there, without data */
+	CuAssertTrue(tc, find_domain(db, "a.b.c.d.example.org.") != NULL);
+	CuAssertTrue(tc, find_domain(db, "*.wc.example.org.") != NULL);
+
+	/* the new zone contents, without the wildcard and without
+	 * a.b.c.d, the empty nonterminals b.c.d and c.d go as well */
+	add_str(db, zone, &udbz, "example.org. IN SOA ns.example.org. hostmaster.example.org. 2011041300 28800 7200 604800 3600\n");
+	add_str(db, zone, &udbz, "example.org. IN NS ns.example.com.\n");
+	add_str(db, zone, &udbz, "wc.example.org. IN A 1.2.3.4\n");
+	add_str(db, zone, &udbz, "ack.wc.example.org. IN A 1.2.3.7\n");
+	add_str(db, zone, &udbz, "www.example.org. IN A 1.2.3.4\n");
+	add_str(db, zone, &udbz, "new.d.example.org. IN A 1.2.3.12\n");
+	prune_zone_domains(db, zone);
+
+	/* check is_existing and wildcard_child_closest_match everywhere */
+	check_namedb(tc, db);
+	CuAssertTrue(tc, find_domain(db, "*.wc.example.org.") == NULL);
+	CuAssertTrue(tc, find_domain(db, "in.*.wc.example.org.") == NULL);
+	CuAssertTrue(tc, find_domain(db, "zoop.wc.example.org.") == NULL);
+	CuAssertTrue(tc, find_domain(db, "a.b.c.d.example.org.") == NULL);
+	CuAssertTrue(tc, find_domain(db, "c.d.example.org.") == NULL);
+	CuAssertTrue(tc, find_domain(db, "ns2.example.com.") == NULL);
+	CuAssertTrue(tc, find_domain(db, "d.example.org.") != NULL);
+	CuAssertTrue(tc, find_domain(db, "d.example.org.")->is_existing);
+	wc = find_domain(db, "wc.example.org.");
+	CuAssertTrue(tc, wc && domain_wildcard_child(wc) == NULL);
+	CuAssertTrue(tc, find_domain(db, "ack.wc.example.org.")->is_existing);
+
+	udb_ptr_unlink(&udbz, db->udb);
+}
+
+/* test _5 : an AXFR that removes names keeps the domain table consistent */
+static void namedb_5(CuTest *tc)
+{
+	region_type* region;
+	namedb_type* db;
+	if(v) printf("test 5 namedb start\n");
+	region = region_create(xalloc, free);
+	db = create_and_read_db(tc, region, "example.org.",
+		"example.org. IN SOA ns.example.org. hostmaster.example.org. 2011041200 28800 7200 604800 3600\n"
+		"example.org. IN NS ns.example.com.\n"
+		"example.org. IN NS ns2.example.com.\n"
+		"wc.example.org. IN A 1.2.3.4\n"
+		"*.wc.example.org. IN A 1.2.3.5\n"
+		"in.*.wc.example.org. IN A 1.2.3.6\n"
+		"ack.wc.example.org. IN A 1.2.3.7\n"
+		"zoop.wc.example.org. IN A 1.2.3.7\n"
+		"a.b.c.d.example.org. IN A 1.2.3.4\n"
+		"www.example.org. IN A 1.2.3.4\n"
+	);
+	test_axfr_prune(tc, db);
+	if(v) printf("test 5 namedb end\n");
+	unlink(db->udb->fname);
+	namedb_close(db);
+	region_destroy(region);
+}
@@ -27,6 +27,8 @@ static void acl_6(CuTest *tc);
 static void replace_1(CuTest *tc);
 static void replace_2(CuTest *tc);
 static void zonelist_1(CuTest *tc);
+static void dnstap_1(CuTest *tc);
+static void dnstap_2(CuTest *tc);
 
 CuSuite* reg_cutest_options(void)
 {
@@ -41,6 +43,8 @@ CuSuite* reg_cutest_options(void)
 	SUITE_ADD_TEST(suite, replace_1); /* replace_str */
 	SUITE_ADD_TEST(suite, replace_2); /* make_zonefile */
 	SUITE_ADD_TEST(suite, zonelist_1); /* zonelist */
+	SUITE_ADD_TEST(suite, dnstap_1); /* dnstap_parse_qtypes */
+	SUITE_ADD_TEST(suite, dnstap_2); /* dnstap_parse_rcodes */
 	return suite;
 }
 
@@ -507,3 +511,80 @@ static void zonelist_1(CuTest *tc)
 	region_destroy(region);
 	unlink(zname);
 }
+
+/* the type is set in the bits of dnstap_parse_qtypes */
+static int
+qtype_bit(uint8_t* bits, uint16_t t)
+{
+	return (bits[t/8] & (1<<(t&7))) != 0;
+}
+
+/* count the bits that are set */
+static int
+qtype_bits_count(uint8_t* bits)
+{
+	int i, c = 0;
+	for(i=0; i<65536; i++)
+		if(qtype_bit(bits, (uint16_t)i))
+			c++;
+	return c;
+}
+
+static void dnstap_1(CuTest *tc)
+{
+	uint8_t bits[65536/8];
+
+	memset(bits, 0, sizeof(bits));
+	CuAssertTrue(tc, dnstap_parse_qtypes("AXFR IXFR", bits));
+	CuAssertTrue(tc, qtype_bit(bits, TYPE_AXFR));
+	CuAssertTrue(tc, qtype_bit(bits, TYPE_IXFR));
+	CuAssertTrue(tc, qtype_bits_count(bits) == 2);
+
+	/* commas and blanks separate, the case does not matter */
+	memset(bits, 0, sizeof(bits));
+	CuAssertTrue(tc, dnstap_parse_qtypes(" a,AAAA\tany , TYPE65534,",
+		bits));
+	CuAssertTrue(tc, qtype_bit(bits, TYPE_A));
+	CuAssertTrue(tc, qtype_bit(bits, TYPE_AAAA));
+	CuAssertTrue(tc, qtype_bit(bits, TYPE_ANY));
+	CuAssertTrue(tc, qtype_bit(bits, 65534));
+	CuAssertTrue(tc, qtype_bits_count(bits) == 4);
+	CuAssertTrue(tc, dnstap_parse_qtypes("MX", NULL));
+
+	/* an empty list and unknown types are errors */
+	CuAssertTrue(tc, !dnstap_parse_qtypes("", NULL));
+	CuAssertTrue(tc, !dnstap_parse_qtypes(" , ", NULL));
+	CuAssertTrue(tc, !dnstap_parse_qtypes("A FOO", NULL));
+	CuAssertTrue(tc, !dnstap_parse_qtypes("A;MX", NULL));
+	CuAssertTrue(tc, !dnstap_parse_qtypes("1", NULL));
+	CuAssertTrue(tc, !dnstap_parse_qtypes(
+		"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA", NULL));
+}
+
+static void dnstap_2(CuTest *tc)
+{
+	uint32_t mask;
+
+	mask = 0;
+	CuAssertTrue(tc, dnstap_parse_rcodes("SERVFAIL,5", &mask));
+	CuAssertTrue(tc, mask == ((1<<RCODE_SERVFAIL) | (1<<RCODE_REFUSE)));
+	mask = 0;
+	CuAssertTrue(tc, dnstap_parse_rcodes("noerror NXDOMAIN\t0 15", &mask));
+	CuAssertTrue(tc, mask == ((1<<RCODE_OK) | (1<<RCODE_NXDOMAIN) |
+		(1<<15)));
+	CuAssertTrue(tc, dnstap_parse_rcodes("notzone", NULL));
+
+	/* an empty list, unknown names and numbers that do not fit in
+	 * the 4 bits of the rcode are errors */
+	mask = 0;
+	CuAssertTrue(tc, !dnstap_parse_rcodes("", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes(",", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes("SERVFAIL junk", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes("16", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes("-1", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes("+5", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes("5x", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes("4294967298", &mask));
+	CuAssertTrue(tc, !dnstap_parse_rcodes("99999999999999999999", &mask));
+	CuAssertTrue(tc, (mask & ~(uint32_t)0xffff) == 0);
+}
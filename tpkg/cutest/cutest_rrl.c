@@ -12,15 +12,20 @@
 #include <stdlib.h>
 #include "tpkg/cutest/cutest.h"
 #include "rrl.h"
+#include "options.h"
 
 #ifdef RATELIMIT
 static void rrl_1(CuTest *tc);
+static void rrl_2(CuTest *tc);
+static void rrl_3(CuTest *tc);
 
 CuSuite* reg_cutest_rrl(void)
 {
         CuSuite* suite = CuSuiteNew();
 
 	SUITE_ADD_TEST(suite, rrl_1);
+	SUITE_ADD_TEST(suite, rrl_2);
+	SUITE_ADD_TEST(suite, rrl_3);
 	return suite;
 }
 
@@ -72,4 +77,127 @@ static void rrl_1(CuTest *tc)
 
 	rrl_deinit(0);
 }
+
+/* set the query source address */
+static void rrl_2_addr(query_type* q, int family, const char* str)
+{
+	memset(&q->addr, 0, sizeof(q->addr));
+#ifdef INET6
+	if(family == AF_INET6) {
+		((struct sockaddr_in6*)&q->addr)->sin6_family = AF_INET6;
+		(void)inet_pton(AF_INET6, str,
+			&((struct sockaddr_in6*)&q->addr)->sin6_addr);
+		return;
+	}
+	((struct sockaddr_in*)&q->addr)->sin_family = AF_INET;
+	(void)inet_pton(AF_INET, str, &((struct sockaddr_in*)&q->addr)->sin_addr);
+#else
+	(void)family;
+	q->addr.sin_family = AF_INET;
+	(void)inet_pton(AF_INET, str, &q->addr.sin_addr);
+#endif
+}
+
+static void rrl_2(CuTest *tc)
+{
+	query_type q;
+	uint32_t lm;
+	struct rrl_prefix_option p[5];
+	uint8_t addr[16];
+	int family;
+	uint8_t len;
+	memset(&q, 0, sizeof(q));
+	memset(p, 0, sizeof(p));
+
+	CuAssert(tc, "rrl prefix parse", rrl_prefix_parse("192.0.2.7/24",
+		&family, addr, &len));
+	CuAssert(tc, "rrl prefix parse family", family == AF_INET && len == 24);
+	CuAssert(tc, "rrl prefix parse mask", addr[2] == 2 && addr[3] == 0);
+	CuAssert(tc, "rrl prefix parse len", !rrl_prefix_parse("192.0.2.0/33",
+		NULL, NULL, NULL));
+	CuAssert(tc, "rrl prefix parse addr", !rrl_prefix_parse("192.0.2/24",
+		NULL, NULL, NULL));
+
+	p[0].address = "192.0.2.0/24"; p[0].ratelimit = 100; p[0].next = &p[1];
+	p[1].address = "192.0.2.128/25"; p[1].ratelimit = 0; p[1].next = &p[2];
+	p[2].address = "10.0.0.0/8"; p[2].ratelimit = 50; p[2].next = &p[3];
+	p[3].address = "10.0.0.0/8"; p[3].ratelimit = 60; p[3].next = NULL;
+#ifdef INET6
+	p[3].next = &p[4];
+	p[4].address = "2001:db8::1/128"; p[4].ratelimit = 10;
+#endif
+	rrl_set_prefixes(&p[0]);
+
+	rrl_2_addr(&q, AF_INET, "192.0.2.10");
+	CuAssert(tc, "rrl prefix /24", rrl_prefix_lookup(&q, &lm) && lm == 200);
+	rrl_2_addr(&q, AF_INET, "192.0.2.200");
+	CuAssert(tc, "rrl prefix longest", rrl_prefix_lookup(&q, &lm) && lm == 0);
+	rrl_2_addr(&q, AF_INET, "10.1.2.3");
+	CuAssert(tc, "rrl prefix last", rrl_prefix_lookup(&q, &lm) && lm == 120);
+	rrl_2_addr(&q, AF_INET, "192.0.3.1");
+	CuAssert(tc, "rrl prefix nomatch", !rrl_prefix_lookup(&q, &lm));
+#ifdef INET6
+	rrl_2_addr(&q, AF_INET6, "2001:db8::1");
+	CuAssert(tc, "rrl prefix /128", rrl_prefix_lookup(&q, &lm) && lm == 20);
+	rrl_2_addr(&q, AF_INET6, "2001:db8::2");
+	CuAssert(tc, "rrl prefix /128 nomatch", !rrl_prefix_lookup(&q, &lm));
+#endif
+	rrl_set_prefixes(NULL);
+}
+
+static void rrl_3(CuTest *tc)
+{
+	query_type q;
+	uint64_t source = 0x100;
+	int32_t now = 123000; /* in msec */
+	uint32_t hash = 0x743;
+	uint16_t c = rrl_type_nxdomain;
+	uint32_t i;
+	uint32_t rate = 200;
+	uint32_t m = 400; /* ratelimit */
+	memset(&q, 0, sizeof(q));
+
+	rrl_init(0);
+
+	/* the bucket holds rate queries */
+	for(i=0; i<rate; i++) {
+		CuAssert(tc, "rrl token burst", !rrl_update_token(&q, hash,
+			source, c, now, m));
+	}
+	CuAssert(tc, "rrl token empty", rrl_update_token(&q, hash, source, c,
+		now, m));
+
+	/* refill is rate per second, 1 query per 5 msec */
+	now += 4;
+	CuAssert(tc, "rrl token partial", rrl_update_token(&q, hash, source, c,
+		now, m));
+	now += 1;
+	CuAssert(tc, "rrl token refill", !rrl_update_token(&q, hash, source, c,
+		now, m));
+	CuAssert(tc, "rrl token refill used", rrl_update_token(&q, hash, source,
+		c, now, m));
+
+	/* after a second, the bucket is full again, but not more */
+	now += 10000;
+	for(i=0; i<rate; i++) {
+		CuAssert(tc, "rrl token full", !rrl_update_token(&q, hash,
+			source, c, now, m));
+	}
+	CuAssert(tc, "rrl token cap", rrl_update_token(&q, hash, source, c,
+		now, m));
+
+	/* a large ratelimit does not overflow the token counter */
+	m = 8589936;
+	source = 0x200;
+	hash = 0x744;
+	CuAssert(tc, "rrl token large", !rrl_update_token(&q, hash, source, c,
+		now, m));
+	now += 1;
+	for(i=0; i<1000; i++) {
+		CuAssert(tc, "rrl token large refill", !rrl_update_token(&q,
+			hash, source, c, now, m));
+	}
+
+	rrl_deinit(0);
+}
 #endif /* RATELIMIT */
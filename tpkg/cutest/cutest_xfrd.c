@@ -0,0 +1,172 @@
+/*
+	test xfrd.c timer wheel
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tpkg/cutest/cutest.h"
+#include "nsd.h"
+#include "xfrd.h"
+
+static void xfrd_wheel_1(CuTest *tc);
+static void xfrd_wheel_2(CuTest *tc);
+static void xfrd_wheel_3(CuTest *tc);
+
+CuSuite* reg_cutest_xfrd(void)
+{
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, xfrd_wheel_1);
+	SUITE_ADD_TEST(suite, xfrd_wheel_2);
+	SUITE_ADD_TEST(suite, xfrd_wheel_3);
+	return suite;
+}
+
+/* the start is 300 seconds before a level 1 and level 2 boundary */
+#define WHEEL_T0 ((time_t)0x12340000 - 300)
+/* the seconds after the start that the zones expire, near the boundaries
+ * of the levels of the wheel */
+static const time_t wheel_offsets[] = { 0, 1, 5, 255, 256, 257, 299, 300,
+	301, 511, 512, 600, 65535, 65536, 65537, 65836, 70000, 131079,
+	196608, 200000 };
+#define WHEEL_NUM (sizeof(wheel_offsets)/sizeof(wheel_offsets[0]))
+#define WHEEL_END (WHEEL_T0 + 200001)
+
+static xfrd_state_type wheel_state;
+static xfrd_zone_type wheel_zones[WHEEL_NUM];
+
+/* set up the xfrd state with the timer wheel at time t0 */
+static void
+wheel_setup(time_t t0)
+{
+	memset(&wheel_state, 0, sizeof(wheel_state));
+	memset(wheel_zones, 0, sizeof(wheel_zones));
+	xfrd = &wheel_state;
+	xfrd->event_base = nsd_child_event_base();
+	xfrd->got_time = 1;
+	xfrd->current_time = t0;
+	xfrd->timer_wheel_time = t0;
+}
+
+static void
+wheel_teardown(void)
+{
+	if(xfrd->timer_wheel_added)
+		event_del(&xfrd->timer_wheel_handler);
+	event_base_free(xfrd->event_base);
+	xfrd = NULL;
+}
+
+/* set the clock to now and take the expired zones from the wheel, they
+ * must expire after prev and not after now */
+static void
+wheel_fire(CuTest* tc, time_t prev, time_t now, int* fired)
+{
+	xfrd_zone_type* zone;
+	xfrd->current_time = now;
+	xfrd_timer_wheel_advance(now);
+	while((zone = xfrd->timer_batch) != NULL) {
+		xfrd_timer_wheel_remove(zone);
+		CuAssert(tc, "zone not early", zone->timer_expire <= now);
+		CuAssert(tc, "zone not late", zone->timer_expire > prev);
+		fired[zone - wheel_zones]++;
+	}
+}
+
+static void
+wheel_check_fired(CuTest* tc, int* fired)
+{
+	size_t i;
+	for(i=0; i<WHEEL_NUM; i++)
+		CuAssert(tc, "zone fired once", fired[i] == 1);
+	CuAssert(tc, "wheel empty", xfrd->timer_wheel_count == 0);
+}
+
+/* the clock steps one second at a time, every zone fires at its expiry */
+static void xfrd_wheel_1(CuTest *tc)
+{
+	int fired[WHEEL_NUM];
+	size_t i;
+	time_t now;
+	memset(fired, 0, sizeof(fired));
+	wheel_setup(WHEEL_T0);
+	for(i=0; i<WHEEL_NUM; i++)
+		xfrd_timer_wheel_add(&wheel_zones[i],
+			WHEEL_T0 + wheel_offsets[i]);
+	CuAssert(tc, "count", xfrd->timer_wheel_count == WHEEL_NUM);
+	CuAssert(tc, "wheel event", xfrd->timer_wheel_added &&
+		xfrd->timer_wheel_next == WHEEL_T0);
+	for(now = WHEEL_T0; now < WHEEL_END; now++)
+		wheel_fire(tc, now-1, now, fired);
+	wheel_check_fired(tc, fired);
+	wheel_teardown();
+}
+
+/* the wheel runs at irregular times, across the boundaries, every zone
+ * fires at the first run at or after its expiry */
+static void xfrd_wheel_2(CuTest *tc)
+{
+	int fired[WHEEL_NUM];
+	size_t i;
+	time_t now = WHEEL_T0, prev = WHEEL_T0 - 1, step = 1;
+	memset(fired, 0, sizeof(fired));
+	wheel_setup(WHEEL_T0);
+	for(i=0; i<WHEEL_NUM; i++)
+		xfrd_timer_wheel_add(&wheel_zones[i],
+			WHEEL_T0 + wheel_offsets[i]);
+	while(prev < WHEEL_END) {
+		wheel_fire(tc, prev, now, fired);
+		prev = now;
+		step = (step*7 + 3) % 1021 + 1;
+		now += step;
+	}
+	wheel_check_fired(tc, fired);
+	wheel_teardown();
+}
+
+/* the clock steps back, the zones move back by the same amount and fire
+ * at their expiry minus the step */
+static void xfrd_wheel_3(CuTest *tc)
+{
+	int fired[WHEEL_NUM];
+	time_t expire[WHEEL_NUM];
+	time_t now, back = 1000, delta;
+	size_t i;
+	memset(fired, 0, sizeof(fired));
+	wheel_setup(WHEEL_T0);
+	for(i=0; i<WHEEL_NUM; i++)
+		xfrd_timer_wheel_add(&wheel_zones[i],
+			WHEEL_T0 + 10 + wheel_offsets[i]);
+	for(now = WHEEL_T0; now < WHEEL_T0 + 10; now++)
+		wheel_fire(tc, now-1, now, fired);
+	/* the wheel is at WHEEL_T0 + 10, the clock goes back */
+	delta = xfrd->timer_wheel_time - (WHEEL_T0 - back + 1);
+	for(i=0; i<WHEEL_NUM; i++)
+		expire[i] = wheel_zones[i].timer_expire - delta;
+	wheel_fire(tc, WHEEL_T0 - back - 1, WHEEL_T0 - back, fired);
+	CuAssert(tc, "wheel moved back",
+		xfrd->timer_wheel_time == WHEEL_T0 - back + 1);
+	for(i=0; i<WHEEL_NUM; i++) {
+		CuAssert(tc, "zone moved back",
+			wheel_zones[i].timer_expire == expire[i]);
+	}
+	for(now = WHEEL_T0 - back + 1; now < WHEEL_END; now++) {
+		xfrd->current_time = now;
+		xfrd_timer_wheel_advance(now);
+		while(xfrd->timer_batch) {
+			xfrd_zone_type* zone = xfrd->timer_batch;
+			xfrd_timer_wheel_remove(zone);
+			CuAssert(tc, "zone fires at its expiry",
+				expire[zone - wheel_zones] == now);
+			fired[zone - wheel_zones]++;
+		}
+	}
+	wheel_check_fired(tc, fired);
+	wheel_teardown();
+}
@@ -0,0 +1,114 @@
+/*
+	test zonec.c
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "tpkg/cutest/cutest.h"
+#include "region-allocator.h"
+#include "util.h"
+#include "zonec.h"
+
+static void zonec_time_1(CuTest *tc);
+static void zonec_time_2(CuTest *tc);
+static void zonec_time_3(CuTest *tc);
+
+CuSuite* reg_cutest_zonec(void)
+{
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, zonec_time_1);
+	SUITE_ADD_TEST(suite, zonec_time_2);
+	SUITE_ADD_TEST(suite, zonec_time_3);
+	return suite;
+}
+
+/* the scanned time must be the same as the one from strptime */
+static void
+check_time_as_strptime(CuTest *tc, const char* str)
+{
+	struct tm scan, parse;
+	char* end;
+	memset(&parse, 0, sizeof(parse));
+	CuAssert(tc, "zparser_scan_time_digits accepts time",
+		zparser_scan_time_digits(str, &scan));
+	end = strptime(str, "%Y%m%d%H%M%S", &parse);
+	CuAssert(tc, "strptime accepts time", end != NULL && *end == 0);
+	CuAssert(tc, "year", scan.tm_year == parse.tm_year);
+	CuAssert(tc, "month", scan.tm_mon == parse.tm_mon);
+	CuAssert(tc, "day", scan.tm_mday == parse.tm_mday);
+	CuAssert(tc, "hour", scan.tm_hour == parse.tm_hour);
+	CuAssert(tc, "minute", scan.tm_min == parse.tm_min);
+	CuAssert(tc, "second", scan.tm_sec == parse.tm_sec);
+	CuAssert(tc, "mktime_from_utc", mktime_from_utc(&scan) ==
+		mktime_from_utc(&parse));
+}
+
+/* valid YYYYMMDDHHmmSS times */
+static void zonec_time_1(CuTest *tc)
+{
+	check_time_as_strptime(tc, "20110519131330");
+	check_time_as_strptime(tc, "20110421131330");
+	check_time_as_strptime(tc, "19700101000000");
+	check_time_as_strptime(tc, "20380119031407");
+	check_time_as_strptime(tc, "20380119031408");
+	check_time_as_strptime(tc, "21060207062815");
+	check_time_as_strptime(tc, "20240229235959");
+	check_time_as_strptime(tc, "20161231235960");
+	check_time_as_strptime(tc, "20001231000000");
+}
+
+/* text that is not 14 digits is left to strptime */
+static void zonec_time_2(CuTest *tc)
+{
+	struct tm tm;
+	CuAssert(tc, "empty", !zparser_scan_time_digits("", &tm));
+	CuAssert(tc, "13 digits",
+		!zparser_scan_time_digits("2011051913133", &tm));
+	CuAssert(tc, "15 digits",
+		!zparser_scan_time_digits("201105191313300", &tm));
+	CuAssert(tc, "letter", !zparser_scan_time_digits("2011051913133x",
+		&tm));
+	CuAssert(tc, "sign", !zparser_scan_time_digits("+2011051913133",
+		&tm));
+	CuAssert(tc, "space", !zparser_scan_time_digits("20110519 31330",
+		&tm));
+	CuAssert(tc, "trailing space",
+		!zparser_scan_time_digits("20110519131330 ", &tm));
+	CuAssert(tc, "separators",
+		!zparser_scan_time_digits("2011-05-19 13:13", &tm));
+	/* the serial arithmetic form of the RRSIG times */
+	CuAssert(tc, "seconds", !zparser_scan_time_digits("1305810810",
+		&tm));
+}
+
+/* fields that are out of range are left to strptime */
+static void zonec_time_3(CuTest *tc)
+{
+	struct tm tm;
+	CuAssert(tc, "month 00", !zparser_scan_time_digits("20110019131330",
+		&tm));
+	CuAssert(tc, "month 13", !zparser_scan_time_digits("20111319131330",
+		&tm));
+	CuAssert(tc, "day 00", !zparser_scan_time_digits("20110500131330",
+		&tm));
+	CuAssert(tc, "day 32", !zparser_scan_time_digits("20110532131330",
+		&tm));
+	CuAssert(tc, "hour 24", !zparser_scan_time_digits("20110519241330",
+		&tm));
+	CuAssert(tc, "minute 60",
+		!zparser_scan_time_digits("20110519136030", &tm));
+	CuAssert(tc, "second 61",
+		!zparser_scan_time_digits("20110519131361", &tm));
+	CuAssert(tc, "second 99",
+		!zparser_scan_time_digits("20110519131399", &tm));
+	/* strptime does not check the day of the month either */
+	check_time_as_strptime(tc, "20110231000000");
+}
@@ -24,6 +24,10 @@ static void init_context(void *context,
 			 tsig_key_type *key);
 static void update(void *context, const void *data, size_t size);
 static void final(void *context, uint8_t *digest, size_t *size);
+static void free_template(void *hmac_template);
+
+/* serial number for the next keyed HMAC template that is created */
+static unsigned int tsig_openssl_template_serial = 0;
 
 #ifdef HAVE_EVP_MAC_CTX_NEW
 struct tsig_openssl_data {
@@ -38,6 +42,9 @@ struct tsig_openssl_context {
 	EVP_MAC_CTX* hmac_ctx;
 	/* the size of destination buffers */
 	size_t outsize;
+	/* the key template that hmac_ctx was copied from, and its serial */
+	EVP_MAC_CTX* keyed_from;
+	unsigned int keyed_serial;
 };
 
 static void
@@ -133,6 +140,7 @@ tsig_openssl_init_algorithm(region_type* region,
 	algorithm->hmac_init_context = init_context;
 	algorithm->hmac_update = update;
 	algorithm->hmac_final = final;
+	algorithm->hmac_free_template = free_template;
 	tsig_add_algorithm(algorithm);
 
 #ifdef HAVE_EVP_MAC_CTX_NEW
@@ -209,27 +217,37 @@ create_context(region_type *region)
 	return context;
 }
 
-static void
-init_context(void *context,
-			  tsig_algorithm_type *algorithm,
-			  tsig_key_type *key)
+/* create a HMAC state that has the algorithm and key set */
+static void *
+make_template(tsig_algorithm_type *algorithm, tsig_key_type *key)
 {
 #ifndef HAVE_EVP_MAC_CTX_NEW
-	HMAC_CTX *ctx = (HMAC_CTX *) context;
 	const EVP_MD *md = (const EVP_MD *) algorithm->data;
-	HMAC_Init_ex(ctx, key->data, key->size, md, NULL);
+#ifdef HAVE_HMAC_CTX_NEW
+	HMAC_CTX *ctx = HMAC_CTX_new();
+#else
+	HMAC_CTX *ctx = (HMAC_CTX *) malloc(sizeof(HMAC_CTX));
+#endif
+	if(!ctx)
+		return NULL;
+#ifdef HAVE_HMAC_CTX_RESET
+	HMAC_CTX_reset(ctx);
+#else
+	HMAC_CTX_init(ctx);
+#endif
+	if(!HMAC_Init_ex(ctx, key->data, key->size, md, NULL)) {
+		cleanup_context(ctx);
+		return NULL;
+	}
+	return ctx;
 #else
 	OSSL_PARAM params[3];
 	struct tsig_openssl_data* algo_data = (struct tsig_openssl_data*)
 		algorithm->data;
-	struct tsig_openssl_context* c = (struct tsig_openssl_context*)context;
-	if(c->hmac_ctx) {
-		EVP_MAC_CTX_free(c->hmac_ctx);
-	}
-	c->hmac_ctx = EVP_MAC_CTX_new(algo_data->mac);
-	if(!c->hmac_ctx) {
+	EVP_MAC_CTX* hmac_ctx = EVP_MAC_CTX_new(algo_data->mac);
+	if(!hmac_ctx) {
 		log_msg(LOG_ERR, "could not EVP_MAC_CTX_new");
-		return;
+		return NULL;
 	}
 	params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
 		(char*)algo_data->digest, 0);
@@ -237,20 +255,88 @@ init_context(void *context,
 		key->data, key->size);
 	params[2] = OSSL_PARAM_construct_end();
 #ifdef HAVE_EVP_MAC_CTX_SET_PARAMS
-	if(EVP_MAC_CTX_set_params(c->hmac_ctx, params) <= 0) {
+	if(EVP_MAC_CTX_set_params(hmac_ctx, params) <= 0) {
 		log_msg(LOG_ERR, "could not EVP_MAC_CTX_set_params");
-		EVP_MAC_CTX_free(c->hmac_ctx);
-		c->hmac_ctx = NULL;
-		return;
+		EVP_MAC_CTX_free(hmac_ctx);
+		return NULL;
 	}
 #else
 	if(EVP_MAC_set_ctx_params(hmac_ctx, params) <= 0) {
 		log_msg(LOG_ERR, "could not EVP_MAC_set_ctx_params");
+		EVP_MAC_CTX_free(hmac_ctx);
+		return NULL;
+	}
+#endif
+	return hmac_ctx;
+#endif
+}
+
+static void
+free_template(void *hmac_template)
+{
+#ifndef HAVE_EVP_MAC_CTX_NEW
+	cleanup_context(hmac_template);
+#else
+	EVP_MAC_CTX_free((EVP_MAC_CTX*)hmac_template);
+#endif
+}
+
+/*
+ * Return the HMAC state with the key applied for the algorithm. It is
+ * made once and stored in the key, so that the key schedule (and, for
+ * EVP_MAC, the digest lookup and parameter parsing) is not redone for
+ * every message.
+ */
+static void *
+key_template(tsig_algorithm_type *algorithm, tsig_key_type *key)
+{
+	if(key->hmac_template && key->hmac_template_algorithm == algorithm)
+		return key->hmac_template;
+	tsig_key_clear_template(key);
+	key->hmac_template = make_template(algorithm, key);
+	if(key->hmac_template) {
+		key->hmac_template_algorithm = algorithm;
+		key->hmac_template_serial = ++tsig_openssl_template_serial;
+	}
+	return key->hmac_template;
+}
+
+static void
+init_context(void *context,
+			  tsig_algorithm_type *algorithm,
+			  tsig_key_type *key)
+{
+#ifndef HAVE_EVP_MAC_CTX_NEW
+	HMAC_CTX *ctx = (HMAC_CTX *) context;
+	HMAC_CTX *tmpl = (HMAC_CTX *) key_template(algorithm, key);
+	if(!tmpl || !HMAC_CTX_copy(ctx, tmpl)) {
+		const EVP_MD *md = (const EVP_MD *) algorithm->data;
+		HMAC_Init_ex(ctx, key->data, key->size, md, NULL);
+	}
+#else
+	struct tsig_openssl_context* c = (struct tsig_openssl_context*)context;
+	EVP_MAC_CTX* tmpl = (EVP_MAC_CTX*)key_template(algorithm, key);
+	if(!tmpl) {
 		EVP_MAC_CTX_free(c->hmac_ctx);
 		c->hmac_ctx = NULL;
+		c->keyed_from = NULL;
 		return;
 	}
-#endif
+	/* The context still holds the keyed state of this template, the
+	 * init without a key restarts from it without allocation. */
+	if(c->hmac_ctx && c->keyed_from == tmpl &&
+		c->keyed_serial == key->hmac_template_serial &&
+		EVP_MAC_init(c->hmac_ctx, NULL, 0, NULL) > 0)
+		return;
+	EVP_MAC_CTX_free(c->hmac_ctx);
+	c->hmac_ctx = EVP_MAC_CTX_dup(tmpl);
+	if(!c->hmac_ctx) {
+		log_msg(LOG_ERR, "could not EVP_MAC_CTX_dup");
+		c->keyed_from = NULL;
+		return;
+	}
+	c->keyed_from = tmpl;
+	c->keyed_serial = key->hmac_template_serial;
 	c->outsize = algorithm->maximum_digest_size;
 #endif
 }
@@ -179,6 +179,17 @@ tsig_del_key(tsig_key_type *key)
 	region_recycle(tsig_region, entry, sizeof(tsig_key_table_type));
 }
 
+void
+tsig_key_clear_template(tsig_key_type *key)
+{
+	if(!key || !key->hmac_template)
+		return;
+	assert(key->hmac_template_algorithm);
+	key->hmac_template_algorithm->hmac_free_template(key->hmac_template);
+	key->hmac_template = NULL;
+	key->hmac_template_algorithm = NULL;
+}
+
 tsig_key_type*
 tsig_find_key(const dname_type* name)
 {
@@ -90,6 +90,12 @@ struct tsig_algorithm
 	 * least maximum_digest_size bytes.
 	 */
 	void  (*hmac_final)(void *context, uint8_t *digest, size_t *size);
+
+	/*
+	 * Free a keyed HMAC state made by hmac_init_context and stored
+	 * in the key.
+	 */
+	void  (*hmac_free_template)(void *hmac_template);
 };
 
 /*
@@ -100,6 +106,15 @@ struct tsig_key
 	const dname_type *name;
 	size_t            size;
 	uint8_t		 *data;
+	/*
+	 * HMAC state with the key already applied for the algorithm,
+	 * made on first use and copied into the context for every
+	 * message. NULL if not created yet.
+	 */
+	void                *hmac_template;
+	tsig_algorithm_type *hmac_template_algorithm;
+	/* changes whenever a new hmac_template is created */
+	unsigned int         hmac_template_serial;
 };
 
 struct tsig_record
@@ -142,6 +157,11 @@ int tsig_init(region_type *region);
 void tsig_add_key(tsig_key_type *key);
 void tsig_del_key(tsig_key_type *key);
 
+/*
+ * Free the cached HMAC state of the key, call when the key data changes.
+ */
+void tsig_key_clear_template(tsig_key_type *key);
+
 /*
  * Add the specified algorithm to the TSIG algorithm table.
  */
@@ -38,7 +38,7 @@
 #include "zonec.h"
 #include "nsd.h"
 
-#ifdef USE_MMAP_ALLOC
+#if defined(USE_MMAP_ALLOC) || defined(USE_NAMEDB_ARENA)
 #include <sys/mman.h>
 
 #if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
@@ -47,7 +47,7 @@
 #define	MAP_ANON	MAP_ANONYMOUS
 #endif
 
-#endif /* USE_MMAP_ALLOC */
+#endif /* USE_MMAP_ALLOC || USE_NAMEDB_ARENA */
 
 #ifndef NDEBUG
 unsigned nsd_debug_facilities = 0xffff;
@@ -337,7 +337,7 @@ xrealloc(void *ptr, size_t size)
 	return ptr;
 }
 
-#ifdef USE_MMAP_ALLOC
+#if defined(USE_MMAP_ALLOC) || defined(USE_NAMEDB_ARENA)
 
 void *
 mmap_alloc(size_t size)
@@ -383,7 +383,7 @@ mmap_free(void *ptr)
 #endif /* HAVE_MUNMAP */
 }
 
-#endif /* USE_MMAP_ALLOC */
+#endif /* USE_MMAP_ALLOC || USE_NAMEDB_ARENA */
 
 int
 write_data(FILE *file, const void *data, size_t size)
@@ -155,10 +155,10 @@ char *xstrdup(const char *src);
  * Mmap allocator routines.
  *
  */
-#ifdef USE_MMAP_ALLOC
+#if defined(USE_MMAP_ALLOC) || defined(USE_NAMEDB_ARENA)
 void *mmap_alloc(size_t size);
 void mmap_free(void *ptr);
-#endif /* USE_MMAP_ALLOC */
+#endif /* USE_MMAP_ALLOC || USE_NAMEDB_ARENA */
 
 /*
  * Write SIZE bytes of DATA to FILE.  Report an error on failure.
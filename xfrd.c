@@ -81,6 +81,12 @@ static void xfrd_set_reload_timeout(void);
 static void xfrd_handle_reload(int fd, short event, void* arg);
 /* handle child timeout */
 static void xfrd_handle_child_timer(int fd, short event, void* arg);
+/* handle timer wheel timeout, for the expired zone timers */
+static void xfrd_handle_timer_wheel(int fd, short event, void* arg);
+/* set the timer wheel event for the next zones in the wheel */
+static void xfrd_timer_wheel_next(void);
+/* compare the addresses of the SOA check rate entries */
+static int xfrd_soa_check_rate_cmp(const void* a, const void* b);
 
 /* send ixfr request, returns fd of connection to read on */
 static int xfrd_send_ixfr_request_udp(xfrd_zone_type* zone);
@@ -152,6 +158,13 @@ xfrd_init(int socket, struct nsd* nsd, int shortsoa, int reload_active,
 	xfrd->udp_use_num = 0;
 	xfrd->got_time = 0;
 	xfrd->xfrfilenumber = 0;
+	xfrd->timer_wheel_time = xfrd_time();
+	xfrd->timer_wheel_count = 0;
+	xfrd->timer_batch = NULL;
+	xfrd->timer_wheel_added = 0;
+	xfrd->soa_check_rate = rbtree_create(xfrd->region,
+		xfrd_soa_check_rate_cmp);
+	xfrd->soa_check_rate_time = 0;
 #ifdef USE_ZONE_STATS
 	xfrd->zonestat_safe = nsd->zonestatdesired;
 #endif
@@ -357,6 +370,10 @@ xfrd_shutdown()
 	if(xfrd->nsd->options->zonefiles_write) {
 		event_del(&xfrd->write_timer);
 	}
+	if(xfrd->timer_wheel_added) {
+		event_del(&xfrd->timer_wheel_handler);
+		xfrd->timer_wheel_added = 0;
+	}
 #ifdef HAVE_SSL
 	daemon_remote_close(xfrd->nsd->rc); /* close sockets of rc */
 #endif
@@ -509,6 +526,7 @@ xfrd_init_slave_zone(xfrd_state_type* xfrd, struct zone_options* zone_opt)
 	xzone->zone_handler.ev_fd = -1;
 	xzone->zone_handler_flags = 0;
 	xzone->event_added = 0;
+	xzone->timer_list = NULL;
 
 	xzone->tcp_conn = -1;
 	xzone->tcp_waiting = 0;
@@ -855,6 +873,7 @@ xfrd_del_slave_zone(xfrd_state_type* xfrd, const dname_type* dname)
 		xfrd_udp_release(z);
 	} else if(z->event_added)
 		event_del(&z->zone_handler);
+	xfrd_timer_wheel_remove(z);
 
 	while(z->latest_xfr) xfrd_delete_zone_xfr(z, z->latest_xfr);
 
@@ -1137,6 +1156,7 @@ xfrd_udp_obtain(xfrd_zone_type* zone)
 		if(fd == -1)
 			xfrd->udp_use_num--;
 		else {
+			xfrd_timer_wheel_remove(zone);
 			if(zone->event_added)
 				event_del(&zone->zone_handler);
 			memset(&zone->zone_handler, 0,
@@ -1248,6 +1268,7 @@ xfrd_unset_timer(xfrd_zone_type* zone)
 	assert(zone->zone_handler.ev_fd == -1);
 	if(zone->event_added)
 		event_del(&zone->zone_handler);
+	xfrd_timer_wheel_remove(zone);
 	zone->zone_handler_flags = 0;
 	zone->event_added = 0;
 }
@@ -1267,12 +1288,22 @@ xfrd_set_timer(xfrd_zone_type* zone, time_t t)
 		t = base + random_generate(t-base);
 	}
 
-	/* keep existing flags and fd, but re-add with timeout */
-	if(zone->event_added)
-		event_del(&zone->zone_handler);
-	else	fd = -1;
 	zone->timeout.tv_sec = t;
 	zone->timeout.tv_usec = 0;
+	if(!zone->event_added || fd == -1) {
+		/* no socket, the timeout is kept in the timer wheel */
+		if(zone->event_added)
+			event_del(&zone->zone_handler);
+		zone->zone_handler.ev_fd = -1;
+		zone->event_added = 0;
+		zone->zone_handler_flags = EV_TIMEOUT;
+		xfrd_timer_wheel_add(zone, xfrd_time() + t);
+		return;
+	}
+
+	/* keep existing flags and fd, but re-add with timeout */
+	xfrd_timer_wheel_remove(zone);
+	event_del(&zone->zone_handler);
 	memset(&zone->zone_handler, 0, sizeof(zone->zone_handler));
 	event_set(&zone->zone_handler, fd, fl, xfrd_handle_zone, zone);
 	if(event_base_set(xfrd->event_base, &zone->zone_handler) != 0)
@@ -1283,6 +1314,300 @@ xfrd_set_timer(xfrd_zone_type* zone, time_t t)
 	zone->event_added = 1;
 }
 
+/* insert the zone at the front of the timer list */
+static void
+xfrd_timer_list_insert(xfrd_zone_type* zone, xfrd_zone_type** list)
+{
+	zone->timer_list = list;
+	zone->timer_prev = NULL;
+	zone->timer_next = *list;
+	if(*list)
+		(*list)->timer_prev = zone;
+	*list = zone;
+}
+
+/* the timer wheel slot for the absolute expire time */
+static xfrd_zone_type**
+xfrd_timer_wheel_slot(time_t expire)
+{
+	time_t delta = expire - xfrd->timer_wheel_time;
+	int level = 0;
+	while(level < XFRD_TIMER_WHEEL_LEVELS-1 && delta >=
+		((time_t)1<<(XFRD_TIMER_WHEEL_BITS*(level+1))))
+		level++;
+	return &xfrd->timer_wheel[level][(expire>>(XFRD_TIMER_WHEEL_BITS*
+		level))&(XFRD_TIMER_WHEEL_SLOTS-1)];
+}
+
+/* set the timer wheel event for the absolute time */
+static void
+xfrd_timer_wheel_set(time_t target)
+{
+	struct timeval tv;
+	if(xfrd->timer_wheel_added)
+		event_del(&xfrd->timer_wheel_handler);
+	tv.tv_sec = (target > xfrd_time()) ? target - xfrd_time() : 0;
+	tv.tv_usec = 0;
+	memset(&xfrd->timer_wheel_handler, 0,
+		sizeof(xfrd->timer_wheel_handler));
+	event_set(&xfrd->timer_wheel_handler, -1, EV_TIMEOUT,
+		xfrd_handle_timer_wheel, xfrd);
+	if(event_base_set(xfrd->event_base, &xfrd->timer_wheel_handler) != 0)
+		log_msg(LOG_ERR, "xfrd timer wheel: event_base_set failed");
+	if(event_add(&xfrd->timer_wheel_handler, &tv) != 0)
+		log_msg(LOG_ERR, "xfrd timer wheel: event_add failed");
+	xfrd->timer_wheel_next = target;
+	xfrd->timer_wheel_added = 1;
+}
+
+/* if the clock has stepped back, before the time of the wheel, the
+ * timers move back by the same amount, so they do not wait for the
+ * clock to catch up */
+static void
+xfrd_timer_wheel_rebase(time_t now)
+{
+	xfrd_zone_type* list = NULL, *zone, *next;
+	time_t delta = xfrd->timer_wheel_time - (now + 1);
+	int level;
+	size_t i;
+	if(now + 1 >= xfrd->timer_wheel_time)
+		return;
+	for(level=0; level<XFRD_TIMER_WHEEL_LEVELS; level++) {
+		for(i=0; i<XFRD_TIMER_WHEEL_SLOTS; i++) {
+			zone = xfrd->timer_wheel[level][i];
+			xfrd->timer_wheel[level][i] = NULL;
+			while(zone) {
+				next = zone->timer_next;
+				zone->timer_expire -= delta;
+				zone->timer_next = list;
+				list = zone;
+				zone = next;
+			}
+		}
+	}
+	xfrd->timer_wheel_time = now + 1;
+	while(list) {
+		next = list->timer_next;
+		xfrd_timer_list_insert(list,
+			xfrd_timer_wheel_slot(list->timer_expire));
+		list = next;
+	}
+	xfrd_timer_wheel_next();
+}
+
+void
+xfrd_timer_wheel_add(xfrd_zone_type* zone, time_t expire)
+{
+	xfrd_timer_wheel_remove(zone);
+	xfrd_timer_wheel_rebase(xfrd_time());
+	if(expire < xfrd->timer_wheel_time)
+		expire = xfrd->timer_wheel_time;
+	if(expire - xfrd->timer_wheel_time >= XFRD_TIMER_WHEEL_SPAN)
+		expire = xfrd->timer_wheel_time + XFRD_TIMER_WHEEL_SPAN - 1;
+	zone->timer_expire = expire;
+	xfrd_timer_list_insert(zone, xfrd_timer_wheel_slot(expire));
+	xfrd->timer_wheel_count++;
+	if(!xfrd->timer_wheel_added || expire < xfrd->timer_wheel_next)
+		xfrd_timer_wheel_set(expire);
+}
+
+void
+xfrd_timer_wheel_remove(xfrd_zone_type* zone)
+{
+	if(!zone->timer_list)
+		return;
+	if(zone->timer_prev)
+		zone->timer_prev->timer_next = zone->timer_next;
+	else	*zone->timer_list = zone->timer_next;
+	if(zone->timer_next)
+		zone->timer_next->timer_prev = zone->timer_prev;
+	zone->timer_list = NULL;
+	zone->timer_next = NULL;
+	zone->timer_prev = NULL;
+	xfrd->timer_wheel_count--;
+}
+
+/* move the zones in the slot to the batch list, or if cascade is true,
+ * to their slot in the lower levels of the wheel */
+static void
+xfrd_timer_wheel_move(xfrd_zone_type** slot, int cascade)
+{
+	xfrd_zone_type* zone = *slot, *next;
+	*slot = NULL;
+	while(zone) {
+		next = zone->timer_next;
+		xfrd_timer_list_insert(zone, cascade ?
+			xfrd_timer_wheel_slot(zone->timer_expire) :
+			&xfrd->timer_batch);
+		zone = next;
+	}
+}
+
+/* move the zones that have expired at time now to the batch list */
+static void
+xfrd_timer_wheel_expire(time_t now)
+{
+	int level;
+	size_t i;
+	if(now - xfrd->timer_wheel_time >= XFRD_TIMER_WHEEL_SPAN) {
+		/* the clock jumped past the span of the wheel */
+		for(level=0; level<XFRD_TIMER_WHEEL_LEVELS; level++)
+			for(i=0; i<XFRD_TIMER_WHEEL_SLOTS; i++)
+				xfrd_timer_wheel_move(
+					&xfrd->timer_wheel[level][i], 0);
+		xfrd->timer_wheel_time = now+1;
+		return;
+	}
+	while(xfrd->timer_wheel_time <= now) {
+		time_t t = xfrd->timer_wheel_time;
+		if((t&(XFRD_TIMER_WHEEL_SLOTS-1)) == 0) {
+			/* start of a new round, cascade the slots of the
+			 * higher levels that start now */
+			int top = 1;
+			while(top < XFRD_TIMER_WHEEL_LEVELS-1 &&
+				((t>>(XFRD_TIMER_WHEEL_BITS*top))&
+				(XFRD_TIMER_WHEEL_SLOTS-1)) == 0)
+				top++;
+			for(level=top; level>0; level--)
+				xfrd_timer_wheel_move(&xfrd->timer_wheel[level]
+					[(t>>(XFRD_TIMER_WHEEL_BITS*level))&
+					(XFRD_TIMER_WHEEL_SLOTS-1)], 1);
+		}
+		xfrd_timer_wheel_move(&xfrd->timer_wheel[0]
+			[t&(XFRD_TIMER_WHEEL_SLOTS-1)], 0);
+		xfrd->timer_wheel_time++;
+	}
+}
+
+void
+xfrd_timer_wheel_advance(time_t now)
+{
+	xfrd_timer_wheel_rebase(now);
+	xfrd_timer_wheel_expire(now);
+}
+
+/* set the timer wheel event for the next slot with zones in it, or the
+ * next round of the wheel when the higher levels are cascaded */
+static void
+xfrd_timer_wheel_next(void)
+{
+	time_t t = xfrd->timer_wheel_time;
+	if(xfrd->timer_wheel_count == 0) {
+		if(xfrd->timer_wheel_added)
+			event_del(&xfrd->timer_wheel_handler);
+		xfrd->timer_wheel_added = 0;
+		return;
+	}
+	do {
+		if(xfrd->timer_wheel[0][t&(XFRD_TIMER_WHEEL_SLOTS-1)])
+			break;
+		t++;
+	} while((t&(XFRD_TIMER_WHEEL_SLOTS-1)) != 0);
+	xfrd_timer_wheel_set(t);
+}
+
+static int
+xfrd_soa_check_rate_cmp(const void* a, const void* b)
+{
+	const struct xfrd_soa_check_rate* x = a, *y = b;
+	if(x->is_ipv6 != y->is_ipv6)
+		return (x->is_ipv6 < y->is_ipv6) ? -1 : 1;
+	if(x->port != y->port)
+		return (x->port < y->port) ? -1 : 1;
+#ifdef INET6
+	if(x->is_ipv6)
+		return memcmp(&x->addr.addr6, &y->addr.addr6,
+			sizeof(x->addr.addr6));
+#endif
+	return memcmp(&x->addr.addr, &y->addr.addr, sizeof(x->addr.addr));
+}
+
+/* the master the next request of the zone goes to, like
+ * xfrd_make_request picks it */
+static struct acl_options*
+xfrd_next_master(xfrd_zone_type* zone)
+{
+	struct acl_options* master;
+	if(zone->next_master != -1) {
+		master = acl_find_num(zone->zone_options->pattern->request_xfr,
+			zone->next_master);
+		if(master)
+			return master;
+	} else if(zone->round_num != -1 && zone->master && zone->master->next)
+		return zone->master->next;
+	return zone->zone_options->pattern->request_xfr;
+}
+
+/* see if the SOA check for the zone is over the rate for its master,
+ * counts the check if not. The count is per address of the master, it
+ * can be listed in the patterns of many zones. */
+static int
+xfrd_soa_check_over_rate(xfrd_zone_type* zone)
+{
+	struct acl_options* master = xfrd_next_master(zone);
+	struct xfrd_soa_check_rate key, *rate;
+	if(!master)
+		return 0;
+	if(xfrd->soa_check_rate_time != xfrd_time()) {
+		/* the counts are for one second, remove those of earlier
+		 * seconds, also for masters that are no longer configured */
+		rbnode_type* n;
+		while((n = rbtree_first(xfrd->soa_check_rate)) !=
+			RBTREE_NULL) {
+			(void)rbtree_delete(xfrd->soa_check_rate, n->key);
+			region_recycle(xfrd->region, n,
+				sizeof(struct xfrd_soa_check_rate));
+		}
+		xfrd->soa_check_rate_time = xfrd_time();
+	}
+	memset(&key, 0, sizeof(key));
+	key.node.key = &key;
+	key.is_ipv6 = master->is_ipv6;
+	key.port = master->port;
+	key.addr = master->addr;
+	rate = (struct xfrd_soa_check_rate*)rbtree_search(
+		xfrd->soa_check_rate, &key);
+	if(!rate) {
+		rate = region_alloc(xfrd->region, sizeof(*rate));
+		*rate = key;
+		rate->node.key = rate;
+		rbtree_insert(xfrd->soa_check_rate, &rate->node);
+	}
+	if(rate->count >= XFRD_SOA_CHECK_RATE)
+		return 1;
+	rate->count++;
+	return 0;
+}
+
+static void
+xfrd_handle_timer_wheel(int ATTR_UNUSED(fd), short event,
+	void* ATTR_UNUSED(arg))
+{
+	xfrd_zone_type* zone;
+	assert(event & EV_TIMEOUT);
+	(void)event;
+	xfrd->timer_wheel_added = 0;
+	xfrd_timer_wheel_advance(xfrd_time());
+
+	/* handle the expired zones as a batch, the zones are taken from
+	 * the batch list one by one, the handler can change other zones */
+	while((zone = xfrd->timer_batch) != NULL) {
+		xfrd_timer_wheel_remove(zone);
+		if(zone->tcp_conn == -1 && xfrd_soa_check_over_rate(zone)) {
+			/* too many checks for the master in this second,
+			 * spread them over the next seconds */
+			DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: zone %s SOA "
+				"check deferred, master rate limit",
+				zone->apex_str));
+			xfrd_timer_wheel_add(zone, xfrd_time() + 1 +
+				random_generate(XFRD_SOA_CHECK_SPREAD));
+			continue;
+		}
+		xfrd_handle_zone(-1, EV_TIMEOUT, zone);
+	}
+	xfrd_timer_wheel_next();
+}
+
 void
 xfrd_handle_incoming_soa(xfrd_zone_type* zone,
 	xfrd_soa_type* soa, time_t acquired)
@@ -1451,6 +1776,7 @@ xfrd_udp_release(xfrd_zone_type* zone)
 			if(wz->tcp_conn == -1) {
 				int fd = xfrd_send_ixfr_request_udp(wz);
 				if(fd != -1) {
+					xfrd_timer_wheel_remove(wz);
 					if(wz->event_added)
 						event_del(&wz->zone_handler);
 					memset(&wz->zone_handler, 0,
@@ -38,6 +38,26 @@ typedef struct xfrd_state xfrd_state_type;
 typedef struct xfrd_xfr xfrd_xfr_type;
 typedef struct xfrd_zone xfrd_zone_type;
 typedef struct xfrd_soa xfrd_soa_type;
+
+#define XFRD_TIMER_WHEEL_BITS 8 /* log2 of the slots per level */
+#define XFRD_TIMER_WHEEL_SLOTS (1<<XFRD_TIMER_WHEEL_BITS)
+#define XFRD_TIMER_WHEEL_LEVELS 3 /* 2^24 seconds span, above timeouts */
+#define XFRD_TIMER_WHEEL_SPAN ((time_t)1<<(XFRD_TIMER_WHEEL_BITS*XFRD_TIMER_WHEEL_LEVELS))
+#define XFRD_SOA_CHECK_RATE 100 /* timer started SOA checks per second per master */
+#define XFRD_SOA_CHECK_SPREAD 5 /* seconds to spread SOA checks over the rate */
+/*
+ * The timer started SOA checks in the current second, for a primary.
+ */
+struct xfrd_soa_check_rate {
+	/* key is the address of the primary */
+	rbnode_type node;
+	uint8_t is_ipv6;
+	unsigned int port;
+	union acl_addr_storage addr;
+	/* the number of checks in the second of the tree */
+	size_t count;
+};
+
 /*
  * The global state for the xfrd daemon process.
  * The time_t times are epochs in secs since 1970, absolute times.
@@ -59,6 +79,28 @@ struct xfrd_state {
 	/* activated waiting list, double linked list */
 	struct xfrd_zone *activated_first;
 
+	/* zone timeouts without a socket, the refresh, retry and expire
+	 * timers and transfer timeouts, are kept in a timer wheel with one
+	 * event. Level 0 has a slot per second, the slots of the higher
+	 * levels span XFRD_TIMER_WHEEL_SLOTS times the lower level. */
+	struct xfrd_zone* timer_wheel[XFRD_TIMER_WHEEL_LEVELS]
+		[XFRD_TIMER_WHEEL_SLOTS];
+	/* the next second of the wheel to process */
+	time_t timer_wheel_time;
+	/* number of zones in the wheel and the batch list */
+	size_t timer_wheel_count;
+	/* expired zones, that are processed together */
+	struct xfrd_zone* timer_batch;
+	/* event for the wheel, and the time it is set for */
+	struct event timer_wheel_handler;
+	time_t timer_wheel_next;
+	int timer_wheel_added;
+	/* tree of xfrd_soa_check_rate, by the address of the primary,
+	 * the timer started SOA checks per second for the rate limit */
+	rbtree_type* soa_check_rate;
+	/* the second of the entries in soa_check_rate */
+	time_t soa_check_rate_time;
+
 	/* current time is cached */
 	uint8_t got_time;
 	time_t current_time;
@@ -186,6 +228,13 @@ struct xfrd_zone {
 	struct event zone_handler;
 	int zone_handler_flags;
 	int event_added;
+	/* timer wheel list the zone is in, when it waits for a timeout
+	 * without a socket, or NULL */
+	xfrd_zone_type** timer_list;
+	xfrd_zone_type* timer_next;
+	xfrd_zone_type* timer_prev;
+	/* absolute time of the timeout in the timer wheel */
+	time_t timer_expire;
 
 	/* tcp connection zone is using, or -1 */
 	int tcp_conn;
@@ -381,6 +430,13 @@ void xfrd_set_timer(xfrd_zone_type* zone, time_t t);
 void xfrd_set_refresh_now(xfrd_zone_type* zone);
 /* unset the timer - no more timeouts, for when zone is queued */
 void xfrd_unset_timer(xfrd_zone_type* zone);
+/* put the zone in the timer wheel, for the absolute expire time */
+void xfrd_timer_wheel_add(xfrd_zone_type* zone, time_t expire);
+/* remove the zone from the timer wheel, if it is in it */
+void xfrd_timer_wheel_remove(xfrd_zone_type* zone);
+/* move the zones in the timer wheel that have expired at time now to the
+ * timer_batch list, the wheel moves back if the clock has stepped back */
+void xfrd_timer_wheel_advance(time_t now);
 /* remove the 'refresh now', remove it from the activated list */
 void xfrd_deactivate_zone(xfrd_zone_type* z);
 
@@ -52,13 +52,6 @@
 const dname_type *error_dname;
 domain_type *error_domain;
 
-static time_t startzonec = 0;
-static long int totalrrs = 0;
-
-extern uint8_t nsecbits[NSEC_WINDOW_COUNT][NSEC_WINDOW_BITS_SIZE];
-extern uint16_t nsec_highest_rcode;
-
-
 /*
  * Allocate SIZE+sizeof(uint16_t) bytes and store SIZE in the first
  * element.  Return a pointer to the allocation.
@@ -167,6 +160,36 @@ zparser_conv_hex_length(region_type *region, const char *hex, size_t len)
 	return r;
 }
 
+/*
+ * Scan the YYYYMMDDHHmmSS time of RRSIG records without strptime, that
+ * is slow for the two times in every RRSIG of a signed zone.
+ * Returns false if the text is not like that, and strptime is used.
+ */
+int
+zparser_scan_time_digits(const char *time, struct tm *tm)
+{
+	int i;
+	for (i = 0; i < 14; i++) {
+		if (!isdigit((unsigned char)time[i]))
+			return 0;
+	}
+	if (time[14] != '\0')
+		return 0;
+	memset(tm, 0, sizeof(*tm));
+	tm->tm_year = (time[0]-'0')*1000 + (time[1]-'0')*100 +
+		(time[2]-'0')*10 + (time[3]-'0') - 1900;
+	tm->tm_mon = (time[4]-'0')*10 + (time[5]-'0') - 1;
+	tm->tm_mday = (time[6]-'0')*10 + (time[7]-'0');
+	tm->tm_hour = (time[8]-'0')*10 + (time[9]-'0');
+	tm->tm_min = (time[10]-'0')*10 + (time[11]-'0');
+	tm->tm_sec = (time[12]-'0')*10 + (time[13]-'0');
+	if (tm->tm_mon < 0 || tm->tm_mon > 11 || tm->tm_mday < 1 ||
+		tm->tm_mday > 31 || tm->tm_hour > 23 || tm->tm_min > 59 ||
+		tm->tm_sec > 60)
+		return 0;
+	return 1;
+}
+
 uint16_t *
 zparser_conv_time(region_type *region, const char *time)
 {
@@ -175,7 +198,8 @@ zparser_conv_time(region_type *region, const char *time)
 	struct tm tm;
 
 	/* Try to scan the time... */
-	if (!strptime(time, "%Y%m%d%H%M%S", &tm)) {
+	if (!zparser_scan_time_digits(time, &tm) &&
+		!strptime(time, "%Y%m%d%H%M%S", &tm)) {
 		zc_error_prev_line("date and time is expected");
 	} else {
 		uint32_t l = htonl(mktime_from_utc(&tm));
@@ -715,7 +739,7 @@ zparser_conv_nsec(region_type *region,
 	/* The last byte used in each the window.  */
 	int size[NSEC_WINDOW_COUNT];
 
-	window_max = 1 + (nsec_highest_rcode / 256);
+	window_max = 1 + (parser->nsec_highest_rcode / 256);
 
 	/* used[i] is the i-th window included in the nsec
 	 * size[used[0]] is the size of window 0
@@ -2121,9 +2145,9 @@ process_rr(void)
 	if(rr->owner == zone->apex)
 		apex_rrset_checks(parser->db, rrset, rr->owner);
 
-	if(parser->line % ZONEC_PCT_COUNT == 0 && time(NULL) > startzonec + ZONEC_PCT_TIME) {
+	if(parser->line % ZONEC_PCT_COUNT == 0 && time(NULL) > parser->startzonec + ZONEC_PCT_TIME) {
 		struct stat buf;
-		startzonec = time(NULL);
+		parser->startzonec = time(NULL);
 		buf.st_size = 0;
 		fstat(fileno(yyin), &buf);
 		if(buf.st_size == 0) buf.st_size = 1;
@@ -2131,7 +2155,7 @@ process_rr(void)
 			parser->current_zone->opts->name,
 			(int)((uint64_t)ftell(yyin)*(uint64_t)100/(uint64_t)buf.st_size)));
 	}
-	++totalrrs;
+	++parser->totalrrs;
 	return 1;
 }
 
@@ -2192,8 +2216,8 @@ zonec_read(const char* name, const char* zonefile, zone_type* zone)
 {
 	const dname_type *dname;
 
-	totalrrs = 0;
-	startzonec = time(NULL);
+	parser->totalrrs = 0;
+	parser->startzonec = time(NULL);
 	parser->errors = 0;
 
 	dname = dname_parse(parser->rr_region, name);
@@ -2286,18 +2310,14 @@ zonec_desetup_parser(void)
 	}
 }
 
-static domain_table_type* orig_domains = NULL;
-static region_type* orig_region = NULL;
-static region_type* orig_dbregion = NULL;
-
 /** setup for string parse */
 void
 zonec_setup_string_parser(region_type* region, domain_table_type* domains)
 {
 	assert(parser); /* global parser must be setup */
-	orig_domains = parser->db->domains;
-	orig_region = parser->region;
-	orig_dbregion = parser->db->region;
+	parser->orig_domains = parser->db->domains;
+	parser->orig_region = parser->region;
+	parser->orig_dbregion = parser->db->region;
 	parser->region = region;
 	parser->db->region = region;
 	parser->db->domains = domains;
@@ -2308,9 +2328,9 @@ zonec_setup_string_parser(region_type* region, domain_table_type* domains)
 void
 zonec_desetup_string_parser(void)
 {
-	parser->region = orig_region;
-	parser->db->domains = orig_domains;
-	parser->db->region = orig_dbregion;
+	parser->region = parser->orig_region;
+	parser->db->domains = parser->orig_domains;
+	parser->db->region = parser->orig_dbregion;
 }
 
 /** parse a string into temporary storage */
@@ -2322,13 +2342,13 @@ zonec_parse_string(region_type* region, domain_table_type* domains,
 	zonec_setup_string_parser(region, domains);
 	parser->current_zone = zone;
 	parser->errors = 0;
-	totalrrs = 0;
-	startzonec = time(NULL)+100000; /* disable */
+	parser->totalrrs = 0;
+	parser->startzonec = time(NULL)+100000; /* disable */
 	parser_push_stringbuf(str);
 	yyparse();
 	parser_pop_stringbuf();
 	errors = parser->errors;
-	*num_rrs = totalrrs;
+	*num_rrs = parser->totalrrs;
 	if(*num_rrs == 0)
 		*parsed = NULL;
 	else	*parsed = parser->prev_dname;
@@ -34,7 +34,16 @@ struct lex_data {
 
 #define DEFAULT_TTL 3600
 
-/* administration struct */
+/* where the lexer is in the RR it is reading */
+enum lexer_state {
+	EXPECT_OWNER,
+	PARSING_OWNER,
+	PARSING_TTL_CLASS_TYPE,
+	PARSING_RDATA
+};
+
+/* administration struct, it holds the state of a parse, so that it is
+ * not kept in static variables in the lexer and the grammar */
 typedef struct zparser zparser_type;
 struct zparser {
 	region_type *region;	/* Allocate for parser lifetime data.  */
@@ -54,6 +63,27 @@ struct zparser {
 
 	rr_type current_rr;
 	rdata_atom_type *temporary_rdatas;
+
+	/* this hold the nxt bits */
+	uint8_t nxtbits[16];
+	/* 256 windows of 256 bits (32 bytes) */
+	uint8_t nsecbits[NSEC_WINDOW_COUNT][NSEC_WINDOW_BITS_SIZE];
+	/* hold the highest rcode seen in a NSEC rdata , BUG #106 */
+	uint16_t nsec_highest_rcode;
+	int dlv_warn;
+
+	/* lexer state */
+	int paren_open;
+	enum lexer_state lexer_state;
+
+	/* progress report and number of RRs read */
+	time_t startzonec;
+	long int totalrrs;
+
+	/* saved while parsing a string into temporary storage */
+	domain_table_type* orig_domains;
+	region_type* orig_region;
+	region_type* orig_dbregion;
 };
 
 extern zparser_type *parser;
@@ -87,6 +117,7 @@ int process_rr(void);
 uint16_t *zparser_conv_hex(region_type *region, const char *hex, size_t len);
 uint16_t *zparser_conv_hex_length(region_type *region, const char *hex, size_t len);
 uint16_t *zparser_conv_time(region_type *region, const char *time);
+int zparser_scan_time_digits(const char *time, struct tm *tm);
 uint16_t *zparser_conv_services(region_type *region, const char *protostr, char *servicestr);
 uint16_t *zparser_conv_serial(region_type *region, const char *periodstr);
 uint16_t *zparser_conv_period(region_type *region, const char *periodstr);
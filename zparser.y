@@ -26,17 +26,6 @@ extern "C"
 #endif /* __cplusplus */
 int yywrap(void);
 
-/* this hold the nxt bits */
-static uint8_t nxtbits[16];
-static int dlv_warn = 1;
-
-/* 256 windows of 256 bits (32 bytes) */
-/* still need to reset the bastard somewhere */
-static uint8_t nsecbits[NSEC_WINDOW_COUNT][NSEC_WINDOW_BITS_SIZE];
-
-/* hold the highest rcode seen in a NSEC rdata , BUG #106 */
-uint16_t nsec_highest_rcode;
-
 void yyerror(const char *message);
 
 #ifdef NSEC3
@@ -457,7 +446,7 @@ nxt_seq:	str
     {
 	    uint16_t type = rrtype_from_string($1.str);
 	    if (type != 0 && type < 128) {
-		    set_bit(nxtbits, type);
+		    set_bit(parser->nxtbits, type);
 	    } else {
 		    zc_error("bad type %d in NXT record", (int) type);
 	    }
@@ -466,7 +455,7 @@ nxt_seq:	str
     {
 	    uint16_t type = rrtype_from_string($3.str);
 	    if (type != 0 && type < 128) {
-		    set_bit(nxtbits, type);
+		    set_bit(parser->nxtbits, type);
 	    } else {
 		    zc_error("bad type %d in NXT record", (int) type);
 	    }
@@ -483,10 +472,10 @@ nsec_more:	SP nsec_more
     {
 	    uint16_t type = rrtype_from_string($1.str);
 	    if (type != 0) {
-                    if (type > nsec_highest_rcode) {
-                            nsec_highest_rcode = type;
+                    if (type > parser->nsec_highest_rcode) {
+                            parser->nsec_highest_rcode = type;
                     }
-		    set_bitnsec(nsecbits, type);
+		    set_bitnsec(parser->nsecbits, type);
 	    } else {
 		    zc_error("bad type %d in NSEC record", (int) type);
 	    }
@@ -665,8 +654,8 @@ type_and_rdata:
     |	T_APL sp rdata_unknown { $$ = $1; parse_unknown_rdata($1, $3); }
     |	T_DS sp rdata_ds
     |	T_DS sp rdata_unknown { $$ = $1; parse_unknown_rdata($1, $3); }
-    |	T_DLV sp rdata_dlv { if (dlv_warn) { dlv_warn = 0; zc_warning_prev_line("DLV is experimental"); } }
-    |	T_DLV sp rdata_unknown { if (dlv_warn) { dlv_warn = 0; zc_warning_prev_line("DLV is experimental"); } $$ = $1; parse_unknown_rdata($1, $3); }
+    |	T_DLV sp rdata_dlv { if (parser->dlv_warn) { parser->dlv_warn = 0; zc_warning_prev_line("DLV is experimental"); } }
+    |	T_DLV sp rdata_unknown { if (parser->dlv_warn) { parser->dlv_warn = 0; zc_warning_prev_line("DLV is experimental"); } $$ = $1; parse_unknown_rdata($1, $3); }
     |	T_SSHFP sp rdata_sshfp
     |	T_SSHFP sp rdata_unknown { $$ = $1; parse_unknown_rdata($1, $3); check_sshfp(); }
     |	T_RRSIG sp rdata_rrsig
@@ -866,8 +855,8 @@ rdata_loc:	concatenated_str_seq trail
 rdata_nxt:	dname sp nxt_seq trail
     {
 	    zadd_rdata_domain($1); /* nxt name */
-	    zadd_rdata_wireformat(zparser_conv_nxt(parser->region, nxtbits)); /* nxt bitlist */
-	    memset(nxtbits, 0, sizeof(nxtbits));
+	    zadd_rdata_wireformat(zparser_conv_nxt(parser->region, parser->nxtbits)); /* nxt bitlist */
+	    memset(parser->nxtbits, 0, sizeof(parser->nxtbits));
     }
     ;
 
@@ -976,9 +965,9 @@ rdata_nsec:	wire_dname nsec_seq
     {
 	    zadd_rdata_wireformat(zparser_conv_dns_name(parser->region, 
 				(const uint8_t*) $1.str, $1.len)); /* nsec name */
-	    zadd_rdata_wireformat(zparser_conv_nsec(parser->region, nsecbits)); /* nsec bitlist */
-	    memset(nsecbits, 0, sizeof(nsecbits));
-            nsec_highest_rcode = 0;
+	    zadd_rdata_wireformat(zparser_conv_nsec(parser->region, parser->nsecbits)); /* nsec bitlist */
+	    memset(parser->nsecbits, 0, sizeof(parser->nsecbits));
+            parser->nsec_highest_rcode = 0;
     }
     ;
 
@@ -988,9 +977,9 @@ rdata_nsec3:   str sp str sp str sp str sp str nsec_seq
 	    nsec3_add_params($1.str, $3.str, $5.str, $7.str, $7.len);
 
 	    zadd_rdata_wireformat(zparser_conv_b32(parser->region, $9.str)); /* next hashed name */
-	    zadd_rdata_wireformat(zparser_conv_nsec(parser->region, nsecbits)); /* nsec bitlist */
-	    memset(nsecbits, 0, sizeof(nsecbits));
-	    nsec_highest_rcode = 0;
+	    zadd_rdata_wireformat(zparser_conv_nsec(parser->region, parser->nsecbits)); /* nsec bitlist */
+	    memset(parser->nsecbits, 0, sizeof(parser->nsecbits));
+	    parser->nsec_highest_rcode = 0;
 #else
 	    zc_error_prev_line("nsec3 not supported");
 #endif /* NSEC3 */
@@ -1157,9 +1146,9 @@ rdata_csync:	str sp str nsec_seq
     {
 	    zadd_rdata_wireformat(zparser_conv_serial(parser->region, $1.str));
 	    zadd_rdata_wireformat(zparser_conv_short(parser->region, $3.str));
-	    zadd_rdata_wireformat(zparser_conv_nsec(parser->region, nsecbits)); /* nsec bitlist */
-	    memset(nsecbits, 0, sizeof(nsecbits));
-            nsec_highest_rcode = 0;
+	    zadd_rdata_wireformat(zparser_conv_nsec(parser->region, parser->nsecbits)); /* nsec bitlist */
+	    memset(parser->nsecbits, 0, sizeof(parser->nsecbits));
+            parser->nsec_highest_rcode = 0;
     }
     ;
 
@@ -1246,6 +1235,15 @@ zparser_create(region_type *region, region_type *rr_region, namedb_type *db)
 	result->temporary_rdatas = (rdata_atom_type *) region_alloc_array(
 		result->region, MAXRDATALEN, sizeof(rdata_atom_type));
 
+	result->dlv_warn = 1;
+	result->paren_open = 0;
+	result->lexer_state = EXPECT_OWNER;
+	result->startzonec = 0;
+	result->totalrrs = 0;
+	result->orig_domains = NULL;
+	result->orig_region = NULL;
+	result->orig_dbregion = NULL;
+
 	return result;
 }
 
@@ -1256,9 +1254,11 @@ void
 zparser_init(const char *filename, uint32_t ttl, uint16_t klass,
 	     const dname_type *origin)
 {
-	memset(nxtbits, 0, sizeof(nxtbits));
-	memset(nsecbits, 0, sizeof(nsecbits));
-        nsec_highest_rcode = 0;
+	memset(parser->nxtbits, 0, sizeof(parser->nxtbits));
+	memset(parser->nsecbits, 0, sizeof(parser->nsecbits));
+        parser->nsec_highest_rcode = 0;
+	parser->paren_open = 0;
+	parser->lexer_state = EXPECT_OWNER;
 
 	parser->default_ttl = ttl;
 	parser->default_class = klass;